@@ -0,0 +1,213 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "allocations.hpp"
+
+#ifdef SVN2GIT_ALLOCATIONS
+
+# include "log.hpp"
+
+# include <algorithm>
+# include <atomic>
+# include <cstdint>
+# include <cstdlib>
+# include <iomanip>
+# include <new>
+
+namespace {
+
+char const* const phase_names[allocations::phase_count] = {
+    "other", "discovery", "merge discovery", "traversal", "emission", "close"
+};
+
+// Updated with relaxed atomics: nearly all allocation is in the
+// importer's thread, so they are rarely contended
+struct counters
+{
+    std::atomic<std::uint64_t> count;
+    std::atomic<std::uint64_t> bytes;
+    std::atomic<std::int64_t> live_bytes;
+    std::atomic<std::int64_t> peak_live_bytes;  // since the last report
+};
+
+counters by_phase[allocations::phase_count];
+
+thread_local allocations::phase current_phase = allocations::other;
+
+// Each allocation is preceded by its size and phase, which keeps
+// malloc's alignment
+struct header
+{
+    std::size_t size;
+    std::size_t phase;
+};
+
+void* allocate(std::size_t size)
+{
+    header* h = static_cast<header*>(std::malloc(sizeof(header) + size));
+    if (h == nullptr)
+        return nullptr;
+    h->size = size;
+    h->phase = current_phase;
+
+    counters& c = by_phase[current_phase];
+    c.count.fetch_add(1, std::memory_order_relaxed);
+    c.bytes.fetch_add(size, std::memory_order_relaxed);
+    std::int64_t const live = c.live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+    if (live > c.peak_live_bytes.load(std::memory_order_relaxed))
+        c.peak_live_bytes.store(live, std::memory_order_relaxed);
+    return h + 1;
+}
+
+void deallocate(void* p)
+{
+    if (p == nullptr)
+        return;
+    header* h = static_cast<header*>(p) - 1;
+    by_phase[h->phase].live_bytes.fetch_sub(h->size, std::memory_order_relaxed);
+    std::free(h);
+}
+
+void* allocate_or_throw(std::size_t size)
+{
+    for (;;)
+    {
+        if (void* p = allocate(size))
+            return p;
+        std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr)
+            throw std::bad_alloc();
+        handler();
+    }
+}
+
+// Touched only by the reporting thread
+struct snapshot
+{
+    std::uint64_t count;
+    std::uint64_t bytes;
+    std::int64_t peak_live_bytes;
+};
+
+snapshot last_report[allocations::phase_count];
+snapshot run_peaks[allocations::phase_count];
+std::size_t report_interval = 0;
+std::size_t first_revnum = 0;         // of the run
+std::size_t interval_first_revnum = 0; // since the last report
+std::size_t current_revnum = 0;
+
+void write_report(char const* title, bool whole_run)
+{
+    Log::line report(Log::Info);
+    std::ostream& os = report.stream();
+    os << title << "\n"
+       << std::left << std::setw(20) << "phase" << std::right
+       << std::setw(14) << "allocations" << std::setw(12) << "MB"
+       << std::setw(12) << "mean bytes" << std::setw(12) << "live MB"
+       << std::setw(12) << "peak MB" << "\n";
+
+    os << std::fixed;
+    for (std::size_t i = 0; i < allocations::phase_count; ++i)
+    {
+        counters& c = by_phase[i];
+        std::uint64_t const count = c.count.load(std::memory_order_relaxed);
+        std::uint64_t const bytes = c.bytes.load(std::memory_order_relaxed);
+        std::int64_t const live = c.live_bytes.load(std::memory_order_relaxed);
+
+        // Start the next interval's peak from where the phase is now
+        std::int64_t const peak = c.peak_live_bytes.exchange(live, std::memory_order_relaxed);
+        run_peaks[i].peak_live_bytes = std::max(run_peaks[i].peak_live_bytes, peak);
+
+        snapshot& last = last_report[i];
+        std::uint64_t const n = whole_run ? count : count - last.count;
+        std::uint64_t const b = whole_run ? bytes : bytes - last.bytes;
+        last.count = count;
+        last.bytes = bytes;
+
+        os << std::left << std::setw(20) << phase_names[i] << std::right
+           << std::setw(14) << n
+           << std::setprecision(1) << std::setw(12) << b / 1048576.0
+           << std::setw(12) << (n ? double(b) / n : 0.0)
+           << std::setw(12) << live / 1048576.0
+           << std::setw(12) << (whole_run ? run_peaks[i].peak_live_bytes : peak) / 1048576.0
+           << "\n";
+    }
+    os.unsetf(std::ios::floatfield);
+}
+
+}
+
+allocations::phase& allocations::current()
+{
+    return current_phase;
+}
+
+void allocations::report_every(std::size_t n)
+{
+    report_interval = n;
+}
+
+void allocations::set_revision(std::size_t revnum)
+{
+    if (first_revnum == 0)
+        first_revnum = interval_first_revnum = revnum;
+    if (report_interval != 0 && current_revnum != 0 && revnum % report_interval == 0)
+    {
+        write_report(
+            ("Heap allocations by phase, r" + std::to_string(interval_first_revnum)
+             + " to r" + std::to_string(current_revnum) + ":").c_str(),
+            false);
+        interval_first_revnum = revnum;
+    }
+    current_revnum = revnum;
+}
+
+void allocations::report()
+{
+    write_report(
+        ("Heap allocations by phase, r" + std::to_string(first_revnum)
+         + " to r" + std::to_string(current_revnum) + ":").c_str(),
+        true);
+}
+
+void* operator new(std::size_t size)
+{
+    return allocate_or_throw(size);
+}
+
+void* operator new[](std::size_t size)
+{
+    return allocate_or_throw(size);
+}
+
+void* operator new(std::size_t size, std::nothrow_t const&) noexcept
+{
+    return allocate(size);
+}
+
+void* operator new[](std::size_t size, std::nothrow_t const&) noexcept
+{
+    return allocate(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    deallocate(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    deallocate(p);
+}
+
+void operator delete(void* p, std::nothrow_t const&) noexcept
+{
+    deallocate(p);
+}
+
+void operator delete[](void* p, std::nothrow_t const&) noexcept
+{
+    deallocate(p);
+}
+
+#endif // SVN2GIT_ALLOCATIONS
@@ -0,0 +1,67 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef ALLOCATIONS_DWA2013802_HPP
+# define ALLOCATIONS_DWA2013802_HPP
+
+// Heap allocation accounting by phase of importer::import_revision.
+// It is compiled in only when SVN2GIT_ALLOCATIONS is defined
+// (configure with -DALLOCATIONS=ON), when it replaces the global
+// operator new and delete; otherwise the macros below expand to
+// nothing.
+//
+//   ALLOCATION_PHASE(traversal);   // attribute allocations to the
+//                                  // phase until the end of scope
+//   ALLOCATION_REVISION(revnum);   // report, if one is due
+//
+// Each thread has its own current phase, so allocations in background
+// threads stay attributed to "other".  Memory is charged, when freed,
+// to the phase that allocated it, so a phase's live bytes are what it
+// has allocated and not yet freed.
+# ifdef SVN2GIT_ALLOCATIONS
+
+#  include <boost/preprocessor/cat.hpp>
+#  include <cstddef>
+
+struct allocations
+{
+    enum phase
+    {
+        other, discovery, merge_discovery, traversal, emission, close,
+        phase_count
+    };
+
+    struct scope
+    {
+        explicit scope(phase p) : saved(current()) { current() = p; }
+        ~scope() { current() = saved; }
+
+     private:
+        scope(scope const&);
+        phase saved;
+    };
+
+    // The phase to charge the calling thread's allocations to
+    static phase& current();
+
+    // Also report every n revisions
+    static void report_every(std::size_t n);
+
+    static void set_revision(std::size_t revnum);
+
+    // Write the totals since the last report, and for the whole run
+    static void report();
+};
+
+#  define ALLOCATION_PHASE(p) \
+    allocations::scope BOOST_PP_CAT(allocation_phase_, __LINE__)(allocations::p)
+#  define ALLOCATION_REVISION(revnum) allocations::set_revision(revnum)
+
+# else
+
+#  define ALLOCATION_PHASE(p)
+#  define ALLOCATION_REVISION(revnum)
+
+# endif
+
+#endif // ALLOCATIONS_DWA2013802_HPP
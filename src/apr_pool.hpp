@@ -20,18 +20,22 @@
 
 #include <apr_general.h>
 #include <svn_pools.h>
+#include <cstddef>
+#include <vector>
+
+class AprPoolRecycler;
 
 class AprPool
   {
   public:
     AprPool(apr_pool_t *parent = 0)
+      : recycler(0)
       {
       pool = svn_pool_create(parent);
       }
     ~AprPool()
       {
-      if (pool)
-          svn_pool_destroy(pool);
+      release();
       }
 
     AprPool(AprPool const&) = delete;
@@ -40,14 +44,15 @@ class AprPool
     AprPool(AprPool&& rhs) 
       { 
       pool = rhs.pool; 
+      recycler = rhs.recycler;
       rhs.pool = 0; 
       }
 
     AprPool& operator=(AprPool&& rhs) 
       { 
-      if (pool) 
-        svn_pool_destroy(pool); 
+      release();
       pool = rhs.pool; 
+      recycler = rhs.recycler;
       rhs.pool = 0; 
       return *this;
       }
@@ -69,7 +74,78 @@ class AprPool
       return pool;
       }
   private:
+    friend class AprPoolRecycler;
+
+    AprPool(apr_pool_t *pool, AprPoolRecycler *recycler)
+      : pool(pool), recycler(recycler)
+      {
+      }
+
+    inline void release();
+
     apr_pool_t *pool;
+    AprPoolRecycler *recycler;   // where the pool goes back to, if anywhere
+  };
+
+// Lends out subpools of a parent pool, and takes them back cleared
+// when they go out of scope, so that a pool per call or per revision
+// costs a clear rather than a create and destroy.  At most max_free
+// pools are kept for reuse; the rest are destroyed when returned.
+class AprPoolRecycler
+  {
+  public:
+    AprPoolRecycler(AprPool const& parent, std::size_t max_free)
+      : parent(parent), max_free(max_free)
+      {
+      }
+    ~AprPoolRecycler()
+      {
+      for (apr_pool_t *p : free)
+          svn_pool_destroy(p);
+      }
+
+    AprPoolRecycler(AprPoolRecycler const&) = delete;
+    void operator=(AprPoolRecycler const&) = delete;
+
+    AprPool acquire()
+      {
+      if (free.empty())
+          return AprPool(svn_pool_create(parent), this);
+      apr_pool_t *p = free.back();
+      free.pop_back();
+      return AprPool(p, this);
+      }
+
+  private:
+    friend class AprPool;
+
+    void recycle(apr_pool_t *pool)
+      {
+      if (free.size() < max_free)
+        {
+        svn_pool_clear(pool);
+        free.push_back(pool);
+        }
+      else
+        {
+        svn_pool_destroy(pool);
+        }
+      }
+
+    AprPool const& parent;
+    std::size_t const max_free;
+    std::vector<apr_pool_t*> free;
   };
 
+inline void AprPool::release()
+  {
+  if (!pool)
+      return;
+  if (recycler)
+      recycler->recycle(pool);
+  else
+      svn_pool_destroy(pool);
+  pool = 0;
+  }
+
 #endif /* APR_POOL_HPP */
@@ -5,16 +5,29 @@
 #include "to_string.hpp"
 #include "AST.hpp"
 #include "ruleset.hpp"
+#include "rules_cache.hpp"
 #include "marks_file_name.hpp"
 #include <boost/program_options.hpp>
 #include <boost/foreach.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/iostreams/device/file_descriptor.hpp>
+#include <boost/process.hpp>
 #include <set>
 #include <map>
 #include <fstream>
-#include <boost/lexical_cast.hpp>
 #include <iostream>
-#include <boost/algorithm/string/predicate.hpp>
 #include <boost/range/adaptor/map.hpp>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 namespace fix_submodule {
 
@@ -32,105 +45,267 @@ typedef std::map<std::string, Repository const*> SubmoduleMap;
 struct Options
   {
   std::string rules_file;
+  std::string rules_cache;
   std::string repo_name;
+  bool marks_index;
+  bool verify_marks_index;
+  bool all;
+  unsigned jobs;
+  std::string git_executable;
+  std::string fixup_suffix;
   };
 
 Options options;
 
 void read_marks_file(Repository& repo)
   {
-  std::ifstream marks(marks_file_path(repo.name).c_str());
-  marks.exceptions( std::ifstream::badbit );
-  char colon, newline;
-  std::pair<unsigned long, std::string> mark_sha;
-  while (marks >> colon >> mark_sha.first >> mark_sha.second)
-    {
-    if (colon != ':')
-        throw std::runtime_error("Expected colon in marks file!");
-    marks.read(&newline, 1);
-    if (newline != '\n')
-        throw std::runtime_error("Expected newline in marks file!");
-
-    // Insert the mapping.  All kinds of efficiencies are possible
-    // here, but I was more interested in getting the logic right.
-    mark_sha_map::iterator where = find_sha_pos(repo.mark2sha, mark_sha.first);
-    
-    // Make sure we're not mapping the same mark twice.
-    if (where != repo.mark2sha.end() && where->first == mark_sha.first)
-        throw std::runtime_error("Duplicate mark mapping!");
-    
-    repo.mark2sha.insert(where, mark_sha);
-    }
+  repo.mark2sha.load(marks_file_path(repo.name), options.marks_index, options.verify_marks_index);
   }
 
-void transform_import_stream(
-    Repository const& super_module,
-    SubmoduleMap const& submodules
-  )
+// Copies a git fast-import stream from one file descriptor to
+// another, replacing the decimal marks that svn2git writes in place
+// of SHAs in submodule gitlinks ("M 160000 <mark> <path>") with the
+// SHAs of the corresponding submodule commits.
+//
+// Input is read in large blocks.  Unmodified bytes, including blob
+// payloads, are written straight out of the input buffer, and blob
+// payloads that extend past it are moved with splice(2) where the
+// platform supports it.  Only gitlink lines are ever reformatted.
+class import_stream_rewriter
   {
-  std::istream& in = std::cin;
-  std::ostream& out = std::cout;
-    
-  char const submodule_prefix[] = "M 160000 ";
-  std::size_t const submodule_prefix_length = std::strlen(submodule_prefix);
-  std::size_t const sha_length = 40;
-
-  char const data_prefix[] = "data ";
-  std::size_t const data_prefix_length = std::strlen(data_prefix);
-
-  in.exceptions( std::istream::badbit );
-  out.exceptions( std::ostream::failbit | std::ostream::badbit );
-  
-  std::string line;
-  while (getline(in, line))
-    {
-    if (boost::starts_with(line, submodule_prefix))
+  public:
+    import_stream_rewriter(int in_fd, int out_fd, SubmoduleMap const& submodules)
+      : in_fd(in_fd), out_fd(out_fd), submodules(submodules),
+        buf(buffer_size), begin(0), end(0), pending(0)
       {
-      unsigned long mark = boost::lexical_cast<unsigned long>(
-          line.substr(submodule_prefix_length, sha_length));
-      std::string submodule_path = line.substr(submodule_prefix_length + sha_length + 1);
+      }
 
-      SubmoduleMap::const_iterator sub_repo = submodules.find(submodule_path);
-      assert(sub_repo != submodules.end());
-        
-      mark_sha_map::const_iterator const mark_sha = find_sha_pos(sub_repo->second->mark2sha, mark);
-      if (mark_sha->first != mark)
+    void run()
+      {
+      while (std::size_t line_length = next_line())
         {
-        throw std::runtime_error(
-            "unmapped mark " + to_string(mark) + "in " + marks_file_path(sub_repo->second->name)
-          );
+        char const* line = buf.data() + begin;
+        if (starts_with(line, line_length, submodule_prefix, submodule_prefix_length))
+          {
+          rewrite_gitlink(line, line_length);
+          }
+        else if (starts_with(line, line_length, data_prefix, data_prefix_length))
+          {
+          begin += line_length;
+          skip_data(parse_number(line + data_prefix_length, line_length - data_prefix_length - 1));
+          }
+        else
+          {
+          begin += line_length;
+          }
         }
-      out << submodule_prefix << mark_sha->second << " " << submodule_path << "\n";
+      flush();
       }
-    else
+
+  private:
+    static std::size_t const buffer_size = 4 << 20;
+    static char const submodule_prefix[];
+    static std::size_t const submodule_prefix_length = 9;
+    static char const data_prefix[];
+    static std::size_t const data_prefix_length = 5;
+    static std::size_t const sha_length = 40;
+
+    static bool starts_with(
+        char const* line, std::size_t length, char const* prefix, std::size_t prefix_length)
       {
-      out << line << "\n";
+      return length >= prefix_length && std::memcmp(line, prefix, prefix_length) == 0;
+      }
+
+    static std::size_t parse_number(char const* p, std::size_t length)
+      {
+      if (length == 0)
+          throw std::runtime_error("expected a number in fast-import stream");
+      std::size_t result = 0;
+      for (char const* e = p + length; p != e; ++p)
+        {
+        if (*p < '0' || *p > '9')
+            throw std::runtime_error("expected a number in fast-import stream");
+        result = result * 10 + (*p - '0');
+        }
+      return result;
+      }
+
+    // Make a complete line available at buf[begin] and return its
+    // length, including the terminating newline.  Returns zero at
+    // the end of input.
+    std::size_t next_line()
+      {
+      for (std::size_t scanned = begin;;)
+        {
+        if (char const* nl = static_cast<char const*>(
+                std::memchr(buf.data() + scanned, '\n', end - scanned)))
+          {
+          return nl + 1 - (buf.data() + begin);
+          }
+        scanned = end - begin;
+        if (!fill())
+          {
+          if (begin != end)
+              throw std::runtime_error("unterminated line at end of fast-import stream");
+          return 0;
+          }
+        scanned += begin;
+        }
+      }
+
+    // Read more input, after moving the unconsumed tail of the buffer
+    // to its front.  Returns false at end of input.
+    bool fill()
+      {
+      flush();
+      std::memmove(buf.data(), buf.data() + begin, end - begin);
+      end -= begin;
+      begin = pending = 0;
+      if (end == buf.size())
+          buf.resize(buf.size() * 2);
+
+      ssize_t n;
+      while ((n = ::read(in_fd, buf.data() + end, buf.size() - end)) < 0 && errno == EINTR)
+        {
+        }
+      if (n < 0)
+          throw std::runtime_error("error reading fast-import stream: " + std::string(std::strerror(errno)));
+      end += n;
+      return n > 0;
+      }
+
+    // Write the input consumed so far but not yet written
+    void flush()
+      {
+      write_out(buf.data() + pending, begin - pending);
+      pending = begin;
+      }
+
+    void write_out(char const* data, std::size_t size)
+      {
+      while (size > 0)
+        {
+        ssize_t n = ::write(out_fd, data, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            throw std::runtime_error("error writing fast-import stream: " + std::string(std::strerror(errno)));
+        data += n;
+        size -= n;
+        }
       }
 
-    if (boost::starts_with(line, data_prefix))
+    // Pass length bytes of raw data through unchanged
+    void skip_data(std::size_t length)
       {
-      std::size_t length = boost::lexical_cast<std::size_t>(
-          line.substr(data_prefix_length));
-        
+      std::size_t available = std::min(length, end - begin);
+      begin += available;
+      length -= available;
+      if (length == 0)
+          return;
+
+      flush();
+#ifdef __linux__
       while (length > 0)
         {
-        char buf[2048];
-        std::size_t num_to_read = std::min(length, sizeof(buf));
-        in.read(buf, num_to_read);
-        out.write(buf, num_to_read);
-        length -= num_to_read;
+        ssize_t n = ::splice(in_fd, nullptr, out_fd, nullptr, length, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            break; // not a pipe; fall back to copying
+        if (n == 0)
+            throw std::runtime_error("unexpected end of fast-import stream in data");
+        length -= n;
+        }
+#endif
+      while (length > 0)
+        {
+        if (!fill())
+            throw std::runtime_error("unexpected end of fast-import stream in data");
+        available = std::min(length, end - begin);
+        begin += available;
+        length -= available;
         }
       }
-    }
+
+    void rewrite_gitlink(char const* line, std::size_t length)
+      {
+      if (length < submodule_prefix_length + sha_length + 2)
+          throw std::runtime_error("malformed gitlink: " + std::string(line, length));
+
+      unsigned long mark = parse_number(line + submodule_prefix_length, sha_length);
+      std::string submodule_path(
+          line + submodule_prefix_length + sha_length + 1,
+          line + length - 1);
+
+      SubmoduleMap::const_iterator sub_repo = submodules.find(submodule_path);
+      if (sub_repo == submodules.end())
+          throw std::runtime_error("gitlink to unknown submodule " + submodule_path);
+
+      unsigned char const* const sha = sub_repo->second->mark2sha.find(mark);
+      if (sha == nullptr)
+        {
+        throw std::runtime_error(
+            "unmapped mark " + to_string(mark) + " in " + marks_file_path(sub_repo->second->name)
+          );
+        }
+
+      // Write everything preceding the SHA, then the SHA, and leave
+      // the rest of the line pending.
+      begin += submodule_prefix_length;
+      flush();
+      char hex[sha_length];
+      sha_to_hex(sha, hex);
+      write_out(hex, sha_length);
+      begin += length - submodule_prefix_length;
+      pending += sha_length;
+      }
+
+  private:
+    int in_fd;
+    int out_fd;
+    SubmoduleMap const& submodules;
+    std::vector<char> buf;
+    std::size_t begin;          // start of unconsumed input
+    std::size_t end;            // end of valid input
+    std::size_t pending;        // start of consumed input not yet written
+  };
+
+char const import_stream_rewriter::submodule_prefix[] = "M 160000 ";
+char const import_stream_rewriter::data_prefix[] = "data ";
+
+void transform_import_stream(
+    int in_fd,
+    int out_fd,
+    SubmoduleMap const& submodules
+  )
+  {
+  import_stream_rewriter(in_fd, out_fd, submodules).run();
   }
 
-void run()
+// Read the repository declarations of the rules file
+void read_repositories(RepoStore& repo_store)
   {
   using boost2git::AST;
-  
-  AST const ast = parse_rules_file(options.rules_file);
-  
-  RepoStore repo_store;
+
+  // Use svn2git's compiled ruleset if it's up to date
+  AST ast;
+  bool cached = false;
+  if (!options.rules_cache.empty())
+    {
+    rules_cache_file cache(options.rules_cache, options.rules_file);
+    if (cache.valid())
+      {
+      rules_cache_reader in = cache.contents();
+      ast = load_ast(in);
+      cached = true;
+      }
+    }
+  if (!cached)
+    {
+    ast = parse_rules_file(options.rules_file);
+    }
+
   BOOST_FOREACH(AST::const_reference repo_rule, ast)
     {
     Repository& repo = repo_store[repo_rule.git_repo_name];
@@ -142,23 +317,206 @@ void run()
       repo.submodule_path = repo_rule.submodule_info[1];
       }
     }
+  }
 
-  // Verify that the specified repository actually exists in the map
-  RepoStore::iterator const p = repo_store.find(options.repo_name);
-  if (p == repo_store.end())
-      throw std::runtime_error("repository " + options.repo_name + " not found in ruleset");
-
+// The submodules of the given repository, keyed by path.  Their
+// marks files must already have been read.
+SubmoduleMap submodules_of(RepoStore const& repo_store, Repository const* super)
+  {
   SubmoduleMap submodules;
-  // Read all relevant marks files
+  BOOST_FOREACH(Repository const& repo, repo_store | boost::adaptors::map_values)
+    {
+    if (repo.submodule_in_repo == super)
+        submodules[repo.submodule_path] = &repo;
+    }
+  return submodules;
+  }
+
+// A pipe whose descriptors are not inherited by child processes, so
+// that concurrent pipelines don't keep each other's pipes open.  The
+// descriptors are close-on-exec from the start; setting the flag
+// afterwards would leave a window in which another job's fork could
+// inherit them.
+boost::process::pipe create_private_pipe()
+  {
+  int fds[2];
+  if (::pipe2(fds, O_CLOEXEC) == -1)
+      throw std::runtime_error("pipe2(2) failed: " + std::string(std::strerror(errno)));
+  return boost::process::pipe(fds[0], fds[1]);
+  }
+
+std::string const& git_executable()
+  {
+  static std::string const git_exe = options.git_executable.empty()
+    ? boost::process::search_path("git")
+    : options.git_executable;
+  return git_exe;
+  }
+
+void check_exit_status(int status, std::string const& command, std::string const& repo_name)
+  {
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+      throw std::runtime_error(command + " failed in repository " + repo_name);
+  }
+
+// Write the history of the given repository, with its gitlinks
+// fixed, into a fresh repository named by appending the fixup suffix:
+//
+//   git fast-export --all | <rewriter> | git fast-import --force
+void rewrite_repository(Repository const& repo, SubmoduleMap const& submodules)
+  {
+  namespace process = boost::process;
+  namespace iostreams = boost::iostreams;
+  using namespace process::initializers;
+
+  std::string const dst_dir = repo.name + options.fixup_suffix;
+  boost::filesystem::create_directories(dst_dir);
+
+  std::array<std::string, 4> const init_args = { git_executable(), "init", "--bare", "--quiet" };
+  check_exit_status(
+      process::wait_for_exit(
+          process::execute(
+              run_exe(git_executable()), set_args(init_args),
+              start_in_dir(dst_dir), throw_on_error())),
+      "git init", dst_dir);
+
+  process::pipe exported = create_private_pipe();
+  process::pipe rewritten = create_private_pipe();
+  iostreams::file_descriptor_source from_export(exported.source, iostreams::close_handle);
+  iostreams::file_descriptor_sink to_import(rewritten.sink, iostreams::close_handle);
+
+  std::array<std::string, 4> const import_args = { git_executable(), "fast-import", "--quiet", "--force" };
+  process::child importer = process::execute(
+      run_exe(git_executable()), set_args(import_args), start_in_dir(dst_dir),
+      bind_stdin(iostreams::file_descriptor_source(rewritten.source, iostreams::close_handle)),
+      throw_on_error());
+
+  std::array<std::string, 3> const export_args = { git_executable(), "fast-export", "--all" };
+  process::child exporter = process::execute(
+      run_exe(git_executable()), set_args(export_args), start_in_dir(repo.name),
+      bind_stdout(iostreams::file_descriptor_sink(exported.sink, iostreams::close_handle)),
+      throw_on_error());
+
+  // Closing our ends of the pipes lets both processes run to
+  // completion even if the rewriter gave up early.
+  std::string error;
+  try
+    {
+    import_stream_rewriter(from_export.handle(), to_import.handle(), submodules).run();
+    }
+  catch (std::exception const& e)
+    {
+    error = e.what();
+    }
+  from_export.close();
+  to_import.close();
+  int const export_status = process::wait_for_exit(exporter);
+  int const import_status = process::wait_for_exit(importer);
+
+  if (!error.empty())
+      throw std::runtime_error(error + " in repository " + repo.name);
+  check_exit_status(export_status, "git fast-export", repo.name);
+  check_exit_status(import_status, "git fast-import", dst_dir);
+  }
+
+// Rewrite every repository that has submodules, running up to
+// options.jobs pipelines at once.  Largest repositories are started
+// first, so that the run takes about as long as the largest one.
+bool rewrite_all(RepoStore const& repo_store)
+  {
+  std::vector<Repository const*> supers;
+  BOOST_FOREACH(Repository const& repo, repo_store | boost::adaptors::map_values)
+    {
+    if (repo.submodule_in_repo != nullptr
+        && std::find(supers.begin(), supers.end(), repo.submodule_in_repo) == supers.end())
+      {
+      supers.push_back(repo.submodule_in_repo);
+      }
+    }
+
+  // The marks file grows with the number of commits, which makes it
+  // a fair estimate of the work in each pipeline
+  std::map<Repository const*, boost::uintmax_t> sizes;
+  BOOST_FOREACH(Repository const* repo, supers)
+    {
+    boost::system::error_code ec;
+    sizes[repo] = boost::filesystem::file_size(marks_file_path(repo->name), ec);
+    if (ec)
+        sizes[repo] = 0;
+    }
+  std::stable_sort(supers.begin(), supers.end(),
+      [&sizes](Repository const* lhs, Repository const* rhs)
+        {
+        return sizes[lhs] > sizes[rhs];
+        });
+
+  std::atomic<std::size_t> next_job(0);
+  std::atomic<bool> failed(false);
+  std::mutex output_mutex;
+
+  auto worker = [&]
+    {
+    for (std::size_t i; (i = next_job++) < supers.size();)
+      {
+      Repository const& repo = *supers[i];
+        {
+        std::lock_guard<std::mutex> lock(output_mutex);
+        std::cerr << "fixing submodule references in " << repo.name << std::endl;
+        }
+      try
+        {
+        rewrite_repository(repo, submodules_of(repo_store, &repo));
+        }
+      catch (std::exception const& error)
+        {
+        std::lock_guard<std::mutex> lock(output_mutex);
+        std::cerr << error.what() << std::endl;
+        failed = true;
+        }
+      }
+    };
+
+  std::vector<std::thread> threads;
+  std::size_t const thread_count = std::min<std::size_t>(std::max(options.jobs, 1u), supers.size());
+  for (std::size_t i = 0; i < thread_count; ++i)
+      threads.push_back(std::thread(worker));
+  BOOST_FOREACH(std::thread& t, threads)
+      t.join();
+
+  return !failed;
+  }
+
+bool run()
+  {
+  RepoStore repo_store;
+  read_repositories(repo_store);
+
+  // Read the marks file of every submodule once; the tables are
+  // shared read-only by all pipelines
   BOOST_FOREACH(Repository& repo, repo_store | boost::adaptors::map_values)
     {
-    if (repo.submodule_in_repo == &p->second)
+    if (repo.submodule_in_repo != nullptr
+        && (options.all || repo.submodule_in_repo->name == options.repo_name))
       {
-        read_marks_file(repo);
-        submodules[repo.submodule_path] = &repo;
+      read_marks_file(repo);
       }
     }
-  transform_import_stream(p->second, submodules);
+
+  if (options.all)
+    {
+    // A write to a pipeline whose fast-import died should fail
+    // that pipeline only
+    ::signal(SIGPIPE, SIG_IGN);
+    return rewrite_all(repo_store);
+    }
+
+  // Verify that the specified repository actually exists in the map
+  RepoStore::const_iterator const p = repo_store.find(options.repo_name);
+  if (p == repo_store.end())
+      throw std::runtime_error("repository " + options.repo_name + " not found in ruleset");
+
+  transform_import_stream(STDIN_FILENO, STDOUT_FILENO, submodules_of(repo_store, &p->second));
+  return true;
   }
 } // namespace fix_submodule
 
@@ -171,23 +529,44 @@ int main(int argc, char **argv)
     ("help,h", "produce help message")
     ("rules", po::value(&options.rules_file)->value_name("FILENAME")->required(),
       "file with the conversion rules")
-    ("repo-name", po::value(&options.repo_name)->value_name("IDENTIFIER")->required(),
-      "name of the repository to rewrite")
+    ("rules-cache", po::value(&options.rules_cache)->value_name("FILENAME"),
+      "read the rules from svn2git's compiled ruleset, if it is up to date")
+    ("repo-name", po::value(&options.repo_name)->value_name("IDENTIFIER"),
+      "name of the repository whose fast-import stream to rewrite from stdin to stdout")
+    ("all", "rewrite every repository with submodules into a new repository")
+    ("jobs,j", po::value(&options.jobs)->value_name("NUMBER")
+      ->default_value(std::max(std::thread::hardware_concurrency(), 1u)),
+      "number of repositories to rewrite at once with --all")
+    ("git", po::value(&options.git_executable)->value_name("PATH"),
+      "Git executable to use with --all")
+    ("fixup-suffix", po::value(&options.fixup_suffix)->value_name("SUFFIX")->default_value("-fixup"),
+      "suffix of the names of the repositories written with --all")
+    ("marks-index", "keep a binary index next to each marks file for faster reloading")
+    ("verify-marks-index", "with --marks-index, also check each index against a CRC of its marks file, which means reading the marks file")
     ;
   po::variables_map variables;
   store(po::command_line_parser(argc, argv)
     .options(program_options)
     .run(), variables);
   notify(variables);
+  options.marks_index = variables.count("marks-index") > 0;
+  options.verify_marks_index = variables.count("verify-marks-index") > 0;
+  options.all = variables.count("all") > 0;
   if (variables.count("help"))
     {
     std::cout << program_options << std::endl;
     return 0;
     }
+  if (options.all == !options.repo_name.empty())
+    {
+    std::cerr << "exactly one of --repo-name and --all is required" << std::endl;
+    return -1;
+    }
 
   try
     {
-    fix_submodule::run();
+    if (!fix_submodule::run())
+        return -1;
     }
   catch (std::exception& error)
     {
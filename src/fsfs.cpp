@@ -0,0 +1,686 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "fsfs.hpp"
+#include "svndiff.hpp"
+
+#include <boost/filesystem/operations.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+// Sizes of the caches
+std::size_t const max_mapped_files = 512;
+std::size_t const fulltext_bytes = 256 << 20;
+std::size_t const directory_entries = 1 << 20;
+
+void malformed(std::string const& what)
+{
+    throw std::runtime_error("malformed FSFS repository: " + what);
+}
+
+std::string read_file(std::string const& filename)
+{
+    std::ifstream in(filename.c_str(), std::ios::binary);
+    if (!in)
+        throw std::runtime_error("cannot read " + filename);
+    return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+// A cursor over text in memory
+struct reader
+{
+    reader(char const* pos, char const* end) : pos(pos), end(end) {}
+
+    // The next line, without its newline
+    std::string line()
+    {
+        char const* const nl = static_cast<char const*>(std::memchr(pos, '\n', end - pos));
+        if (nl == nullptr)
+            malformed("unterminated line");
+        std::string result(pos, nl);
+        pos = nl + 1;
+        return result;
+    }
+
+    std::string bytes(std::uint64_t n)
+    {
+        if (n > std::uint64_t(end - pos))
+            malformed("truncated data");
+        std::string result(pos, pos + n);
+        pos += n;
+        return result;
+    }
+
+    char const* pos;
+    char const* end;
+};
+
+std::uint64_t to_uint(std::string const& s)
+{
+    if (s.empty() || s.find_first_not_of("0123456789") != std::string::npos)
+        malformed("expected a number, got \"" + s + "\"");
+    return std::strtoull(s.c_str(), nullptr, 10);
+}
+
+std::vector<std::string> words(std::string const& s)
+{
+    std::istringstream in(s);
+    return std::vector<std::string>(
+        (std::istream_iterator<std::string>(in)), std::istream_iterator<std::string>());
+}
+
+// Parse a hash dump ("K <len>\n<key>\nV <len>\n<value>\n"..."END\n")
+template <class F>
+void parse_hash(reader& in, F f)
+{
+    for (;;)
+    {
+        std::string const line = in.line();
+        if (line == "END")
+            return;
+        if (line.size() < 3 || line[0] != 'K' || line[1] != ' ')
+            malformed("bad hash key line \"" + line + "\"");
+        std::string const key = in.bytes(to_uint(line.substr(2)));
+        if (!in.line().empty())
+            malformed("bad hash key");
+
+        std::string const vline = in.line();
+        if (vline.size() < 3 || vline[0] != 'V' || vline[1] != ' ')
+            malformed("bad hash value line \"" + vline + "\"");
+        std::string const value = in.bytes(to_uint(vline.substr(2)));
+        if (!in.line().empty())
+            malformed("bad hash value");
+        f(key, value);
+    }
+}
+
+// "<node>.<copy>.r<rev>/<offset>"
+std::pair<long, std::uint64_t> parse_id(std::string const& id)
+{
+    std::string::size_type const r = id.rfind(".r");
+    std::string::size_type const slash = id.find('/', r);
+    if (r == std::string::npos || slash == std::string::npos)
+        malformed("bad node-revision id \"" + id + "\"");
+    return std::make_pair(
+        long(to_uint(id.substr(r + 2, slash - r - 2))), to_uint(id.substr(slash + 1)));
+}
+
+// Find the offsets of the root node-revision and the changed-path
+// list in the trailer of a revision, "\n<root> <changes>\n"
+void parse_trailer(
+    long rev, char const* begin, char const* end, std::uint64_t& root, std::uint64_t& changes)
+{
+    if (end - begin < 2 || end[-1] != '\n')
+        malformed("r" + std::to_string(rev) + " has no trailer");
+    char const* trailer = end - 1;
+    while (trailer != begin && trailer[-1] != '\n')
+        --trailer;
+    std::vector<std::string> const offsets = words(std::string(trailer, end - 1));
+    if (offsets.size() != 2)
+        malformed("r" + std::to_string(rev) + " has a bad trailer");
+    root = to_uint(offsets[0]);
+    changes = to_uint(offsets[1]);
+    if (root >= std::uint64_t(end - begin) || changes >= std::uint64_t(end - begin))
+        malformed("r" + std::to_string(rev) + " has a bad trailer");
+}
+
+bool starts_with(std::string const& s, char const* prefix)
+{
+    return s.compare(0, std::strlen(prefix), prefix) == 0;
+}
+
+// Call f(w, path, copyfrom) with each entry of the changed-path list
+// of rev, which starts at in.  Each is "<id> <kind>[-<node kind>]
+// <text-mod> <prop-mod> [<mergeinfo-mod>] /<path>", whose words
+// before the path are passed as w, and a line holding "<rev> /<path>"
+// for copies, or nothing; a blank line ends the list.
+template <class F>
+void for_each_changed_path(long rev, reader& in, F f)
+{
+    for (std::string line = in.line(); !line.empty(); line = in.line())
+    {
+        std::string::size_type const slash = line.find(" /");
+        if (slash == std::string::npos)
+            malformed("r" + std::to_string(rev) + " changed path \"" + line + "\"");
+        std::vector<std::string> const w = words(line.substr(0, slash));
+        if (w.size() < 4)
+            malformed("r" + std::to_string(rev) + " changed path \"" + line + "\"");
+        f(w, line.substr(slash + 2), in.line());
+    }
+}
+
+}
+
+fsfs::fsfs(std::string const& repo_path)
+    : db(repo_path + "/db"),
+      format(0),
+      shard_size(0),
+      min_unpacked(0),
+      files(max_mapped_files),
+      fulltexts(fulltext_bytes),
+      directories(directory_entries)
+{
+    std::string const type = db + "/fs-type";
+    if (boost::filesystem::exists(type) && words(read_file(type)) != std::vector<std::string>(1, "fsfs"))
+        throw std::runtime_error(repo_path + " is not an FSFS repository");
+
+    std::istringstream in(read_file(db + "/format"));
+    std::string line;
+    if (!(in >> format) || format < 1)
+        malformed(db + "/format");
+    if (format > 8)
+        throw std::runtime_error("unsupported FSFS format " + std::to_string(format));
+
+    std::getline(in, line);
+    while (std::getline(in, line))
+    {
+        std::vector<std::string> const w = words(line);
+        if (w.size() == 3 && w[0] == "layout" && w[1] == "sharded")
+            shard_size = long(to_uint(w[2]));
+        else if (w.size() == 2 && w[0] == "addressing" && w[1] != "physical")
+            throw std::runtime_error(
+                "FSFS repositories with " + w[1] + " addressing are not supported");
+    }
+    min_unpacked = min_unpacked_rev();
+}
+
+long fsfs::youngest() const
+{
+    // In format 1, "current" also holds the next node and copy ids
+    return long(to_uint(words(read_file(db + "/current")).at(0)));
+}
+
+long fsfs::min_unpacked_rev() const
+{
+    if (format < 4 || !boost::filesystem::exists(db + "/min-unpacked-rev"))
+        return 0;
+    return long(to_uint(words(read_file(db + "/min-unpacked-rev")).at(0)));
+}
+
+std::string fsfs::revision_path(long rev, bool packed) const
+{
+    if (shard_size == 0)
+        return db + "/revs/" + std::to_string(rev);
+    std::string const shard = std::to_string(rev / shard_size);
+    if (packed)
+        return db + "/revs/" + shard + ".pack";
+    return db + "/revs/" + shard + "/" + std::to_string(rev);
+}
+
+std::shared_ptr<fsfs::mapped_file const> fsfs::map_file(std::string const& filename, bool pack) const
+{
+    if (auto f = files.find(filename))
+        return f;
+
+    auto f = std::make_shared<mapped_file>();
+    if (pack)
+    {
+        std::istringstream manifest(read_file(filename + "/manifest"));
+        std::string offset;
+        while (manifest >> offset)
+            f->manifest.push_back(to_uint(offset));
+        f->filename = filename + "/pack";
+    }
+    else
+    {
+        f->filename = filename;
+    }
+    f->file.open(f->filename);
+    files.insert(filename, f, 1);
+    return f;
+}
+
+fsfs::revision_data fsfs::revision(long rev) const
+{
+    bool packed;
+    {
+        std::lock_guard<std::mutex> guard(min_unpacked_lock);
+        packed = rev < min_unpacked;
+    }
+
+    std::shared_ptr<mapped_file const> f;
+    try
+    {
+        f = map_file(revision_path(rev, packed), packed);
+    }
+    catch (std::exception const&)
+    {
+        // The repository may have been packed since we last looked
+        long const latest = min_unpacked_rev();
+        {
+            std::lock_guard<std::mutex> guard(min_unpacked_lock);
+            min_unpacked = latest;
+        }
+        if (packed || rev >= latest)
+            throw;
+        packed = true;
+        f = map_file(revision_path(rev, packed), packed);
+    }
+
+    revision_data result;
+    result.holder = f;
+    char const* const data = result.holder->file.data();
+    result.begin = data;
+    result.end = data + result.holder->file.size();
+
+    if (packed)
+    {
+        auto const& manifest = result.holder->manifest;
+        std::size_t const i = rev % shard_size;
+        if (i >= manifest.size() || manifest[i] > result.holder->file.size())
+            malformed("pack manifest for r" + std::to_string(rev));
+        result.begin = data + manifest[i];
+        if (i + 1 < manifest.size())
+        {
+            if (manifest[i + 1] < manifest[i] || manifest[i + 1] > result.holder->file.size())
+                malformed("pack manifest for r" + std::to_string(rev));
+            result.end = data + manifest[i + 1];
+        }
+    }
+    return result;
+}
+
+std::string fsfs::revprops_path(long rev) const
+{
+    if (shard_size == 0)
+        return db + "/revprops/" + std::to_string(rev);
+    return db + "/revprops/" + std::to_string(rev / shard_size) + "/" + std::to_string(rev);
+}
+
+std::map<std::string, std::string> fsfs::revision_properties(long rev) const
+{
+    std::map<std::string, std::string> props;
+    auto const insert = [&](std::string const& k, std::string const& v) { props[k] = v; };
+
+    std::string const unpacked = revprops_path(rev);
+    if (boost::filesystem::exists(unpacked) || shard_size == 0)
+    {
+        std::string const text = read_file(unpacked);
+        reader in(text.data(), text.data() + text.size());
+        parse_hash(in, insert);
+        return props;
+    }
+
+    // Packed revprops: the manifest names the pack file of each
+    // revision in the shard.  A pack holds its first revision, the
+    // number of revisions and the size of each one's properties, a
+    // blank line, then the properties themselves.
+    std::string const pack_dir = db + "/revprops/" + std::to_string(rev / shard_size) + ".pack";
+    std::vector<std::string> const manifest = words(read_file(pack_dir + "/manifest"));
+    std::size_t const i = rev % shard_size;
+    if (i >= manifest.size())
+        malformed(pack_dir + "/manifest");
+
+    std::string const packed = read_file(pack_dir + "/" + manifest[i]);
+    std::string const text = svndiff::decompress(packed.data(), packed.size());
+    reader in(text.data(), text.data() + text.size());
+    long const first = long(to_uint(in.line()));
+    std::uint64_t const count = to_uint(in.line());
+    if (rev < first || std::uint64_t(rev - first) >= count)
+        malformed(pack_dir + "/" + manifest[i]);
+
+    std::vector<std::uint64_t> sizes;
+    for (std::uint64_t n = 0; n < count; ++n)
+        sizes.push_back(to_uint(in.line()));
+    if (!in.line().empty())
+        malformed(pack_dir + "/" + manifest[i]);
+
+    for (long r = first; r < rev; ++r)
+        in.bytes(sizes[r - first]);
+    std::string const own = in.bytes(sizes[rev - first]);
+    reader props_in(own.data(), own.data() + own.size());
+    parse_hash(props_in, insert);
+    return props;
+}
+
+std::vector<fsfs::change> fsfs::changes(long rev) const
+{
+    revision_data const data = revision(rev);
+
+    std::uint64_t root, changes_offset;
+    parse_trailer(rev, data.begin, data.end, root, changes_offset);
+
+    std::map<std::string, change> folded;
+    reader in(data.begin + changes_offset, data.end);
+    for_each_changed_path(
+        rev, in,
+        [&](std::vector<std::string> const& w, std::string const& path, std::string const& copyfrom)
+        {
+            change c;
+            c.path = path;
+            c.text_mod = w[2] == "true";
+            c.prop_mod = w[3] == "true";
+            c.node = none;
+
+            std::string kind = w[1];
+            std::string::size_type const dash = kind.find('-');
+            if (dash != std::string::npos)
+            {
+                std::string const node = kind.substr(dash + 1);
+                c.node = node == "file" ? file : node == "dir" ? dir : none;
+                kind.erase(dash);
+            }
+
+            c.copyfrom_rev = -1;
+            if (!copyfrom.empty())
+            {
+                std::string::size_type const space = copyfrom.find(" /");
+                if (space == std::string::npos)
+                    malformed("r" + std::to_string(rev) + " copy source \"" + copyfrom + "\"");
+                c.copyfrom_rev = long(to_uint(copyfrom.substr(0, space)));
+                c.copyfrom_path = copyfrom.substr(space + 2);
+            }
+
+            // Fold this change into any earlier one for the same path, as
+            // libsvn_fs does
+            auto const pos = folded.find(c.path);
+            if (kind == "reset")
+            {
+                if (pos != folded.end())
+                    folded.erase(pos);
+                return;
+            }
+            else if (kind == "delete")
+            {
+                c.kind = deleted;
+                if (pos != folded.end() && pos->second.kind == add)
+                {
+                    folded.erase(pos);
+                    return;
+                }
+            }
+            else if (kind == "add" || kind == "replace")
+            {
+                c.kind = kind == "add" ? add : replace;
+                if (pos != folded.end() && pos->second.kind == deleted)
+                    c.kind = replace;
+            }
+            else if (kind == "modify")
+            {
+                c.kind = modify;
+                if (pos != folded.end())
+                {
+                    pos->second.text_mod = pos->second.text_mod || c.text_mod;
+                    pos->second.prop_mod = pos->second.prop_mod || c.prop_mod;
+                    return;
+                }
+            }
+            else
+            {
+                malformed("r" + std::to_string(rev) + " change kind \"" + kind + "\"");
+            }
+            folded[c.path] = c;
+        });
+
+    std::vector<change> result;
+    result.reserve(folded.size());
+    for (auto& kv : folded)
+        result.push_back(std::move(kv.second));
+    return result;
+}
+
+fsfs::node_revision fsfs::read_node(location where) const
+{
+    revision_data const data = revision(where.first);
+    if (where.second >= std::uint64_t(data.end - data.begin))
+        malformed("node-revision offset in r" + std::to_string(where.first));
+
+    node_revision result;
+    result.kind = none;
+    result.text.where.first = -1;
+    result.text.size = result.text.expanded_size = 0;
+
+    reader in(data.begin + where.second, data.end);
+    for (std::string line = in.line(); !line.empty(); line = in.line())
+    {
+        if (starts_with(line, "type: "))
+        {
+            result.kind = line == "type: file" ? file : line == "type: dir" ? dir : none;
+        }
+        else if (starts_with(line, "text: "))
+        {
+            // <rev> <offset> <size> <expanded size> <md5> [<sha1> <uniquifier>]
+            std::vector<std::string> const w = words(line.substr(6));
+            if (w.size() < 4)
+                malformed("text representation \"" + line + "\"");
+            result.text.where = location(long(to_uint(w[0])), to_uint(w[1]));
+            result.text.size = to_uint(w[2]);
+            result.text.expanded_size = to_uint(w[3]);
+        }
+    }
+    if (result.kind == none)
+        malformed("node-revision without a type in r" + std::to_string(where.first));
+    return result;
+}
+
+std::shared_ptr<std::string const> fsfs::read_representation(location where, std::uint64_t size) const
+{
+    if (auto cached = fulltexts.find(where))
+        return cached;
+
+    revision_data const data = revision(where.first);
+    if (where.second >= std::uint64_t(data.end - data.begin))
+        malformed("representation offset in r" + std::to_string(where.first));
+    reader in(data.begin + where.second, data.end);
+    std::string const header = in.line();
+    if (size > std::uint64_t(in.end - in.pos))
+        malformed("representation size in r" + std::to_string(where.first));
+
+    std::shared_ptr<std::string const> result;
+    if (header == "PLAIN")
+    {
+        result = std::make_shared<std::string const>(in.pos, in.pos + size);
+    }
+    else if (header == "DELTA")
+    {
+        result = std::make_shared<std::string const>(svndiff::apply(in.pos, size, std::string()));
+    }
+    else if (starts_with(header, "DELTA "))
+    {
+        // DELTA <base rev> <base offset> <base size>
+        std::vector<std::string> const w = words(header.substr(6));
+        if (w.size() != 3)
+            malformed("representation header \"" + header + "\"");
+        auto const base = read_representation(
+            location(long(to_uint(w[0])), to_uint(w[1])), to_uint(w[2]));
+        result = std::make_shared<std::string const>(svndiff::apply(in.pos, size, *base));
+    }
+    else
+    {
+        malformed("representation header \"" + header + "\"");
+    }
+
+    fulltexts.insert(where, result, result->size());
+    return result;
+}
+
+std::shared_ptr<fsfs::directory const> fsfs::read_directory(node_revision const& n) const
+{
+    if (n.text.where.first < 0)
+        return std::make_shared<directory const>();
+    if (auto cached = directories.find(n.text.where))
+        return cached;
+
+    auto const contents = read_representation(n.text.where, n.text.size);
+    auto result = std::make_shared<directory>();
+    reader in(contents->data(), contents->data() + contents->size());
+    parse_hash(
+        in,
+        [&](std::string const& name, std::string const& value)
+        {
+            // "<kind> <id>"
+            std::string::size_type const space = value.find(' ');
+            if (space == std::string::npos)
+                malformed("directory entry \"" + value + "\"");
+            std::string const kind = value.substr(0, space);
+            entry const e = {
+                name, kind == "file" ? file : kind == "dir" ? dir : none,
+                parse_id(value.substr(space + 1))
+            };
+            result->push_back(e);
+        });
+    std::sort(
+        result->begin(), result->end(),
+        [](entry const& x, entry const& y) { return x.name < y.name; });
+
+    directories.insert(n.text.where, result, result->size() + 1);
+    return result;
+}
+
+bool fsfs::lookup(long rev, std::string const& path, node_revision& result) const
+{
+    revision_data const data = revision(rev);
+    std::uint64_t root, changes;
+    parse_trailer(rev, data.begin, data.end, root, changes);
+    result = read_node(location(rev, root));
+
+    std::string::size_type start = 0;
+    while (start < path.size())
+    {
+        std::string::size_type slash = path.find('/', start);
+        if (slash == std::string::npos)
+            slash = path.size();
+        if (slash != start)
+        {
+            if (result.kind != dir)
+                return false;
+            auto const entries = read_directory(result);
+            std::string const name = path.substr(start, slash - start);
+            auto const pos = std::lower_bound(
+                entries->begin(), entries->end(), name,
+                [](entry const& e, std::string const& name) { return e.name < name; });
+            if (pos == entries->end() || pos->name != name)
+                return false;
+            result = read_node(pos->where);
+        }
+        start = slash + 1;
+    }
+    return true;
+}
+
+fsfs::node_kind fsfs::check_path(long rev, std::string const& path) const
+{
+    node_revision n;
+    return lookup(rev, path, n) ? n.kind : none;
+}
+
+std::vector<std::string> fsfs::dir_entries(long rev, std::string const& path) const
+{
+    std::vector<std::string> result;
+    for (auto const& e : list_directory(rev, path))
+        result.push_back(e.name);
+    return result;
+}
+
+std::vector<fsfs::dirent> fsfs::list_directory(long rev, std::string const& path) const
+{
+    node_revision n;
+    if (!lookup(rev, path, n) || n.kind != dir)
+        throw std::runtime_error("r" + std::to_string(rev) + ": /" + path + " is not a directory");
+
+    std::vector<dirent> result;
+    auto const entries = read_directory(n);
+    result.reserve(entries->size());
+    for (auto const& e : *entries)
+    {
+        // A node-revision is identified by where it is stored
+        dirent const d = {
+            e.name, e.kind, std::to_string(e.where.first) + "/" + std::to_string(e.where.second)
+        };
+        result.push_back(d);
+    }
+    return result;
+}
+
+std::uint64_t fsfs::file_length(long rev, std::string const& path) const
+{
+    node_revision n;
+    if (!lookup(rev, path, n) || n.kind != file)
+        throw std::runtime_error("r" + std::to_string(rev) + ": /" + path + " is not a file");
+    if (n.text.where.first < 0)
+        return 0;
+    // Older repositories record an expanded size of 0 when it equals
+    // the size, and the size alone can't be trusted for deltas
+    if (n.text.expanded_size != 0)
+        return n.text.expanded_size;
+    return read_representation(n.text.where, n.text.size)->size();
+}
+
+std::shared_ptr<std::string const> fsfs::file_contents(long rev, std::string const& path) const
+{
+    node_revision n;
+    if (!lookup(rev, path, n) || n.kind != file)
+        throw std::runtime_error("r" + std::to_string(rev) + ": /" + path + " is not a file");
+    if (n.text.where.first < 0)
+        return std::make_shared<std::string const>();
+    return read_representation(n.text.where, n.text.size);
+}
+
+std::vector<fsfs::extent> fsfs::read_ahead(long rev, std::size_t max_chain) const
+{
+    std::vector<extent> result;
+    auto const add = [&](revision_data const& d, std::uint64_t offset, std::uint64_t length)
+    {
+        extent const e = {
+            d.holder->filename, std::uint64_t(d.begin - d.holder->file.data()) + offset, length
+        };
+        result.push_back(e);
+    };
+
+    revision_data const data = revision(rev);
+    add(data, 0, data.end - data.begin);
+
+    std::string revprops = revprops_path(rev);
+    if (shard_size != 0 && !boost::filesystem::exists(revprops))
+    {
+        std::string const pack_dir = db + "/revprops/" + std::to_string(rev / shard_size) + ".pack";
+        std::vector<std::string> const manifest = words(read_file(pack_dir + "/manifest"));
+        if (std::size_t(rev % shard_size) < manifest.size())
+            revprops = pack_dir + "/" + manifest[rev % shard_size];
+    }
+    extent const props = { revprops, 0, boost::filesystem::file_size(revprops) };
+    result.push_back(props);
+
+    std::uint64_t root, changes_offset;
+    parse_trailer(rev, data.begin, data.end, root, changes_offset);
+    reader in(data.begin + changes_offset, data.end);
+    for_each_changed_path(
+        rev, in,
+        [&](std::vector<std::string> const& w, std::string const&, std::string const&)
+        {
+            if (w[2] != "true" || starts_with(w[1], "delete") || starts_with(w[1], "reset"))
+                return;
+            node_revision const n = read_node(parse_id(w[0]));
+            if (n.kind != file)
+                return;
+
+            // Walk the delta chain, stopping at a fulltext we already have
+            location where = n.text.where;
+            std::uint64_t size = n.text.size;
+            for (std::size_t steps = 0; where.first >= 0 && steps < max_chain; ++steps)
+            {
+                if (fulltexts.find(where))
+                    break;
+                revision_data const d = revision(where.first);
+                if (where.second >= std::uint64_t(d.end - d.begin))
+                    malformed("representation offset in r" + std::to_string(where.first));
+                reader rep(d.begin + where.second, d.end);
+                std::string const header = rep.line();
+                add(d, where.second, header.size() + 1 + size);
+
+                std::vector<std::string> const base = words(header);
+                if (base.size() != 4 || base[0] != "DELTA")
+                    break;
+                where = location(long(to_uint(base[1])), to_uint(base[2]));
+                size = to_uint(base[3]);
+            }
+        });
+    return result;
+}
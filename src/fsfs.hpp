@@ -0,0 +1,151 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef FSFS_DWA2013727_HPP
+# define FSFS_DWA2013727_HPP
+
+// A reader for FSFS repositories that works directly on the files
+// beneath db/, without libsvn_fs or APR.  Revision and pack files are
+// memory-mapped; changed-path lists, node-revisions and directories
+// are parsed here, and file contents are rebuilt from their delta
+// chains, with a cache of recently built fulltexts.
+//
+// Only physically addressed repositories are supported, i.e. those
+// created by Subversion 1.8 and earlier, or later with
+// "compatible-version" 1.8 or less.  All members are safe to call
+// from several threads at once.
+
+# include "lru_cache.hpp"
+
+# include <boost/iostreams/device/mapped_file.hpp>
+# include <cstdint>
+# include <map>
+# include <memory>
+# include <mutex>
+# include <string>
+# include <utility>
+# include <vector>
+
+class fsfs
+{
+ public:
+    explicit fsfs(std::string const& repo_path);
+
+    enum node_kind { none, file, dir };
+    enum change_kind { modify, add, deleted, replace };
+
+    struct change
+    {
+        std::string path;               // without the leading slash
+        change_kind kind;
+        node_kind node;                 // none if the repository doesn't say
+        bool text_mod;
+        bool prop_mod;
+        long copyfrom_rev;              // -1 if not a copy
+        std::string copyfrom_path;
+    };
+
+    long youngest() const;
+    std::map<std::string, std::string> revision_properties(long rev) const;
+
+    // The folded list of paths changed in rev, sorted by path
+    std::vector<change> changes(long rev) const;
+
+    // Paths are relative to the repository root
+    node_kind check_path(long rev, std::string const& path) const;
+    std::vector<std::string> dir_entries(long rev, std::string const& path) const;
+
+    // An entry of a directory.  Entries with the same id are the
+    // same node-revision, and so have the same contents.
+    struct dirent
+    {
+        std::string name;
+        node_kind kind;
+        std::string id;
+    };
+
+    // The entries of a directory, sorted by name
+    std::vector<dirent> list_directory(long rev, std::string const& path) const;
+    std::uint64_t file_length(long rev, std::string const& path) const;
+    std::shared_ptr<std::string const> file_contents(long rev, std::string const& path) const;
+
+    // A byte range of one of the repository's files
+    struct extent
+    {
+        std::string filename;
+        std::uint64_t offset;
+        std::uint64_t length;
+    };
+
+    // The parts of the repository that converting rev will read: its
+    // revision data and properties, and the representations of the
+    // texts it changes, following their delta chains into earlier
+    // revisions for at most max_chain steps.  Finding them reads the
+    // revision's changed-path list and node-revisions.
+    std::vector<extent> read_ahead(long rev, std::size_t max_chain = 16) const;
+
+ private:
+    typedef std::pair<long, std::uint64_t> location;    // revision, offset
+
+    struct representation
+    {
+        location where;                 // where.first < 0 if absent
+        std::uint64_t size;
+        std::uint64_t expanded_size;
+    };
+
+    struct node_revision
+    {
+        node_kind kind;
+        representation text;
+    };
+
+    struct entry
+    {
+        std::string name;
+        node_kind kind;
+        location where;
+    };
+    typedef std::vector<entry> directory;       // sorted by name
+
+    struct mapped_file
+    {
+        std::string filename;
+        boost::iostreams::mapped_file_source file;
+        std::vector<std::uint64_t> manifest;    // offsets of a pack's revisions
+    };
+
+    // The bytes of one revision, and what keeps them mapped
+    struct revision_data
+    {
+        std::shared_ptr<mapped_file const> holder;
+        char const* begin;
+        char const* end;
+    };
+
+ private:
+    std::string revision_path(long rev, bool packed) const;
+    std::string revprops_path(long rev) const;
+    long min_unpacked_rev() const;
+    std::shared_ptr<mapped_file const> map_file(std::string const& filename, bool pack) const;
+    revision_data revision(long rev) const;
+
+    node_revision read_node(location where) const;
+    bool lookup(long rev, std::string const& path, node_revision& result) const;
+    std::shared_ptr<directory const> read_directory(node_revision const& n) const;
+    std::shared_ptr<std::string const> read_representation(location where, std::uint64_t size) const;
+
+ private:
+    std::string db;
+    int format;
+    long shard_size;                    // 0 if the layout is linear
+
+    mutable std::mutex min_unpacked_lock;
+    mutable long min_unpacked;
+
+    mutable lru_cache<std::string, mapped_file> files;
+    mutable lru_cache<location, std::string> fulltexts;
+    mutable lru_cache<location, directory> directories;
+};
+
+#endif // FSFS_DWA2013727_HPP
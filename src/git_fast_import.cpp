@@ -5,18 +5,32 @@
 #include "git_fast_import.hpp"
 #include "git_executable.hpp"
 #include "path.hpp"
+#include "marks_file_name.hpp"
+#include "spool.hpp"
+#include "timing.hpp"
+#include "to_string.hpp"
 
 #include <boost/iostreams/device/file_descriptor.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/filesystem/operations.hpp>
 #include <numeric>
+#include <sys/ioctl.h>
+#include <stdexcept>
 
 using namespace boost::process::initializers;
 using namespace boost::process;
 namespace iostreams = boost::iostreams;
 
 git_fast_import::git_fast_import(std::string const& git_dir)
-    : inp(boost::process::create_pipe()),
-      outp(boost::process::create_pipe()),
+    : git_dir(git_dir),
+#ifdef SVN2GIT_TIMING
+      timed_name_(timing::intern(git_dir)),
+#endif
+      spool(!options.spool_dir.empty()),
+      inp(spool ? boost::process::pipe(-1, -1) : boost::process::create_pipe()),
+      outp(spool ? boost::process::pipe(-1, -1) : boost::process::create_pipe()),
       process(
+          spool ? child(-1) :
           boost::process::execute(
               run_exe(git_executable()),
               set_env(std::vector<std::string>({"GIT_DIR="+git_dir})),
@@ -28,9 +42,25 @@ git_fast_import::git_fast_import(std::string const& git_dir)
               close_fd(inp.source),
 #endif
               throw_on_error())),
-      cin(iostreams::file_descriptor_sink(outp.sink, iostreams::close_handle)),
-      cout(iostreams::file_descriptor_source(inp.source, iostreams::close_handle))
+      exited(false),
+      bytes_written_(0),
+      commits_written_(0),
+      cout(
+          iostreams::file_descriptor_source(
+              inp.source, spool ? iostreams::never_close_handle : iostreams::close_handle))
 {
+    if (spool)
+    {
+        std::string const filename = spool::file_path(options.spool_dir, git_dir);
+        boost::filesystem::create_directories(boost::filesystem::path(filename).parent_path());
+        // Spooling shouldn't be slower than fast-import
+        cin.push(iostreams::gzip_compressor(iostreams::gzip_params(iostreams::gzip::best_speed)));
+        cin.push(iostreams::file_descriptor_sink(filename, std::ios::binary | std::ios::trunc));
+    }
+    else
+    {
+        cin.push(iostreams::file_descriptor_sink(outp.sink, iostreams::close_handle));
+    }
 }
 
 git_fast_import::~git_fast_import()
@@ -38,14 +68,28 @@ git_fast_import::~git_fast_import()
     // Note: this might not be enough to avoid waiting forever for
     // process exit if there are other subprocesses whose input
     // streams are still open.
+    wait();
+}
+
+void git_fast_import::wait()
+{
+    if (exited)
+        return;
+    exited = true;
     close();
+    if (spool)
+        return;
+    TIMED_REPO_SCOPE("fast-import exit", timed_name_);
     wait_for_exit(process);
 }
 
 std::vector<std::string> 
 git_fast_import::arg_vector(std::string const& git_dir)
 {
-    return { git_executable(), "fast-import", "--quiet" };
+    return {
+        git_executable(), "fast-import", "--quiet",
+        "--export-marks=" + boost::filesystem::absolute(marks_file_path(git_dir)).string()
+    };
 }
 
 git_fast_import& git_fast_import::write_raw(char const* data, std::size_t nbytes)
@@ -59,7 +103,9 @@ git_fast_import& git_fast_import::write_raw(char const* data, std::size_t nbytes
         std::cerr << std::endl;
     }
 #endif 
+    TIMED_REPO_SCOPE("fast-import write", timed_name_);
     cin.write(data, nbytes);
+    bytes_written_.fetch_add(nbytes, std::memory_order_relaxed);
     return *this;
 }
 
@@ -81,6 +127,7 @@ git_fast_import& git_fast_import::commit(
     unsigned long epoch,
     std::string const& log_message)
 {
+    commits_written_.fetch_add(1, std::memory_order_relaxed);
     *this << "commit " << ref_name << LF
           << "mark :" << mark << LF
           << "committer " << author << " " << epoch << " +0000" << LF;
@@ -97,6 +144,11 @@ git_fast_import& git_fast_import::filemodify_hdr(path const& p)
     return *this << "M 100644 inline " << p << LF;
 }
 
+git_fast_import& git_fast_import::filemodify_gitlink(path const& p, std::string const& dataref)
+{
+    return *this << "M 160000 " << dataref << " " << p << LF;
+}
+
 git_fast_import& git_fast_import::checkpoint()
 {
     return *this << "checkpoint" << LF << LF;
@@ -105,11 +157,35 @@ git_fast_import& git_fast_import::checkpoint()
 void git_fast_import::send_ls(std::string const& dataref_opt_path)
 {
     *this << "ls " << dataref_opt_path << LF;
+    TIMED_REPO_SCOPE("fast-import flush", timed_name_);
     cin << std::flush;
 }
 
+std::size_t git_fast_import::pending_bytes() const
+{
+    int pending = 0;
+    if (exited || spool || ::ioctl(outp.sink, FIONREAD, &pending) != 0)
+        return 0;
+    return pending;
+}
+
+std::string git_fast_import::get_mark(std::size_t mark)
+{
+    *this << "get-mark :" << mark << LF;
+    {
+        TIMED_REPO_SCOPE("fast-import flush", timed_name_);
+        cin << std::flush;
+    }
+
+    std::string sha = readline();
+    if (sha.size() != 40)
+        throw std::runtime_error("Unrecognized response \"" + sha + "\" from get-mark :" + to_string(mark));
+    return sha;
+}
+
 std::string git_fast_import::readline()
 {
+    TIMED_REPO_SCOPE("fast-import read", timed_name_);
     std::string result;
     std::getline(cout, result);
     return result;
@@ -8,7 +8,10 @@
 
 # include <boost/process.hpp>
 # include <boost/iostreams/device/file_descriptor.hpp>
+# include <boost/iostreams/filtering_stream.hpp>
 # include <boost/iostreams/stream.hpp>
+# include <atomic>
+# include <cstdint>
 # include <vector>
 # include <string>
 
@@ -23,17 +26,25 @@ inline std::ostream& LF (std::ostream& stream)
     return stream;
 }
 
+// With options.spool_dir set, the stream is written to a spool file
+// for svn2git-replay instead of to a process (see spool.hpp), and
+// nothing can be read back.
 struct git_fast_import
 {
     git_fast_import(std::string const& repo_dir);
     ~git_fast_import();
-    void close() { cin.close(); }
+    void close() { cin.reset(); }
+
+    bool spooling() const { return spool; }
+
+    // Close the input stream and wait for the process to exit, after
+    // which its marks file is complete.
+    void wait();
 
     template <class T>
     git_fast_import& operator<<(T const& x) 
     {
-        if (Log::get_level() >= Log::Trace)
-            std::cerr << x << std::flush;
+        LOG_TRACE_UNPREFIXED << x;
         this->cin << x; 
         return *this;
     }
@@ -51,6 +62,10 @@ struct git_fast_import
     
     git_fast_import& filemodify_hdr(path const& p);
 
+    // Writes a submodule entry; dataref is the commit SHA in the
+    // submodule's repository
+    git_fast_import& filemodify_gitlink(path const& p, std::string const& dataref);
+
     git_fast_import& write_raw(char const* data, std::size_t nbytes);
 
     // Just writes the header for the 'data' command; you can write
@@ -61,17 +76,40 @@ struct git_fast_import
     git_fast_import& reset(std::string const& ref_name, int mark);
 
     void send_ls(std::string const& dataref_opt_path);
+
+    // Progress counters, which may be read from other threads
+    std::uint64_t bytes_written() const { return bytes_written_.load(std::memory_order_relaxed); }
+    std::uint64_t commits_written() const { return commits_written_.load(std::memory_order_relaxed); }
+
+    // The number of bytes written but not yet consumed by the
+    // fast-import process
+    std::size_t pending_bytes() const;
+
+# ifdef SVN2GIT_TIMING
+    // The repository's name, interned for TIMED_REPO_SCOPE
+    std::string const* timed_name() const { return timed_name_; }
+# endif
+
+    // Returns the SHA of the object with the given mark.  The
+    // object's commit, if any, must have been terminated.
+    std::string get_mark(std::size_t mark);
     std::string readline();
 
  private:
     static std::vector<std::string> arg_vector(std::string const& git_dir);
 
+    std::string const git_dir;
+# ifdef SVN2GIT_TIMING
+    std::string const* timed_name_;
+# endif
+    bool const spool;
     boost::process::pipe inp;
     boost::process::pipe outp;
     boost::process::child process;
-    boost::iostreams::stream<
-        boost::iostreams::file_descriptor_sink
-    > cin;
+    std::atomic<bool> exited;
+    std::atomic<std::uint64_t> bytes_written_;
+    std::atomic<std::uint64_t> commits_written_;
+    boost::iostreams::filtering_ostream cin;
     boost::iostreams::stream<
         boost::iostreams::file_descriptor_source
     > cout;
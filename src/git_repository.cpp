@@ -5,6 +5,12 @@
 #include "git_repository.hpp"
 #include "git_executable.hpp"
 #include "log.hpp"
+#include "mark_sha_map.hpp"
+#include "marks_file_name.hpp"
+#include "object_pool.hpp"
+#include "options.hpp"
+#include "revmap.hpp"
+#include "spool.hpp"
 
 #include <boost/filesystem.hpp>
 #include <boost/process.hpp>
@@ -29,18 +35,21 @@ bool git_repository::ensure_existence(std::string const& git_dir)
     namespace fs = boost::filesystem;
     using namespace process::initializers;
     
-    if (fs::exists(git_dir))
-        return true;
-
-    // Create the new repository
-    fs::create_directories(git_dir);
-    std::array<std::string, 4> git_args = { git_executable(), "init", "--bare", "--quiet" };
-    auto git_init = process::execute(
-        run_exe(git_executable()),
-        set_args(git_args), 
-        start_in_dir(git_dir), 
-        throw_on_error());
-    wait_for_exit(git_init);
+    if (!fs::exists(git_dir))
+    {
+        // Create the new repository
+        fs::create_directories(git_dir);
+        std::array<std::string, 4> git_args = { git_executable(), "init", "--bare", "--quiet" };
+        auto git_init = process::execute(
+            run_exe(git_executable()),
+            set_args(git_args), 
+            start_in_dir(git_dir), 
+            throw_on_error());
+        wait_for_exit(git_init);
+    }
+
+    if (!options.object_pool.empty())
+        object_pool::share(options.object_pool, git_dir);
     return true;
 }
 
@@ -56,6 +65,11 @@ void git_repository::set_super_module(
             if (this->submodule_path != submodule_path)
                 throw std::runtime_error("Conflicting submodule path declarations");
         }
+        else if (fast_import().spooling())
+        {
+            // Nothing has been written yet, so this comes first
+            fast_import() << spool::submodule_directive << super_module->name() << LF;
+        }
         this->super_module = super_module;
         this->submodule_path = submodule_path;
         super_module->_has_submodules = true;
@@ -71,8 +85,16 @@ void git_repository::prepare_to_close_commit(bool discover_changes)
     if (defer_close(discover_changes))
         return;
 
+    // All submodule commits for this revision are closed now, so
+    // their SHAs are known
+    write_gitlinks();
+
     // TODO: right here, write .gitmodules if necessary
 
+    // There's no one to ask in a spool; see close_commit()
+    if (fast_import().spooling())
+        return;
+
     // Send a fast-import "ls" command to the changed repository now;
     // responses will be read in a separate close_commit() pass over
     // all changed repos.  Hopefully this will prevent us from
@@ -99,44 +121,118 @@ bool git_repository::close_commit(bool discover_changes)
     if (defer_close(discover_changes))
         return false;
 
-    Log::trace() << "repository " << git_dir
+    LOG_TRACE << "repository " << git_dir
                  << " closing commit in ref " << current_ref->name << std::endl;
 
+    // In a spool, svn2git-replay will ask fast-import for the new
+    // tree, and drop the commit in favor of the ref's previous one if
+    // it's unchanged
+    if (fast_import().spooling())
+    {
+        fast_import() << spool::close_directive
+                      << current_ref->marks.mark_at_or_before(current_ref->marks.back().first - 1)
+                      << LF;
+    }
+    else
+    {
+        end_commit();
+    }
+
+    modified_refs.erase(current_ref);
+    current_ref = nullptr;
+
+    LOG_TRACE << modified_refs.size() << " modified refs remaining." << std::endl;
+    if (super_module != nullptr)
+        --super_module->modified_submodule_refs;
+    return modified_refs.empty();
+}
+
+// End the current ref's commit, or drop it if it leaves the ref's
+// tree unchanged, according to the response to the "ls" command sent
+// by prepare_to_close_commit()
+void git_repository::end_commit()
+{
     // Read the response to the git-fast-import "ls" command sent earlier
     std::string response = fast_import().readline();
 
-
     if (response.size() < 41)
     {
-        Log::error() << "Unrecognized response \"" << response << "\" from ls in ref " 
+        LOG_ERROR << "Unrecognized response \"" << response << "\" from ls in ref " 
                      << current_ref->name << std::endl;
         current_ref->head_tree_sha.clear();
+        fast_import() << LF;
     }
     else
     {
-
         assert(response.back() == '\t');
         std::string new_sha = response.substr(response.size() - 41, response.size() - 1);
-        Log::trace() << "New tree SHA: " << new_sha << std::endl;
+        LOG_TRACE << "New tree SHA: " << new_sha << std::endl;
 
         // Dispose of the commit if it didn't change anything in the tree
         if (new_sha == current_ref->head_tree_sha) 
         {
-            Log::trace() << "Tree unchanged; resetting ref" << std::endl;
+            LOG_TRACE << "Tree unchanged; resetting ref" << std::endl;
             assert(current_ref->marks.size() >= 2);
-            current_ref->marks.erase(std::prev(current_ref->marks.end()));
-            fast_import().reset(current_ref->name, std::prev(current_ref->marks.end())->second);
+            current_ref->marks.pop_back();
+            fast_import().reset(current_ref->name, current_ref->marks.back().second);
+        }
+        else
+        {
+            // Terminate the commit, so that a super-module can ask
+            // for its SHA
+            fast_import() << LF;
         }
         current_ref->head_tree_sha = std::move(new_sha);
     }
+}
 
-    modified_refs.erase(current_ref);
-    current_ref = nullptr;
+// Write a gitlink for each submodule whose counterpart of the
+// current ref was changed in this SVN revision
+void git_repository::write_gitlinks()
+{
+    for (git_repository* submodule : current_ref->modified_submodules)
+    {
+        auto const r = submodule->refs.find(current_ref->name);
+        assert(r != submodule->refs.end());
+        ref const& sub_ref = r->second;
 
-    Log::trace() << modified_refs.size() << " modified refs remaining." << std::endl;
-    if (super_module != nullptr)
-        --super_module->modified_submodule_refs;
-    return modified_refs.empty();
+        if (sub_ref.marks.empty())
+        {
+            fast_import().filedelete(submodule->submodule_path);
+            continue;
+        }
+        std::size_t const mark = sub_ref.marks.back().second;
+
+        // Only svn2git-replay will know the submodule's tree
+        if (fast_import().spooling())
+        {
+            fast_import() << spool::gitlink_directive << mark << " " << submodule->name()
+                          << " " << submodule->submodule_path << LF;
+            continue;
+        }
+
+        // An empty submodule tree means the submodule's ref was deleted
+        if (sub_ref.head_tree_sha.empty()
+            || sub_ref.head_tree_sha.compare(0, empty_tree_sha.size(), empty_tree_sha) == 0)
+        {
+            fast_import().filedelete(submodule->submodule_path);
+            continue;
+        }
+
+        if (options.gitlink_marks)
+        {
+            // A placeholder for fix-submodule-refs to replace with
+            // the SHA from the submodule's marks file
+            fast_import().filemodify_gitlink(
+                submodule->submodule_path, spool::gitlink_placeholder(mark));
+        }
+        else
+        {
+            fast_import().filemodify_gitlink(
+                submodule->submodule_path, submodule->fast_import().get_mark(mark));
+        }
+    }
+    current_ref->modified_submodules.clear();
 }
 
 void git_repository::write_merges()
@@ -148,15 +244,15 @@ void git_repository::write_merges()
 
         if (src_rev > current_ref->merged_revisions[src_ref])
         {
-            auto p = src_ref->marks.upper_bound(src_rev);
-            if (p == src_ref->marks.begin())
+            auto mark = src_ref->marks.mark_at_or_before(src_rev);
+            if (mark == 0)
             {
-                Log::warn() << "No commit found at or preceding the source of merge r" 
+                LOG_WARN << "No commit found at or preceding the source of merge r" 
                             << src_rev << " in Git repo " << git_dir << " ref " 
                             << src_ref->name << std::endl;
                 continue;
             }
-            fast_import() << "merge :" << (--p)->second << LF;
+            fast_import() << "merge :" << mark << LF;
             current_ref->merged_revisions[src_ref] = src_rev;
         }
     }
@@ -171,11 +267,11 @@ git_repository::ref* git_repository::open_commit(svn::revision const& rev)
     assert(!modified_refs.empty());
 
     current_ref = *std::prev(modified_refs.end());
-    Log::trace() << "repository " << git_dir
+    LOG_TRACE << "repository " << git_dir
                  << " opening commit in ref " << current_ref->name << std::endl;
 
     int mark = ++last_mark;
-    current_ref->marks[rev.revnum] = mark;
+    current_ref->marks.push_back(rev.revnum, mark);
     fast_import() << "# SVN revision " << rev.revnum << LF;
     fast_import().commit(current_ref->name, mark, rev.author, rev.epoch, rev.log_message);
 
@@ -216,7 +312,7 @@ git_repository::ref* git_repository::modify_ref(std::string const& name, bool al
         if (!allow_discovery)
             return nullptr;
 
-        Log::trace() << "In Git repo " << this->name() << ", marking " << r->name 
+        LOG_TRACE << "In Git repo " << this->name() << ", marking " << r->name 
                      << " for modification" << std::endl;
 
         modified_refs.insert(r);
@@ -225,10 +321,44 @@ git_repository::ref* git_repository::modify_ref(std::string const& name, bool al
         {
             ++super_module->modified_submodule_refs;
             if (auto super_ref = super_module->modify_ref(name, allow_discovery))
+            {
                 super_ref->rewrite_dot_gitmodules = true;
+                super_ref->modified_submodules.insert(this);
+            }
         }
     }
 
     return r;
 }
 
+void git_repository::write_revmap()
+{
+    mark_sha_map shas;
+    shas.load(marks_file_path(git_dir));
+
+    std::vector<std::string> ref_names;
+    for (auto const& name_ref : refs)
+        ref_names.push_back(name_ref.first);
+    std::sort(ref_names.begin(), ref_names.end());
+
+    std::vector<revmap::entry> entries;
+    for (std::uint32_t ref_id = 0; ref_id < ref_names.size(); ++ref_id)
+    {
+        refs.find(ref_names[ref_id])->second.marks.for_each(
+            [&](std::size_t revnum, std::size_t mark)
+            {
+                unsigned char const* sha = shas.find(mark);
+                if (sha == nullptr)
+                {
+                    LOG_WARN << "No SHA for mark :" << mark << " in Git repo "
+                                << git_dir << " ref " << ref_names[ref_id] << std::endl;
+                    return;
+                }
+                revmap::entry e = { std::uint32_t(revnum), ref_id, std::uint32_t(mark), {} };
+                std::copy(sha, sha + sha_size, e.sha);
+                entries.push_back(e);
+            });
+    }
+
+    revmap::write(revmap_file_path(git_dir), ref_names, std::move(entries));
+}
@@ -6,6 +6,7 @@
 
 # include "git_fast_import.hpp"
 # include "path_set.hpp"
+# include "rev_mark_map.hpp"
 # include "svn.hpp"
 # include <boost/container/flat_map.hpp>
 # include <boost/container/flat_set.hpp>
@@ -17,6 +18,7 @@ struct git_repository
     void set_super_module(git_repository* super_module, std::string const& submodule_path);
     
     git_fast_import& fast_import() { return fast_import_; }
+    git_fast_import const& fast_import() const { return fast_import_; }
 
     // A branch or tag
     struct ref
@@ -24,8 +26,6 @@ struct git_repository
         ref(std::string name, git_repository* repo) 
             : name(std::move(name)), repo(repo), rewrite_dot_gitmodules(false) {}
 
-        typedef boost::container::flat_map<std::size_t, std::size_t> rev_mark_map;
-
         // Maps a Git ref into an SVN revision from that ref that has
         // been merged into this ref.
         typedef boost::container::flat_map<ref const*, std::size_t> merge_map;
@@ -38,6 +38,10 @@ struct git_repository
         path_set pending_deletions;
         bool rewrite_dot_gitmodules;
         std::string head_tree_sha;
+
+        // Submodules whose ref of the same name changed in the
+        // current SVN revision, and so need a new gitlink here
+        boost::container::flat_set<git_repository*> modified_submodules;
     };
 
     ref* demand_ref(std::string const& name)
@@ -58,6 +62,9 @@ struct git_repository
     bool close_commit(bool discover_changes); 
 
     std::string const& name() { return git_dir; }
+# ifdef SVN2GIT_TIMING
+    std::string const* timed_name() const { return fast_import_.timed_name(); }
+# endif
 
     // Remember that the given ref is a descendant of the named source
     // ref at the given SVN revision
@@ -65,11 +72,20 @@ struct git_repository
 
     bool has_submodules() const { return _has_submodules; }
 
+    // The repository of which this is a submodule, if any
+    git_repository* super_repository() const { return super_module; }
+
+    // Write the SVN revision <=> Git commit index for this
+    // repository.  Requires that the fast-import process has exited.
+    void write_revmap();
+
  private:
     bool defer_close(bool discover_changes);
+    void end_commit();
     void read_logfile();
     static bool ensure_existence(std::string const& git_dir);
     void write_merges();
+    void write_gitlinks();
 
  private: // data members
     // Relative path to the repository from the current working
@@ -0,0 +1,141 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "git_subtree_index.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+namespace {
+
+struct component_less
+{
+    template <class Node>
+    bool operator()(std::unique_ptr<Node> const& n, std::pair<char const*, std::size_t> c) const
+    {
+        return n->component.compare(0, n->component.size(), c.first, c.second) < 0;
+    }
+};
+
+// Call f with each component of p, stopping early if it returns false
+template <class F>
+bool for_each_component(path const& p, F f)
+{
+    char const* s = p.str().c_str();
+    char const* const finish = s + p.str().size();
+    while (s != finish)
+    {
+        char const* const slash = static_cast<char const*>(std::memchr(s, '/', finish - s));
+        char const* const end = slash ? slash : finish;
+        if (!f(std::pair<char const*, std::size_t>(s, end - s)))
+            return false;
+        s = slash ? slash + 1 : finish;
+    }
+    return true;
+}
+
+std::size_t intern(std::map<std::string, std::size_t>& ids, std::string const& name)
+{
+    return ids.insert(std::make_pair(name, ids.size())).first->second;
+}
+
+}
+
+void git_subtree_index::insert(Rule const* rule)
+{
+    auto const key = std::make_pair(rule->repo_rule, rule->branch_rule);
+    auto pos = ref_roots.find(key);
+    if (pos == ref_roots.end())
+    {
+        auto const ids = std::make_pair(
+            intern(repo_ids, rule->git_repo_name()), intern(ref_ids, rule->git_ref_name()));
+        pos = ref_roots.insert(std::make_pair(key, &roots[ids])).first;
+    }
+
+    node* n = pos->second;
+    for_each_component(
+        rule->git_path(),
+        [&](std::pair<char const*, std::size_t> c)
+        {
+            auto child = std::lower_bound(
+                n->children.begin(), n->children.end(), c, component_less());
+            if (child == n->children.end()
+                || (*child)->component.compare(0, (*child)->component.size(), c.first, c.second) != 0)
+            {
+                child = n->children.insert(
+                    child, std::unique_ptr<node>(new node(std::string(c.first, c.second))));
+            }
+            n = child->get();
+            return true;
+        });
+    n->rules.push_back(rule);
+
+    if (rule->min > 1)
+        add_transition(rule->min);
+    if (rule->max < UINT_MAX)
+        add_transition(rule->max + 1);
+}
+
+void git_subtree_index::add_transition(std::size_t revnum)
+{
+    auto const pos = std::lower_bound(transitions.begin(), transitions.end(), revnum);
+    if (pos == transitions.end() || *pos != revnum)
+        transitions.insert(pos, revnum);
+}
+
+std::vector<Rule const*> git_subtree_index::subtree_rules(
+    Rule const& match, path const& git_path, std::size_t revnum) const
+{
+    auto const pos = ref_roots.find(std::make_pair(match.repo_rule, match.branch_rule));
+    if (pos == ref_roots.end())
+        return std::vector<Rule const*>();
+
+    node const* n = pos->second;
+    bool const found = for_each_component(
+        git_path,
+        [&](std::pair<char const*, std::size_t> c)
+        {
+            auto const child = std::lower_bound(
+                n->children.begin(), n->children.end(), c, component_less());
+            if (child == n->children.end()
+                || (*child)->component.compare(0, (*child)->component.size(), c.first, c.second) != 0)
+            {
+                return false;
+            }
+            n = child->get();
+            return true;
+        });
+    if (!found)
+        return std::vector<Rule const*>();
+
+    std::size_t const e = epoch(revnum);
+    for (auto const& entry : n->cached)
+    {
+        if (entry.epoch == e)
+            return entry.rules;
+    }
+
+    cache_entry& entry = n->cached[n->next_entry];
+    n->next_entry ^= 1;
+    entry.rules.clear();
+    collect(*n, revnum, entry.rules);
+    entry.epoch = e;
+    return entry.rules;
+}
+
+std::size_t git_subtree_index::epoch(std::size_t revnum) const
+{
+    return std::upper_bound(transitions.begin(), transitions.end(), revnum) - transitions.begin();
+}
+
+void git_subtree_index::collect(node const& n, std::size_t revnum, std::vector<Rule const*>& result)
+{
+    for (auto r : n.rules)
+    {
+        if (r->min <= revnum && revnum <= r->max)
+            result.push_back(r);
+    }
+    for (auto const& child : n.children)
+        collect(*child, revnum, result);
+}
@@ -0,0 +1,91 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef GIT_SUBTREE_INDEX_DWA2013726_HPP
+# define GIT_SUBTREE_INDEX_DWA2013726_HPP
+
+# include "rule.hpp"
+# include "path.hpp"
+# include <cstddef>
+# include <boost/functional/hash.hpp>
+# include <map>
+# include <memory>
+# include <string>
+# include <unordered_map>
+# include <utility>
+# include <vector>
+
+// An index from Git locations back to the rules that map SVN trees
+// into them.  Rules are grouped by Git repository and ref, and each
+// group is a tree of Git path components, so finding all the rules
+// that map into a Git subtree costs one lookup per component.
+//
+// The set of rules in effect only changes at the revisions where some
+// rule starts or stops applying, which divide history into "epochs".
+// Each node caches its lookups for the two epochs most recently asked
+// about, so invalidating the same subtree repeatedly is cheap, even
+// when comparing it across a transition.  The cache makes lookups
+// unsafe to perform from more than one thread at a time.
+class git_subtree_index
+{
+ public:
+    // All rules must be inserted before the first lookup
+    void insert(Rule const* rule);
+
+    // The rules in effect at revnum that map into the same Git ref
+    // as match, at or beneath git_path
+    std::vector<Rule const*> subtree_rules(
+        Rule const& match, path const& git_path, std::size_t revnum) const;
+
+ private:
+    // The rules at or beneath a node in effect during epoch
+    struct cache_entry
+    {
+        cache_entry() : epoch(-1) {}
+
+        std::size_t epoch;
+        std::vector<Rule const*> rules;
+    };
+
+    struct node
+    {
+        explicit node(std::string component = std::string())
+            : component(std::move(component)), next_entry(0) {}
+
+        std::string component;
+        std::vector<std::unique_ptr<node> > children;  // sorted by component
+        std::vector<Rule const*> rules;     // mapping to exactly this path
+
+        // Replaced alternately on a miss
+        mutable cache_entry cached[2];
+        mutable unsigned next_entry;
+    };
+
+    void add_transition(std::size_t revnum);
+    std::size_t epoch(std::size_t revnum) const;
+    static void collect(node const& n, std::size_t revnum, std::vector<Rule const*>& result);
+
+ private:
+    std::map<std::string, std::size_t> repo_ids, ref_ids;
+    std::map<std::pair<std::size_t, std::size_t>, node> roots;
+
+    // The root for each (repository rule, branch rule) pair, which
+    // saves looking up the names of the rule's repository and ref
+    typedef std::pair<boost2git::RepoRule const*, boost2git::BranchRule const*> rule_key;
+    struct rule_key_hash
+    {
+        std::size_t operator()(rule_key const& k) const
+        {
+            std::size_t seed = 0;
+            boost::hash_combine(seed, k.first);
+            boost::hash_combine(seed, k.second);
+            return seed;
+        }
+    };
+    std::unordered_map<rule_key, node*, rule_key_hash> ref_roots;
+
+    // Sorted revisions at which some rule starts or stops applying
+    std::vector<std::size_t> transitions;
+};
+
+#endif // GIT_SUBTREE_INDEX_DWA2013726_HPP
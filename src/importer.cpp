@@ -2,21 +2,27 @@
 // Software License, Version 1.0. (See accompanying
 // file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
 #include "importer.hpp"
+#include "allocations.hpp"
 #include "ruleset.hpp"
 #include "svn.hpp"
 #include "log.hpp"
+#include "object_pool.hpp"
+#include "options.hpp"
 #include "path.hpp"
+#include "timing.hpp"
 #include <boost/range/adaptor/map.hpp>
 #include <boost/function_output_iterator.hpp>
 #include <boost/range/as_literal.hpp>
 #include <svn_fs.h>
 #include <apr_hash.h>
+#include <algorithm>
+#include <vector>
 
 using boost::adaptors::map_values;
 using boost::as_literal;
 
 importer::importer(svn const& svn_repo, Ruleset const& ruleset)
-    : svn_repository(svn_repo), ruleset(ruleset), revnum(0)
+    : svn_repository(svn_repo), ruleset(ruleset), completed_revnum(0), revnum(0)
 {
     for(auto const& rule : ruleset.repositories())
     {
@@ -61,6 +67,14 @@ git_repository::ref* importer::prepare_to_modify(Rule const* match, bool discove
     if (!discover_changes && changed_repositories.count(&repo) == 0)
         return nullptr;
     changed_repositories.insert(&repo);
+
+    // A change to a submodule is also a change to the repositories
+    // containing it, which will write the new gitlinks
+    if (discover_changes)
+    {
+        for (auto super = repo.super_repository(); super; super = super->super_repository())
+            changed_repositories.insert(super);
+    }
     return repo.modify_ref(match->git_ref_name(), discover_changes);
 }
 
@@ -84,6 +98,9 @@ path importer::add_svn_tree_to_delete(path const& svn_path, Rule const* match)
 void importer::invalidate_svn_tree(
     svn::revision const& rev, path const& svn_path, Rule const* match)
 {
+    if (convert_svn_tree_differences(rev, svn_path, match))
+        return;
+
     path path_suffix = add_svn_tree_to_delete(svn_path, match);
 
     add_svn_tree_to_convert(rev, svn_path);
@@ -91,26 +108,137 @@ void importer::invalidate_svn_tree(
     // Mark every svn tree that's mapped into the rule's git subtree for
     // (re-)conversion.
 
-    ruleset.matcher().git_subtree_rules(
-        // FIXME: concatenating a subpath to a git address is pretty ugly!
-        match->git_address() 
-        + (match->git_path().str().empty() ? "" : "/") 
-        + path_suffix.str(), 
-        revnum,
+    for (Rule const* r : ruleset.git_index().subtree_rules(*match, match->git_path()/path_suffix, revnum))
+        add_svn_tree_to_convert(rev, r->svn_path());
+}
+
+// Rather than deleting the Git tree into which match maps svn_path
+// and converting it all again, write only what differs from the
+// previous revision, if that's possible.  It is when the Git tree
+// holds one SVN tree before this revision and one after it, mapped
+// whole, with no other rules mapping parts of them elsewhere; then
+// the two trees' node-revision ids show which of their parts differ.
+// Typically they are the same SVN tree, or one is a copy of the
+// other, so there is little to write.  Returns false if the Git tree
+// must be rebuilt instead.
+bool importer::convert_svn_tree_differences(
+    svn::revision const& rev, path const& svn_path, Rule const* match)
+{
+    if (!previous_revision || previous_revision->revnum != revnum - 1)
+        return false;
+    if (svn_path != match->svn_path())
+        return false;
+
+    TIMED_SCOPE("compare svn trees");
+    path const git_path = match->git_path();
+
+    // The rules mapping into the Git tree before and after
+    std::vector<Rule const*> const before
+        = ruleset.git_index().subtree_rules(*match, git_path, revnum - 1);
+    std::vector<Rule const*> const after
+        = ruleset.git_index().subtree_rules(*match, git_path, revnum);
+    if (before.size() != 1 || before[0]->git_path() != git_path
+        || after.size() != 1 || after[0]->git_path() != git_path)
+    {
+        return false;
+    }
+    Rule const* const old_rule = before[0];
+    Rule const* const new_rule = after[0];
+
+    if (svn_trees_compared.count(new_rule))
+        return true;
+    if (maps_svn_subtree(old_rule, revnum - 1) || maps_svn_subtree(new_rule, revnum))
+        return false;
+    if (previous_revision->check_path(old_rule->svn_path()) != svn_node_dir
+        || rev.check_path(new_rule->svn_path()) != svn_node_dir)
+    {
+        return false;
+    }
+
+    LOG_TRACE << "comparing " << new_rule->svn_path() << " with "
+                 << old_rule->svn_path() << "@" << revnum - 1 << std::endl;
+    svn_trees_compared.insert(new_rule);
+    compare_svn_trees(
+        old_rule->svn_path(), rev, new_rule->svn_path(),
+        prepare_to_modify(new_rule, true), git_path);
+    return true;
+}
+
+// Whether any rule other than r, in effect at revnum, maps part of
+// r's SVN tree
+bool importer::maps_svn_subtree(Rule const* r, std::size_t revnum) const
+{
+    bool found = false;
+    ruleset.matcher().svn_subtree_rules(
+        r->svn_path().str(), revnum,
         boost::make_function_output_iterator(
-            [&](Rule const* r){ add_svn_tree_to_convert(rev, r->svn_path()); })
-    );
+            [&](Rule const* s){ if (s != r) found = true; }));
+    return found;
+}
+
+// Delete from git_path in ref what is in old_svn_path in the previous
+// revision but not in svn_path in rev, and mark for conversion what
+// is new or different in svn_path.  Directories whose node-revision
+// is unchanged are skipped without being read.
+void importer::compare_svn_trees(
+    path const& old_svn_path, svn::revision const& rev, path const& svn_path,
+    git_repository::ref* ref, path const& git_path)
+{
+    std::shared_ptr<svn::directory const> before, after;
+    {
+        TIMED_SCOPE("svn_fs_dir_entries");
+        before = previous_revision->list_directory(old_svn_path);
+        after = rev.list_directory(svn_path);
+    }
+
+    auto b = before->begin();
+    auto a = after->begin();
+    while (b != before->end() || a != after->end())
+    {
+        if (a == after->end() || (b != before->end() && b->name < a->name))
+        {
+            ref->pending_deletions.insert(git_path/b->name);
+            ++b;
+        }
+        else if (b == before->end() || a->name < b->name)
+        {
+            add_svn_tree_to_convert(rev, svn_path/a->name);
+            ++a;
+        }
+        else
+        {
+            if (a->id != b->id)
+            {
+                if (a->kind == svn_node_dir && b->kind == svn_node_dir)
+                {
+                    compare_svn_trees(
+                        old_svn_path/b->name, rev, svn_path/a->name, ref, git_path/a->name);
+                }
+                else
+                {
+                    if (a->kind != b->kind)
+                        ref->pending_deletions.insert(git_path/b->name);
+                    add_svn_tree_to_convert(rev, svn_path/a->name);
+                }
+            }
+            ++a;
+            ++b;
+        }
+    }
 }
 
 void importer::add_svn_tree_to_convert(
     svn::revision const& rev, path const& svn_path)
 {
+    // Nothing to do if it's already covered
+    if (svn_paths_to_convert.contains(svn_path))
+        return;
+
     // Mark this svn_path for conversion.  
-    auto kind = svn::call(
-        svn_fs_check_path, rev.fs_root, svn_path.c_str(), rev.pool);
+    auto kind = rev.check_path(svn_path);
 
     if (kind != svn_node_none) {
-        Log::trace() << "adding " << svn_path << " for conversion" << std::endl;
+        LOG_TRACE << "adding " << svn_path << " for conversion" << std::endl;
         svn_paths_to_convert.insert(svn_path);
     }
 }
@@ -122,21 +250,19 @@ void importer::add_svn_tree_to_convert(
 // subsequently be traversed and converted to Git blobs and trees.
 void importer::process_svn_changes(svn::revision const& rev)
 {
-    apr_hash_t *changes = svn::call(svn_fs_paths_changed2, rev.fs_root, rev.pool);
-    for (apr_hash_index_t *i = apr_hash_first(rev.pool, changes); i; i = apr_hash_next(i))
+    TIMED_RSS_SCOPE("svn changes");
+    std::vector<svn::change> changes;
+    {
+        TIMED_SCOPE("svn_fs_paths_changed2");
+        changes = rev.changes();
+    }
+    for (auto const& change : changes)
     {
-        const char *svn_path_ = 0;
-        svn_fs_path_change2_t *change = 0;
-        apr_hash_this(i, (const void**) &svn_path_, nullptr, (void**) &change);
-        // According to the APR docs, this means the hash entry was
-        // deleted, so it should never happen
-        assert(change != nullptr); 
-
         // Ignore changes that only edit properties
-        if (change->change_kind == svn_fs_path_change_modify && !change->text_mod)
+        if (change.change_kind == svn_fs_path_change_modify && !change.text_mod)
             continue;
 
-        path const svn_path(svn_path_);
+        path const& svn_path = change.svn_path;
         
         // We have found a path being modified in SVN.  Note: it's
         // too early to error-out on unmapped SVN paths here: any that
@@ -149,27 +275,27 @@ void importer::process_svn_changes(svn::revision const& rev)
 
         // If it wasn't being deleted in SVN, also convert all of its
         // files to Git.
-        if (change->change_kind != svn_fs_path_change_delete)
+        if (change.change_kind != svn_fs_path_change_delete)
             add_svn_tree_to_convert(rev, svn_path);
 
         // Assume it's a directory if it's not known to be a file.
         // This is conservative, in case node_kind == svn_node_unknown.
-        if (change->node_kind != svn_node_file)
+        if (change.node_kind != svn_node_file)
             process_svn_directory_change(rev, change, svn_path);
     }
 }
 
 void importer::process_svn_directory_change(
-    svn::revision const& rev, svn_fs_path_change2_t *change, path const& svn_path)
+    svn::revision const& rev, svn::change const& change, path const& svn_path)
 {
     // Remember directory copy sources
-    if (change->copyfrom_known && change->copyfrom_path != nullptr)
+    if (change.copyfrom_known && !change.copyfrom_path.empty())
     {
         // It's OK to retain only the last source directory if
         // this target was copied-to more than once
         auto& copy = svn_directory_copies[svn_path];
-        copy.src_revision = change->copyfrom_rev;
-        copy.src_directory = change->copyfrom_path;
+        copy.src_revision = change.copyfrom_rev;
+        copy.src_directory = change.copyfrom_path;
     }
 
     // Handle rules that map SVN subtrees of the deleted path
@@ -187,17 +313,22 @@ void importer::import_revision(int revnum)
 {
     if (Log::get_level() >= Log::Trace)
     {
-        Log::trace() 
+        LOG_TRACE 
         << "################## importing revision " 
         << revnum << " ##################" << std::endl;
     }
     else if (revnum % 1000 == 0)
     {
-        Log::info() << "importing revision " << revnum << std::endl;
+        LOG_INFO << "importing revision " << revnum << std::endl;
     }
 
     this->revnum = revnum;
-    svn::revision rev = svn_repository[revnum];
+    TIMED_REVISION(revnum);
+    TIMED_RSS_SCOPE("import revision");
+    ALLOCATION_REVISION(revnum);
+    ALLOCATION_PHASE(discovery);
+    std::unique_ptr<svn::revision> current(new svn::revision(svn_repository, revnum));
+    svn::revision const& rev = *current;
 
     // Importing an SVN revision happens in two phases.  In the first
     // phase we discover actions to be performed: Git subtrees that
@@ -210,22 +341,29 @@ void importer::import_revision(int revnum)
     //
     svn_paths_to_convert.clear();
     changed_repositories.clear();
+    svn_trees_compared.clear();
     svn_directory_copies.clear();
 
     // Deal with rules becoming active/inactive in this revision
-    for (Rule const* r: ruleset.matcher().rules_in_transition(revnum))
-        invalidate_svn_tree(rev, r->svn_path(), r);
+    {
+        TIMED_RSS_SCOPE("rules in transition");
+        for (Rule const* r: ruleset.matcher().rules_in_transition(revnum))
+            invalidate_svn_tree(rev, r->svn_path(), r);
+    }
 
     // Discover SVN paths that are being deleted/modified
     process_svn_changes(rev);
 
-    Log::trace() 
+    LOG_TRACE 
         << svn_paths_to_convert.size() 
         << " SVN " 
         << (svn_paths_to_convert.size() == 1 ? "path" : "paths")
         << " to convert" << std::endl;
 
-    discover_merges(rev);
+    {
+        ALLOCATION_PHASE(merge_discovery);
+        discover_merges(rev);
+    }
 
     //
     // Phase II: Writing to Git
@@ -248,14 +386,20 @@ void importer::import_revision(int revnum)
     int pass = 0;
     do
     {
-        Log::trace() << "pass " << pass << std::endl;
+        LOG_TRACE << "pass " << pass << std::endl;
 
-        for (auto r : changed_repositories)
-            r->open_commit(rev);
+        {
+            TIMED_RSS_SCOPE("convert");
+            ALLOCATION_PHASE(traversal);
+            for (auto r : changed_repositories)
+                r->open_commit(rev);
         
-        for (auto& svn_path : svn_paths_to_convert)
-            convert_svn_tree(rev, svn_path.c_str(), pass == 0);
+            for (auto& svn_path : svn_paths_to_convert)
+                convert_svn_tree(rev, svn_path.c_str(), pass == 0);
+        }
 
+        TIMED_RSS_SCOPE("close commits");
+        ALLOCATION_PHASE(close);
         for (auto r : changed_repositories)
             r->prepare_to_close_commit(pass == 0);
 
@@ -274,6 +418,8 @@ void importer::import_revision(int revnum)
     while(!changed_repositories.empty());
 
     warn_about_cross_repository_copies();
+    previous_revision = std::move(current);
+    completed_revnum.store(revnum, std::memory_order_relaxed);
 }
 
 void importer::warn_about_cross_repository_copies()
@@ -283,7 +429,8 @@ void importer::warn_about_cross_repository_copies()
         if (kv.second.crossed_repositories.empty())
             continue;
 
-        auto& warn = Log::warn() 
+        Log::line warn(Log::Warning);
+        warn
             << "In r" << revnum << ", SVN directory copy " 
             << kv.second.src_directory << " => " << kv.first
             << " crossed Git repositories:";
@@ -306,54 +453,113 @@ importer::~importer()
     // closing its stream.
     for (auto& repo : repositories | map_values)
         repo.fast_import().close();
+
+    // Once fast-import has exited, its exported marks are complete
+    // and we can index the commits written to each repository.
+    for (auto& repo : repositories | map_values)
+    {
+        try
+        {
+            repo.fast_import().wait();
+
+            // svn2git-replay writes the revmap of a spooled stream
+            if (repo.fast_import().spooling())
+                continue;
+            {
+                TIMED_REPO_SCOPE("write revmap", repo.timed_name());
+                repo.write_revmap();
+            }
+            if (!options.object_pool.empty())
+            {
+                TIMED_REPO_SCOPE("move packs", repo.timed_name());
+                object_pool::move_packs(options.object_pool, repo.name());
+            }
+        }
+        catch(std::exception const& e)
+        {
+            LOG_ERROR << "finishing " << repo.name()
+                         << ": " << e.what() << std::endl;
+        }
+    }
 }
 
+// Call f(file_path, match) for each file at or beneath svn_path, a
+// node of the given kind in rev, where match is the rule matching
+// file_path.  The entries of each directory are matched as a batch, so
+// the matcher need not walk the directory's path for each one, and
+// their kinds come with the listing.
 template <class F>
-void for_each_svn_file(
-    svn::revision const& rev, path const& svn_path, F const& f)
+void for_each_svn_node(
+    patrie<Rule,coverage> const& matcher, svn::revision const& rev,
+    path const& svn_path, svn_node_kind_t kind, Rule const* match, F const& f)
 {
     if (boost::contains(svn_path.str(), "/CVSROOT/"))
         return;
 
-    switch( svn::call(svn_fs_check_path, rev.fs_root, svn_path.c_str(), rev.pool) )
+    switch (kind)
     {
     case svn_node_none: // If it turns out there's nothing here, there's nothing to do.
-        Log::error() << svn_path << " doesn't exist!" << std::endl;
+        LOG_ERROR << svn_path << " doesn't exist!" << std::endl;
         assert(!"We added a non-existent path to convert somehow?!");
         return;
 
     case svn_node_unknown:
-        Log::error() << svn_path << " has unknown type!" << std::endl;
+        LOG_ERROR << svn_path << " has unknown type!" << std::endl;
         assert(!"SVN should know the type of every node in its filesystem?!");
         return;
 
     case svn_node_file:
-        f(svn_path);
+        f(svn_path, match);
         break;
 
     case svn_node_dir:
-        AprPool dir_pool = rev.pool.make_subpool();
-        apr_hash_t *entries = svn::call(svn_fs_dir_entries, rev.fs_root, svn_path.c_str(), dir_pool);
-        for (apr_hash_index_t *i = apr_hash_first(dir_pool, entries); i; i = apr_hash_next(i))
+        std::shared_ptr<svn::directory const> entries;
+        {
+            TIMED_SCOPE("svn_fs_dir_entries");
+            entries = rev.list_directory(svn_path);
+        }
+
+        std::vector<std::string> names;
+        names.reserve(entries->size());
+        for (auto const& e : *entries)
+            names.push_back(e.name);
+
+        std::vector<Rule const*> matches(names.size());
         {
-            char const* subpath;
-            void* value;
-            apr_hash_this(i, (void const **)&subpath, nullptr, nullptr);
-            for_each_svn_file(rev, svn_path/subpath, f);
+            TIMED_SCOPE("rule matching");
+            matcher.longest_matches(
+                svn_path.str(), names.begin(), names.end(), rev.revnum, matches.begin());
         }
+        for (std::size_t i = 0; i < names.size(); ++i)
+            for_each_svn_node(matcher, rev, svn_path/names[i], (*entries)[i].kind, matches[i], f);
         break;
     };
 }
 
+// Likewise, for whatever is at svn_path
+template <class F>
+void for_each_svn_file(
+    patrie<Rule,coverage> const& matcher, svn::revision const& rev,
+    path const& svn_path, Rule const* match, F const& f)
+{
+    svn_node_kind_t kind;
+    {
+        TIMED_SCOPE("svn_fs_check_path");
+        kind = rev.check_path(svn_path);
+    }
+    for_each_svn_node(matcher, rev, svn_path, kind, match, f);
+}
+
 void importer::discover_merges(svn::revision const& rev)
 {
+    TIMED_RSS_SCOPE("discover merges");
     for (auto& kv : svn_directory_copies)
     {
         for_each_svn_file(
-            rev, kv.first,
-            [=](path const& file_path) 
+            ruleset.matcher(), rev, kv.first, match_svn_path(kv.first, revnum, false),
+            [=](path const& file_path, Rule const* match) 
             {
-                if (Rule const* const match = match_svn_path(file_path, revnum))
+                if (check_match(file_path, match))
                 {
                     auto* dst_ref = prepare_to_modify(match, true);
                     record_merges(dst_ref, file_path, match);
@@ -366,38 +572,16 @@ void importer::convert_svn_tree(
     svn::revision const& rev, path const& svn_path, bool discover_changes)
 {
     for_each_svn_file(
-        rev, svn_path, 
-        [=,&rev](path const& file_path) {
-            convert_svn_file(rev, file_path, discover_changes); 
+        ruleset.matcher(), rev, svn_path, match_svn_path(svn_path, revnum, false),
+        [=,&rev](path const& file_path, Rule const* match) {
+            convert_svn_file(rev, file_path, match, discover_changes); 
         });
 }
 
-extern "C"
-{
-    svn_error_t *fast_import_raw_bytes(void *baton, const char *data, apr_size_t *len)
-    {
-        auto& fast_import = *static_cast<git_fast_import*>(baton);
-        try
-        {
-            fast_import.write_raw(data, *len);
-            return SVN_NO_ERROR;
-        }
-        catch(std::exception const& e)
-        {
-            return svn_error_createf(APR_EOF, SVN_NO_ERROR, "%s", e.what());
-        }
-        catch(...)
-        {
-            return svn_error_createf(APR_EOF, SVN_NO_ERROR, "unknown error");
-        }
-    }
-}
-
 void importer::convert_svn_file(
-    svn::revision const& rev, path const& svn_path, bool discover_changes)
+    svn::revision const& rev, path const& svn_path, Rule const* match, bool discover_changes)
 {
-    Rule const* const match = match_svn_path(svn_path, revnum);
-    if (!match) return;
+    if (!check_match(svn_path, match)) return;
 
     // There are two reasons we might skip processing this file in
     // this pass and come back for it in a later one:
@@ -418,16 +602,13 @@ void importer::convert_svn_file(
         return;
 
     auto& fast_import = dst_ref->repo->fast_import();
+    TIMED_REPO_SCOPE("file content", dst_ref->repo->timed_name());
+    ALLOCATION_PHASE(emission);
 
     fast_import.filemodify_hdr(
         match->git_path()/svn_path.sans_prefix(match->svn_path()) );
 
-    auto file_length = svn::call(
-        svn_fs_file_length, rev.fs_root, svn_path.c_str(), rev.pool);
-
-    AprPool scope = rev.pool.make_subpool();
-    svn_stream_t* in_stream = svn::call(
-        svn_fs_file_contents, rev.fs_root, svn_path.c_str(), scope);
+    auto file_length = rev.file_length(svn_path);
 
     // If it's a symlink, we may need to lop 5 bytes off the front of the stream.
     /*
@@ -436,9 +617,9 @@ void importer::convert_svn_file(
     */
 
     fast_import.data_hdr(file_length);
-    svn_stream_t* out_stream = svn_stream_create(&fast_import, scope);
-    svn_stream_set_write(out_stream, fast_import_raw_bytes);
-    check_svn(svn_stream_copy3(in_stream, out_stream, nullptr, nullptr, scope));
+    rev.file_contents(
+        svn_path,
+        [&fast_import](char const* data, std::size_t len) { fast_import.write_raw(data, len); });
     fast_import << LF;
 }
 
@@ -489,12 +670,24 @@ void importer::record_merges(git_repository::ref* target, path const& dst_svn_pa
 
 Rule const* importer::match_svn_path(path const& svn_path, std::size_t revnum, bool require_match)
 {
-    Rule const* match = ruleset.matcher().longest_match(svn_path.str(), revnum);
-    if (require_match && match == nullptr)
+    Rule const* match;
     {
-        Log::error() << "Unmatched svn path " << svn_path 
+        TIMED_SCOPE("rule matching");
+        match = ruleset.matcher().longest_match(svn_path.str(), revnum);
+    }
+    if (require_match)
+        check_match(svn_path, match);
+    return match;
+}
+
+// Complain if svn_path, in the current revision, matched no rule
+bool importer::check_match(path const& svn_path, Rule const* match) const
+{
+    if (match == nullptr)
+    {
+        LOG_ERROR << "Unmatched svn path " << svn_path 
                      << " in r" << revnum << std::endl;
         assert(!"unmatched SVN path");
     }
-    return match;
+    return match != nullptr;
 }
@@ -12,7 +12,9 @@
 
 # include <boost/container/flat_set.hpp>
 # include <boost/container/flat_map.hpp>
+# include <atomic>
 # include <map>
+# include <memory>
 
 struct Rule;
 struct Ruleset;
@@ -26,37 +28,64 @@ struct importer
     int last_valid_svn_revision();
     void import_revision(int revnum);
 
+    // The last SVN revision completely imported; may be called from
+    // other threads
+    int completed_revision() const { return completed_revnum.load(std::memory_order_relaxed); }
+
+    template <class F>
+    void for_each_repository(F f) const
+    {
+        for (auto const& name_repo : repositories)
+            f(name_repo.first, name_repo.second);
+    }
+
  private: // helpers
     git_repository* demand_repo(std::string const& name);
     git_repository::ref* prepare_to_modify(Rule const* match, bool discover_changes);
     void process_svn_changes(svn::revision const& rev);
     void process_svn_directory_change(
-        svn::revision const& rev, svn_fs_path_change2_t *change, path const& svn_path);
+        svn::revision const& rev, svn::change const& change, path const& svn_path);
     path add_svn_tree_to_delete(path const& svn_path, Rule const* match);
     void invalidate_svn_tree(
         svn::revision const& rev, path const& svn_path, Rule const* match);
+    bool convert_svn_tree_differences(
+        svn::revision const& rev, path const& svn_path, Rule const* match);
+    void compare_svn_trees(
+        path const& old_svn_path, svn::revision const& rev, path const& svn_path,
+        git_repository::ref* ref, path const& git_path);
+    bool maps_svn_subtree(Rule const* r, std::size_t revnum) const;
     void add_svn_tree_to_convert(
         svn::revision const& rev, path const& svn_path);
     void convert_svn_tree(
         svn::revision const& rev, path const& svn_path, bool discover_changes);
     void convert_svn_file(
-        svn::revision const& rev, path const& svn_path, bool discover_changes);
+        svn::revision const& rev, path const& svn_path, Rule const* match, bool discover_changes);
     void discover_merges(svn::revision const& rev);
     void record_merges(git_repository::ref*, path const& svn_path, Rule const* match);
 
     void warn_about_cross_repository_copies();
     Rule const* match_svn_path(path const& svn_path, std::size_t revnum, bool require_match = true);
+    bool check_match(path const& svn_path, Rule const* match) const;
 
  private: // persistent members
     std::map<std::string, git_repository> repositories;
     svn const& svn_repository;
     Ruleset const& ruleset;
+    std::atomic<int> completed_revnum;
+
+    // The last revision imported, against which the next one's trees
+    // can be compared
+    std::unique_ptr<svn::revision> previous_revision;
 
  private: // members used per SVN revision
     int revnum;
     path_set svn_paths_to_convert;
     boost::container::flat_set<git_repository*> changed_repositories;
 
+    // Rules whose SVN trees were compared with the previous
+    // revision's, rather than converted in full
+    boost::container::flat_set<Rule const*> svn_trees_compared;
+
     struct svn_directory_copy
     {
         std::size_t src_revision;
@@ -16,92 +16,231 @@
  */
 
 #include "log.hpp"
-#include <stdexcept>
+#include <atomic>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
 
 namespace Log
 {
 
 static Level level = Log::Info;
 
-static std::size_t revision;
-static std::size_t revision_reported;
-static std::ostream dummy(0);
-static std::size_t num_errors = 0;
+static std::atomic<std::size_t> revision(0);
+static std::atomic<std::size_t> num_errors(0);
 
-Level get_level()
+line::unprefixed_t const line::unprefixed = {};
+
+namespace
   {
-  return level;
-  }
 
-void set_level(Level value)
+struct entry
   {
-  level = value;
-  }
+  bool error;                   // for std::cerr rather than std::cout
+  std::string text;
+  };
 
-static void check_revision()
+// Writes the log from its own thread.  Statements are appended to a
+// batch under a mutex; the writer takes the whole batch at once and
+// flushes only when it has written it, so a burst of statements
+// costs one write per stream rather than one flush per line.
+class writer
   {
-  if (revision == revision_reported)
+public:
+  writer()
+    : revision_reported(0), pending_flush(false), stopping(false)
     {
-    return;
     }
-  std::cout << "\nRevision " << revision << std::endl;
-  revision_reported = revision;
+
+  ~writer()
+    {
+    {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+    }
+    wake.notify_one();
+    if (thread.joinable())
+      {
+      thread.join();
+      }
+    }
+
+  void submit(bool error, std::string text)
+    {
+    std::unique_lock<std::mutex> guard(lock);
+    if (stopping)
+      {
+      // Logging during static destruction; there's nobody to hand it to
+      (error ? std::cerr : std::cout) << text << std::flush;
+      return;
+      }
+    if (!thread.joinable())
+      {
+      thread = std::thread(&writer::run, this);
+      }
+    bool const was_idle = batch.empty() && !pending_flush;
+    check_revision();
+    entry e = { error, std::move(text) };
+    batch.push_back(std::move(e));
+    guard.unlock();
+    if (was_idle)
+      {
+      wake.notify_one();
+      }
+    }
+
+  void report_revision()
+    {
+    std::lock_guard<std::mutex> guard(lock);
+    check_revision();
+    }
+
+  void flush()
+    {
+    std::unique_lock<std::mutex> guard(lock);
+    if (!thread.joinable())
+      {
+      return;
+      }
+    pending_flush = true;
+    wake.notify_one();
+    flushed.wait(guard, [&]{ return !pending_flush || stopping; });
+    }
+
+private:
+  // Call with the lock held
+  void check_revision()
+    {
+    std::size_t const rev = revision;
+    if (rev == revision_reported)
+      {
+      return;
+      }
+    entry e = { false, "\nRevision " + std::to_string(rev) + "\n" };
+    batch.push_back(std::move(e));
+    revision_reported = rev;
+    }
+
+  void run()
+    {
+    std::vector<entry> writing;
+    for (;;)
+      {
+      bool flush_requested;
+      {
+      std::unique_lock<std::mutex> guard(lock);
+      wake.wait(guard, [&]{ return stopping || pending_flush || !batch.empty(); });
+      if (batch.empty() && stopping)
+        {
+        return;
+        }
+      writing.swap(batch);
+      flush_requested = pending_flush;
+      }
+
+      for (auto const& e : writing)
+        {
+        std::ostream& os = e.error ? std::cerr : std::cout;
+        // Keep the two streams in order on a terminal
+        if (e.error)
+          {
+          std::cout.flush();
+          }
+        os.write(e.text.data(), e.text.size());
+        }
+      writing.clear();
+      std::cout.flush();
+      std::cerr.flush();
+
+      if (flush_requested)
+        {
+        std::lock_guard<std::mutex> guard(lock);
+        pending_flush = false;
+        flushed.notify_all();
+        }
+      }
+    }
+
+  std::mutex lock;
+  std::condition_variable wake;
+  std::condition_variable flushed;
+  std::vector<entry> batch;
+  std::size_t revision_reported;
+  bool pending_flush;
+  bool stopping;
+  std::thread thread;
+  };
+
+writer& the_writer()
+  {
+  static writer w;
+  return w;
   }
 
-void set_revision(std::size_t rev)
+char const* prefix(Level level)
   {
-  if ((revision % 1000) == 0)
+  switch (level)
     {
-    check_revision();
+    case Error:
+      return "++ ERROR: ";
+    case Warning:
+      return "++ WARNING: ";
+    default:
+      return "-- ";
     }
-  revision = rev;
   }
 
-std::ostream& error()
+  } // namespace
+
+Level get_level()
   {
-  ++num_errors;
-  //if (num_errors > 100)
-  //  {
-  //  throw std::runtime_error("Too many errors, skipping.");
-  //  }
-  check_revision();
-  return std::cerr << "++ ERROR: ";
+  return level;
   }
 
-std::ostream& trace()
+void set_level(Level value)
+  {
+  level = value;
+  }
+
+void set_revision(std::size_t rev)
   {
-  if (level < Log::Trace)
+  if ((revision % 1000) == 0)
     {
-    return dummy;
+    the_writer().report_revision();
     }
-  check_revision();
-  return std::cout << "-- ";
+  revision = rev;
   }
 
-std::ostream& debug()
+line::line(Level level)
+  : level(level)
   {
-  if (level < Log::Debug)
+  if (level == Error)
     {
-    return dummy;
+    ++num_errors;
     }
-  check_revision();
-  return std::cout << "-- ";
+  buffer << prefix(level);
+  }
+
+line::line(Level level, unprefixed_t)
+  : level(level)
+  {
   }
 
-std::ostream& info()
+line::~line()
   {
-  if (level < Log::Info)
+  if (level > get_level())
     {
-    return dummy;
+    return;
     }
-  check_revision();
-  return std::cout << "-- ";
+  the_writer().submit(level == Error, buffer.str());
   }
 
-std::ostream& warn()
+void flush()
   {
-  check_revision();
-  return std::cout << "++ WARNING: ";
+  the_writer().flush();
   }
 
 int result()
@@ -110,7 +249,7 @@ int result()
     {
     return 0;
     }
-  std::cerr << "\n" << num_errors << " Errors occured!" << std::endl;
+  line(Error, line::unprefixed) << "\n" << num_errors << " Errors occured!" << std::endl;
   return -1;
   }
 
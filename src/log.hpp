@@ -18,13 +18,15 @@
 #ifndef LOG_HPP
 #define LOG_HPP
 
-#include <iostream>
+#include <sstream>
+#include <string>
 
 namespace Log
 {
 
 enum Level
   {
+  Error,
   Warning,
   Info,
   Debug,
@@ -35,14 +37,71 @@ Level get_level();
 void set_level(Level value);
 void set_revision(std::size_t value);
 
-std::ostream& error();
-std::ostream& trace();
-std::ostream& debug();
-std::ostream& info();
-std::ostream& warn();
+// One log statement, formatted in the calling thread and handed whole
+// to a background thread that writes the log in batches, so logging
+// is safe from any thread and rarely waits on the terminal.  Errors go
+// to std::cerr, everything else to std::cout, each with its prefix
+// unless the statement is unprefixed.
+class line
+  {
+public:
+  struct unprefixed_t {};
+  static unprefixed_t const unprefixed;
+
+  explicit line(Level level);
+  line(Level level, unprefixed_t);
+  ~line();
+
+  template <class T>
+  line& operator<<(T const& x)
+    {
+    buffer << x;
+    return *this;
+    }
+
+  // For std::endl and the like, which here just end the line
+  line& operator<<(std::ostream& (*manipulator)(std::ostream&))
+    {
+    buffer << manipulator;
+    return *this;
+    }
+
+  std::ostream& stream()
+    {
+    return buffer;
+    }
+
+  line(line const&) = delete;
+  line& operator=(line const&) = delete;
+
+private:
+  Level level;
+  std::ostringstream buffer;
+  };
+
+// Write everything logged so far
+void flush();
 
 int result();
 
 } // namespace Log
 
+// The log statements.  Use them like streams,
+//
+//   LOG_TRACE << "adding " << svn_path << std::endl;
+//
+// When their level is off, nothing after the macro is evaluated.
+#define SVN2GIT_LOG_AT(level) \
+  if (Log::get_level() < Log::level) {} else Log::line(Log::level)
+
+#define LOG_ERROR Log::line(Log::Error)
+#define LOG_WARN Log::line(Log::Warning)
+#define LOG_INFO SVN2GIT_LOG_AT(Info)
+#define LOG_DEBUG SVN2GIT_LOG_AT(Debug)
+#define LOG_TRACE SVN2GIT_LOG_AT(Trace)
+
+// For continuing a line, or echoing a stream piece by piece
+#define LOG_TRACE_UNPREFIXED \
+  if (Log::get_level() < Log::Trace) {} else Log::line(Log::Trace, Log::line::unprefixed)
+
 #endif /* LOG_HPP */
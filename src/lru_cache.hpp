@@ -0,0 +1,65 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef LRU_CACHE_DWA2013730_HPP
+# define LRU_CACHE_DWA2013730_HPP
+
+# include <cstddef>
+# include <list>
+# include <map>
+# include <memory>
+# include <mutex>
+
+// A thread-safe least-recently-used cache, bounded by the total cost
+// of its entries
+template <class Key, class Value>
+class lru_cache
+{
+ public:
+    explicit lru_cache(std::size_t capacity) : capacity(capacity), total(0) {}
+
+    std::shared_ptr<Value const> find(Key const& key)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto const pos = index.find(key);
+        if (pos == index.end())
+            return std::shared_ptr<Value const>();
+        entries.splice(entries.begin(), entries, pos->second);
+        return pos->second->value;
+    }
+
+    void insert(Key const& key, std::shared_ptr<Value const> value, std::size_t cost)
+    {
+        if (cost > capacity / 4)
+            return;
+        std::lock_guard<std::mutex> guard(lock);
+        if (index.count(key))
+            return;
+        entry const e = { key, std::move(value), cost };
+        entries.push_front(e);
+        index[key] = entries.begin();
+        total += cost;
+        while (total > capacity)
+        {
+            total -= entries.back().cost;
+            index.erase(entries.back().key);
+            entries.pop_back();
+        }
+    }
+
+ private:
+    struct entry
+    {
+        Key key;
+        std::shared_ptr<Value const> value;
+        std::size_t cost;
+    };
+
+    std::mutex lock;
+    std::size_t const capacity;
+    std::size_t total;
+    std::list<entry> entries;           // most recently used first
+    std::map<Key, typename std::list<entry>::iterator> index;
+};
+
+#endif // LRU_CACHE_DWA2013730_HPP
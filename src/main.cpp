@@ -28,7 +28,13 @@
 #include "log.hpp"
 #include "importer.hpp"
 #include "git_executable.hpp"
+#include "status.hpp"
+#include "timing.hpp"
+#include "allocations.hpp"
+#include "fsfs.hpp"
+#include "prefetch.hpp"
 
+#include <memory>
 #include <utility>
 
 Options options;
@@ -39,11 +45,18 @@ int main(int argc, char **argv)
     std::string authors_file;
     std::string ignore_file;
     std::string svn_path;
+    std::string svn_dump_file;
+    std::string svn_backend = "libsvn";
     int resume_from = 0;
     int max_rev = 0;
     bool dump_rules = false;
     std::string match_path;
     int match_rev = 0;
+    std::string status_file;
+    std::string rules_cache;
+    std::string status_socket;
+    unsigned status_interval = 10;
+    unsigned prefetch_depth = 32;
     try
     {
         namespace po = boost::program_options;
@@ -57,8 +70,12 @@ int main(int argc, char **argv)
             ("extra-verbose,X", "be even more verbose")
             ("exit-success", "exit with 0, even if errors occured")
             ("authors", po::value(&authors_file)->value_name("FILENAME"), "map between svn username and email")
-            ("svnrepo", po::value(&svn_path)->value_name("PATH")->required(), "path to svn repository")
+            ("svnrepo", po::value(&svn_path)->value_name("PATH"), "path to svn repository")
+            ("svndump", po::value(&svn_dump_file)->value_name("FILENAME"), "read an svn dump, which may be gzip- or bzip2-compressed, from FILENAME (\"-\" for standard input) instead of a repository")
+            ("svn-backend", po::value(&svn_backend)->value_name("NAME")->default_value("libsvn"), "how to read the svn repository: \"libsvn\", or \"fsfs\" to read FSFS files directly")
+            ("prefetch", po::value(&prefetch_depth)->value_name("REVISIONS")->default_value(32), "read ahead the parts of an FSFS repository needed by the next REVISIONS revisions, in the background; 0 disables it")
             ("rules", po::value(&options.rules_file)->value_name("FILENAME")->required(), "file with the conversion rules")
+            ("rules-cache", po::value(&rules_cache)->value_name("FILENAME"), "load the compiled ruleset from FILENAME, rebuilding it when the rules file has changed")
             ("dry-run", "Write no Git repositories")
             ("coverage", "Dump an analysis of rule coverage")
             ("add-metadata", "if passed, each git commit will have svn commit info")
@@ -68,9 +85,21 @@ int main(int argc, char **argv)
             ("debug-rules", "print what rule is being used for each file")
             ("commit-interval", po::value(&options.commit_interval)->value_name("NUMBER")->default_value(10000), "if passed the cache will be flushed to git every NUMBER of commits")
             ("svn-branches", "Use the contents of SVN when creating branches, Note: SVN tags are branches as well")
+            ("gitlink-marks", "write submodule gitlinks as mark placeholders, to be resolved later by fix-submodule-refs")
+            ("spool", po::value(&options.spool_dir)->value_name("DIR"), "write each repository's fast-import stream, compressed, to a file in DIR for svn2git-replay, instead of running git fast-import; implies --gitlink-marks")
+            ("object-pool", po::value(&options.object_pool)->value_name("DIR"), "keep the objects of all repositories in one bare repository DIR, which each borrows from through objects/info/alternates, so objects they share are stored once; objects reach the pool when the run ends, so sharing begins with the next run")
+            ("status-file", po::value(&status_file)->value_name("FILENAME"), "periodically rewrite FILENAME with the progress of the conversion")
+            ("status-socket", po::value(&status_socket)->value_name("PATH"), "send the progress of the conversion to clients of a Unix-domain socket at PATH")
+            ("status-interval", po::value(&status_interval)->value_name("SECONDS")->default_value(10), "how often to update the progress report")
             ("dump-rules", "Dump the contents of the rule trie and exit")
             ("match-path", po::value(&match_path)->value_name("PATH"), "Path to match in a quick ruleset test")
             ("match-rev", po::value(&match_rev)->value_name("REVISION"), "Optional revision to match in a quick ruleset test")
+#ifdef SVN2GIT_ALLOCATIONS
+            ("allocation-report", po::value<std::size_t>()->value_name("REVISIONS"), "report heap allocations by phase every REVISIONS revisions, as well as at the end")
+#endif
+#ifdef SVN2GIT_TIMING
+            ("timing-trace", po::value<std::string>()->value_name("FILENAME"), "write a Chrome trace-event file of the time spent in each phase")
+#endif
             ;
         po::variables_map variables;
         store(po::command_line_parser(argc, argv)
@@ -109,14 +138,32 @@ int main(int argc, char **argv)
         options.coverage = variables.count("coverage");
         options.debug_rules = variables.count("debug-rules");
         options.svn_branches = variables.count("svn-branches");
+        options.gitlink_marks = variables.count("gitlink-marks") || variables.count("spool");
+#ifdef SVN2GIT_ALLOCATIONS
+        if (variables.count("allocation-report"))
+            allocations::report_every(variables["allocation-report"].as<std::size_t>());
+#endif
+#ifdef SVN2GIT_TIMING
+        if (variables.count("timing-trace"))
+            timing::trace_to(variables["timing-trace"].as<std::string>());
+#endif
         notify(variables);
+        if (svn_backend != "libsvn" && svn_backend != "fsfs")
+        {
+            throw std::runtime_error("unknown svn backend: " + svn_backend);
+        }
+        if (svn_path.empty() == svn_dump_file.empty())
+        {
+            throw std::runtime_error("exactly one of --svnrepo and --svndump is required");
+        }
 
 
         // Load the configuration
-        Log::info() << "reading ruleset..." << std::endl;
+        LOG_INFO << "reading ruleset..." << std::endl;
 
-        Ruleset ruleset(options.rules_file);
-        Log::info() << "done reading ruleset." << std::endl;
+        Ruleset ruleset(options.rules_file, rules_cache);
+        LOG_INFO << "done reading ruleset." << std::endl;
+        Log::flush();
 
         if (dump_rules)
         {
@@ -131,28 +178,77 @@ int main(int argc, char **argv)
             exit(r ? 0 : 1);
         }
 
-        Log::info() << "Opening SVN repository at " << svn_path << std::endl;
-        svn svn_repo(svn_path, authors_file);
+        bool const from_dump = !svn_dump_file.empty();
+        LOG_INFO << "Opening SVN " << (from_dump ? "dump " + svn_dump_file : "repository at " + svn_path) << std::endl;
+        svn svn_repo(
+            from_dump ? svn_dump_file : svn_path, authors_file,
+            from_dump ? svn::dump_stream : svn_backend == "fsfs" ? svn::native_fs : svn::libsvn);
 
-        Log::info() << "preparing repositories and import processes..." << std::endl;
+        LOG_INFO << "preparing repositories and import processes..." << std::endl;
         importer imp(svn_repo, ruleset);
-        Log::info() << "done preparing repositories and import processes." << std::endl;
+        LOG_INFO << "done preparing repositories and import processes." << std::endl;
 
-        if (max_rev < 1)
+        // A dump's last revision isn't known until it has been read
+        if (max_rev < 1 && !from_dump)
             max_rev = svn_repo.latest_revision();
 
-        Log::info() << "Using git executable: " << git_executable() << std::endl;
+        LOG_INFO << "Using git executable: " << git_executable() << std::endl;
+
+        // Declared after the importer, so it stops reporting first
+        std::unique_ptr<status_reporter> status;
+        if (!status_file.empty() || !status_socket.empty())
+        {
+            status.reset(
+                new status_reporter(
+                    imp, imp.last_valid_svn_revision() + 1, max_rev,
+                    status_file, status_socket, status_interval));
+        }
+
+        // Dumps are read sequentially anyway
+        std::unique_ptr<fsfs> prefetch_layout;
+        std::unique_ptr<prefetcher> prefetch;
+        if (prefetch_depth > 0 && !from_dump)
+        {
+            try
+            {
+                fsfs const* layout = svn_repo.native.get();
+                if (layout == nullptr)
+                {
+                    prefetch_layout.reset(new fsfs(svn_path));
+                    layout = prefetch_layout.get();
+                }
+                prefetch.reset(
+                    new prefetcher(*layout, imp.last_valid_svn_revision() + 1, max_rev, prefetch_depth));
+            }
+            catch (std::exception const& e)
+            {
+                LOG_WARN << "not reading ahead: " << e.what() << std::endl;
+            }
+        }
 
-        for (int i = imp.last_valid_svn_revision(); ++i <= max_rev;)
+        for (int i = imp.last_valid_svn_revision() + 1;
+             max_rev > 0 ? i <= max_rev : svn_repo.has_revision(i); ++i)
+        {
+            if (prefetch)
+                prefetch->advance(i);
             imp.import_revision(i);
+        }
 
+        // The coverage report is written directly, after the log
+        Log::flush();
         coverage::report();
     }
     catch (std::exception const& error)
     {
-        Log::error() << error.what() << "\n\n";
+        LOG_ERROR << error.what() << "\n\n";
         return EXIT_FAILURE;
     }
+#ifdef SVN2GIT_TIMING
+    timing::report();
+#endif
+#ifdef SVN2GIT_ALLOCATIONS
+    allocations::report();
+#endif
     int result = Log::result();
     return exit_success ? EXIT_SUCCESS : result;
 }
@@ -0,0 +1,191 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "mark_sha_map.hpp"
+
+#include <boost/crc.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <sys/stat.h>
+
+namespace {
+
+char const index_magic[8] = { 'S', 'V', 'N', '2', 'G', 'I', 'T', 'M' };
+std::uint32_t const index_version = 2;
+std::uint32_t const byte_order_mark = 0x01020304;
+
+struct index_header
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byte_order;
+    std::uint64_t text_size;   // of the marks file this was built from
+    std::int64_t text_mtime_ns;// ditto
+    std::uint32_t text_crc;    // ditto
+    std::uint32_t reserved;
+    std::uint64_t count;       // followed by count 20-byte SHAs
+};
+
+unsigned text_crc(char const* text, std::size_t size)
+{
+    boost::crc_32_type crc;
+    crc.process_bytes(text, size);
+    return crc.checksum();
+}
+
+// The shortest possible line in a marks file, ":1 <sha>\n"
+std::size_t const min_line_length = 3 + 2 * sha_size + 1;
+
+}
+
+unsigned char const* mark_sha_map::data() const
+{
+    return index.is_open()
+        ? reinterpret_cast<unsigned char const*>(index.data() + sizeof(index_header))
+        : shas.data();
+}
+
+// What identifies a version of the marks file without reading it
+struct mark_sha_map::text_stamp
+{
+    std::uint64_t size;
+    std::int64_t mtime_ns;
+};
+
+// Maps the text of a marks file, if it isn't empty (empty files can't
+// be mapped)
+static char const* map_text(
+    boost::iostreams::mapped_file_source& text, std::string const& marks_file, std::size_t size)
+{
+    if (size == 0)
+        return "";
+    text.open(marks_file);
+    return text.data();
+}
+
+void mark_sha_map::load(std::string const& marks_file, bool use_index, bool verify_index)
+{
+    index.close();
+    shas.clear();
+    count = 0;
+
+    struct stat st;
+    if (::stat(marks_file.c_str(), &st) != 0)
+        throw std::runtime_error("cannot read marks file " + marks_file);
+    text_stamp const stamp = {
+        std::uint64_t(st.st_size),
+        std::int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec
+    };
+
+    std::string const index_file = marks_file + ".idx";
+    if (use_index && map_index(index_file, stamp, marks_file, verify_index))
+        return;
+
+    boost::iostreams::mapped_file_source text;
+    char const* const text_data = map_text(text, marks_file, stamp.size);
+    parse(text_data, stamp.size, marks_file);
+    if (use_index)
+        write_index(index_file, stamp, text_crc(text_data, stamp.size));
+}
+
+void mark_sha_map::parse(char const* p, std::size_t size, std::string const& marks_file)
+{
+    // The table is indexed by mark, and marks may have gaps, so the
+    // number of lines is only an initial estimate of its size; it
+    // grows below to hold the largest mark
+    shas.assign((size / min_line_length + 1) * sha_size, 0);
+
+    char const* const end = p + size;
+    while (p != end)
+    {
+        if (*p++ != ':')
+            throw std::runtime_error("Expected colon in marks file " + marks_file);
+
+        std::size_t mark = 0;
+        char const* digits = p;
+        for (; p != end && *p >= '0' && *p <= '9'; ++p)
+            mark = mark * 10 + (*p - '0');
+
+        if (p == digits || p == end || *p++ != ' ')
+            throw std::runtime_error("Expected mark in marks file " + marks_file);
+
+        char const* eol = static_cast<char const*>(std::memchr(p, '\n', end - p));
+        char const* sha_end = eol ? eol : end;
+
+        if ((mark + 1) * sha_size > shas.size())
+            shas.resize(std::max(shas.size() * 2, (mark + 1) * sha_size), 0);
+
+        unsigned char* sha = &shas[mark * sha_size];
+        if (mark < count && find(mark) != nullptr)
+            throw std::runtime_error("Duplicate mark mapping in " + marks_file);
+        if (!sha_from_hex(p, sha_end - p, sha))
+            throw std::runtime_error("Expected SHA in marks file " + marks_file);
+
+        count = std::max(count, mark + 1);
+        p = eol ? eol + 1 : end;
+    }
+    shas.resize(count * sha_size);
+}
+
+bool mark_sha_map::map_index(
+    std::string const& index_file, text_stamp const& stamp,
+    std::string const& marks_file, bool verify)
+{
+    namespace fs = boost::filesystem;
+    if (!fs::exists(index_file) || fs::file_size(index_file) < sizeof(index_header))
+        return false;
+
+    index.open(index_file);
+    index_header const& hdr = *reinterpret_cast<index_header const*>(index.data());
+    if (std::memcmp(hdr.magic, index_magic, sizeof(index_magic)) != 0
+        || hdr.version != index_version
+        || hdr.byte_order != byte_order_mark
+        || hdr.text_size != stamp.size
+        || hdr.text_mtime_ns != stamp.mtime_ns
+        || index.size() != sizeof(index_header) + hdr.count * sha_size)
+    {
+        index.close();
+        return false;
+    }
+
+    if (verify)
+    {
+        boost::iostreams::mapped_file_source text;
+        if (hdr.text_crc != text_crc(map_text(text, marks_file, stamp.size), stamp.size))
+        {
+            index.close();
+            return false;
+        }
+    }
+    count = hdr.count;
+    return true;
+}
+
+void mark_sha_map::write_index(
+    std::string const& index_file, text_stamp const& stamp, unsigned crc) const
+{
+    index_header hdr;
+    std::memcpy(hdr.magic, index_magic, sizeof(index_magic));
+    hdr.version = index_version;
+    hdr.byte_order = byte_order_mark;
+    hdr.text_size = stamp.size;
+    hdr.text_mtime_ns = stamp.mtime_ns;
+    hdr.text_crc = crc;
+    hdr.reserved = 0;
+    hdr.count = count;
+
+    // Write to a temporary file and rename it into place, so that
+    // concurrent readers never see a partial index.
+    std::string const tmp_file = index_file + ".tmp";
+    {
+        std::ofstream out(tmp_file.c_str(), std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<char const*>(&hdr), sizeof(hdr));
+        out.write(reinterpret_cast<char const*>(shas.data()), shas.size());
+        if (!out.flush())
+            throw std::runtime_error("error writing marks index " + tmp_file);
+    }
+    boost::filesystem::rename(tmp_file, index_file);
+}
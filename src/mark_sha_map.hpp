@@ -4,30 +4,99 @@
 #ifndef MARK_SHA_MAP_DWA2013515_HPP
 # define MARK_SHA_MAP_DWA2013515_HPP
 
-# include <algorithm>
-# include <vector>
+# include <boost/iostreams/device/mapped_file.hpp>
 # include <string>
+# include <vector>
+
+std::size_t const sha_size = 20;
+
+inline int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
 
-typedef std::vector<std::pair<unsigned long, std::string> > mark_sha_map;
+// Write the 40 hex digits of a binary SHA to out
+inline void sha_to_hex(unsigned char const* sha, char* out)
+{
+    static char const digits[] = "0123456789abcdef";
+    for (std::size_t i = 0; i < sha_size; ++i)
+    {
+        out[2 * i] = digits[sha[i] >> 4];
+        out[2 * i + 1] = digits[sha[i] & 0xF];
+    }
+}
 
-struct compare_marks
-  {
-  bool operator()(mark_sha_map::const_reference lhs, unsigned long rhs) const
+inline std::string sha_to_hex(unsigned char const* sha)
+{
+    std::string result(2 * sha_size, '0');
+    sha_to_hex(sha, &result[0]);
+    return result;
+}
+
+// Returns false unless text is exactly 40 hex digits
+inline bool sha_from_hex(char const* text, std::size_t size, unsigned char* sha)
+{
+    if (size != 2 * sha_size)
+        return false;
+    for (std::size_t i = 0; i < sha_size; ++i)
     {
-    return lhs.first < rhs;
+        int hi = hex_digit(text[2 * i]), lo = hex_digit(text[2 * i + 1]);
+        if (hi < 0 || lo < 0)
+            return false;
+        sha[i] = static_cast<unsigned char>(hi << 4 | lo);
     }
-  };
-
-inline mark_sha_map::iterator
-find_sha_pos(mark_sha_map& m, unsigned long mark)
-  {
-  return std::lower_bound(m.begin(), m.end(), mark, compare_marks());
-  }
-
-inline mark_sha_map::const_iterator
-find_sha_pos(mark_sha_map const& m, unsigned long mark)
-  {
-  return std::lower_bound(m.begin(), m.end(), mark, compare_marks());
-  }
+    return true;
+}
+
+// The SHAs of the objects written by git fast-import, as recorded
+// in the marks file it exports.  fast-import allocates marks densely,
+// so SHAs are stored in binary in an array indexed by mark.
+//
+// When asked to, load() keeps a binary copy of the table next to the
+// marks file, tagged with the size, modification time and CRC of the
+// text it came from.  Later loads of a marks file with the same size
+// and modification time just map that copy, without reading the text;
+// verify_index makes them check the text's CRC too.
+class mark_sha_map
+{
+ public:
+    mark_sha_map() : count(0) {}
+
+    void load(std::string const& marks_file, bool use_index = false, bool verify_index = false);
+
+    // Returns the 20-byte SHA recorded for mark, or null if there is none
+    unsigned char const* find(std::size_t mark) const
+    {
+        if (mark >= count)
+            return nullptr;
+        unsigned char const* sha = data() + mark * sha_size;
+        for (std::size_t i = 0; i < sha_size; ++i)
+        {
+            if (sha[i] != 0)
+                return sha;
+        }
+        return nullptr;
+    }
+
+    // One more than the largest mark
+    std::size_t size() const { return count; }
+
+ private:
+    unsigned char const* data() const;
+    void parse(char const* text, std::size_t size, std::string const& marks_file);
+    struct text_stamp;
+    bool map_index(
+        std::string const& index_file, text_stamp const& stamp,
+        std::string const& marks_file, bool verify);
+    void write_index(std::string const& index_file, text_stamp const& stamp, unsigned crc) const;
+
+ private:
+    boost::iostreams::mapped_file_source index;
+    std::vector<unsigned char> shas;
+    std::size_t count;
+};
 
 #endif // MARK_SHA_MAP_DWA2013515_HPP
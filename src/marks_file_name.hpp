@@ -18,4 +18,10 @@ inline std::string marks_file_path(std::string repo_name)
   return repo_name + "/" + marksFileName(repo_name);
   }
 
+inline std::string revmap_file_path(std::string repo_name)
+  {
+  std::string marks_path = marks_file_path(repo_name);
+  return marks_path.replace(marks_path.rfind("marks-"), 6, "revmap-");
+  }
+
 #endif // MARKS_FILE_NAME_DWA2013516_HPP
@@ -0,0 +1,147 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "object_pool.hpp"
+#include "git_executable.hpp"
+
+#include <boost/filesystem.hpp>
+#include <boost/process.hpp>
+#include <cctype>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace object_pool {
+
+namespace {
+
+namespace fs = boost::filesystem;
+
+void run_git(std::string const& dir, std::vector<std::string> args)
+{
+    namespace process = boost::process;
+    using namespace process::initializers;
+
+    args.insert(args.begin(), git_executable());
+    auto git = process::execute(
+        run_exe(git_executable()), set_args(args), start_in_dir(dir), throw_on_error());
+    process::wait_for_exit(git);
+}
+
+// Creating the pool has to happen once, whichever repository (or
+// svn2git-replay thread) gets there first
+std::mutex creation_lock;
+
+void ensure_pool(std::string const& pool_dir)
+{
+    std::lock_guard<std::mutex> guard(creation_lock);
+    if (fs::exists(pool_dir))
+        return;
+
+    fs::create_directories(pool_dir);
+    run_git(pool_dir, { "init", "--bare", "--quiet" });
+    run_git(pool_dir, { "config", "gc.auto", "0" });
+    run_git(pool_dir, { "config", "gc.pruneExpire", "never" });
+}
+
+// Move a file into the pool, copying it when the pool is on another
+// filesystem.  The copy is made under a temporary name and renamed
+// into place, so the pool never holds a partial object.
+void move_file(fs::path const& from, fs::path const& to)
+{
+    boost::system::error_code error;
+    fs::rename(from, to, error);
+    if (!error)
+        return;
+    if (error != boost::system::errc::cross_device_link)
+        throw fs::filesystem_error("cannot move object file", from, to, error);
+
+    // Another replay may be moving a file of the same name into the
+    // pool, so copy to a name of our own
+    fs::path const tmp = to.parent_path() / fs::unique_path("tmp_%%%%-%%%%-%%%%-%%%%.tmp");
+    try
+    {
+        std::ifstream in(from.string(), std::ios::binary);
+        std::ofstream out(tmp.string(), std::ios::binary | std::ios::trunc);
+        out << in.rdbuf();
+        out.close();
+        if (!in || !out)
+            throw std::runtime_error("cannot copy " + from.string() + " to " + tmp.string());
+        fs::rename(tmp, to);
+    }
+    catch (...)
+    {
+        fs::remove(tmp, error);
+        throw;
+    }
+    fs::remove(from);
+}
+
+}
+
+void share(std::string const& pool_dir, std::string const& git_dir)
+{
+    ensure_pool(pool_dir);
+
+    std::string const pool_objects = fs::canonical(fs::path(pool_dir) / "objects").string();
+    fs::path const alternates = fs::path(git_dir) / "objects" / "info" / "alternates";
+
+    std::string line;
+    for (std::ifstream in(alternates.string()); std::getline(in, line);)
+    {
+        if (line == pool_objects)
+            return;
+    }
+
+    fs::create_directories(alternates.parent_path());
+    std::ofstream out(alternates.string(), std::ios::app);
+    out << pool_objects << '\n';
+    if (!out)
+        throw std::runtime_error("cannot write " + alternates.string());
+}
+
+void move_packs(std::string const& pool_dir, std::string const& git_dir)
+{
+    fs::path const objects = fs::path(git_dir) / "objects";
+    fs::path const pool_objects = fs::path(pool_dir) / "objects";
+
+    // fast-import leaves a small import as loose objects rather than a
+    // pack; those go too, into the same fan-out directories
+    for (fs::directory_iterator d(objects), end; d != end; ++d)
+    {
+        std::string const fanout = d->path().filename().string();
+        if (fanout.size() != 2 || !std::isxdigit(fanout[0]) || !std::isxdigit(fanout[1]))
+            continue;
+        fs::create_directories(pool_objects / fanout);
+        for (fs::directory_iterator p(d->path()); p != end; ++p)
+            move_file(p->path(), pool_objects / fanout / p->path().filename());
+    }
+
+    fs::path const from = objects / "pack";
+    fs::path const to = pool_objects / "pack";
+    if (!fs::exists(from))
+        return;
+    fs::create_directories(to);
+
+    std::vector<fs::path> indexes;
+    for (fs::directory_iterator p(from), end; p != end; ++p)
+    {
+        if (p->path().extension() == ".idx")
+            indexes.push_back(p->path());
+    }
+
+    // Git finds a pack by its index, so each index moves only after
+    // its pack is in place.  Packs are named for their contents, so
+    // one that is already in the pool is simply replaced.
+    for (auto const& idx : indexes)
+    {
+        fs::path const pack = fs::path(idx).replace_extension(".pack");
+        if (!fs::exists(pack))
+            continue;
+        move_file(pack, to / pack.filename());
+        move_file(idx, to / idx.filename());
+    }
+}
+
+}
@@ -0,0 +1,39 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef OBJECT_POOL_DWA2013801_HPP
+# define OBJECT_POOL_DWA2013801_HPP
+
+# include <string>
+
+// With --object-pool DIR, the output repositories keep their objects
+// in one shared bare repository, DIR, which each of them lists in its
+// objects/info/alternates.  git fast-import doesn't write an object
+// that is already in a pack it can see, including the pool's, so a
+// blob or tree that several repositories contain is only compressed
+// and stored once it has reached the pool.  The objects a fast-import
+// writes are moved to the pool once it exits, where later imports
+// (and later runs) find them.
+//
+// fast-import reads the list of packs it can see only when it starts,
+// and svn2git runs all the repositories' fast-imports at once, so
+// objects aren't shared among the repositories written in the same
+// run: the savings come in later runs, and in svn2git-replay with
+// --jobs limiting how many repositories are replayed at once.
+//
+// The pool has no refs of its own, so it is configured never to
+// prune unreachable objects; every object in it is reachable only
+// from the repositories borrowing it.
+namespace object_pool {
+
+// Make the repository at git_dir borrow objects from the pool at
+// pool_dir, creating the pool if need be
+void share(std::string const& pool_dir, std::string const& git_dir);
+
+// Move the packs, and any loose objects, written into the repository
+// at git_dir to the pool
+void move_packs(std::string const& pool_dir, std::string const& git_dir);
+
+}
+
+#endif // OBJECT_POOL_DWA2013801_HPP
@@ -29,8 +29,11 @@ struct Options
   bool coverage;
   int commit_interval;
   bool svn_branches;
+  bool gitlink_marks;
   std::string rules_file;
   std::string git_executable;
+  std::string spool_dir;
+  std::string object_pool;
   };
 
 extern Options options;
@@ -4,46 +4,122 @@
 #include "parse_rules.hpp"
 
 #include <boost/spirit/home/qi.hpp>
-#include <fstream>
+#include <boost/filesystem/operations.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
 #include <iomanip>
+#include <sstream>
 #include <stdexcept>
 #include <boost/spirit/include/qi.hpp>
-#include <boost/spirit/include/support_multi_pass.hpp>
-#include <boost/spirit/include/classic_position_iterator.hpp>
 #include <boost/spirit/repository/include/qi_confix.hpp>
 #include <boost/spirit/repository/include/qi_iter_pos.hpp>
+#include <boost/spirit/include/phoenix_core.hpp>
 #include <boost/spirit/home/phoenix/bind/bind_function.hpp>
 #include <boost/algorithm/string/predicate.hpp>
+#include <boost/proto/deep_copy.hpp>
 
 namespace qi = boost::spirit::qi;
 namespace ascii = boost::spirit::ascii;
-namespace classic = boost::spirit::classic;
 namespace phoenix = boost::phoenix;
 
 namespace boost2git
 {
 
-typedef std::istreambuf_iterator<char> BaseIterator;
-typedef boost::spirit::multi_pass<BaseIterator> ForwardIterator;
-typedef classic::position_iterator2<ForwardIterator> PosIterator;
+typedef char const* Iterator;
 
-static void get_line(int& line, PosIterator const& iterator)
+// Computes line numbers from positions in the text.  Positions are
+// mostly requested in increasing order, so counting resumes from the
+// previous request instead of the beginning.
+class LineCounter
   {
-  line = iterator.get_position().line;
+  public:
+    LineCounter(Iterator begin, Iterator end)
+      : begin(begin), end(end), last(begin), last_line(1)
+      {
+      }
+
+    int line(Iterator pos)
+      {
+      if (pos < last)
+        {
+        last = begin;
+        last_line = 1;
+        }
+      for (; last != pos; ++last)
+        {
+        if (is_newline(last))
+          {
+          ++last_line;
+          }
+        }
+      return last_line;
+      }
+
+    // The text of the line containing pos, without its line ending
+    std::string current_line(Iterator pos) const
+      {
+      Iterator start = pos;
+      while (start != begin && !is_newline(start - 1))
+        {
+        --start;
+        }
+      Iterator finish = pos;
+      while (finish != end && *finish != '\n' && *finish != '\r')
+        {
+        ++finish;
+        }
+      return std::string(start, finish);
+      }
+
+    // The column of pos, counting from 1, with tab stops every 4
+    // columns as Spirit's position_iterator has it
+    int column(Iterator pos) const
+      {
+      int const tab_size = 4;
+      Iterator start = pos;
+      while (start != begin && !is_newline(start - 1))
+        {
+        --start;
+        }
+      int result = 1;
+      for (; start != pos; ++start)
+        {
+        result += *start == '\t' ? tab_size - (result - 1) % tab_size : 1;
+        }
+      return result;
+      }
+
+  private:
+    // A "\r\n" pair ends a line at the '\n'
+    bool is_newline(Iterator c) const
+      {
+      return *c == '\n' || (*c == '\r' && (c + 1 == end || c[1] != '\n'));
+      }
+
+    Iterator begin;
+    Iterator end;
+    Iterator last;
+    int last_line;
+  };
+
+static void get_line(LineCounter& lines, int& line, Iterator pos)
+  {
+  line = lines.line(pos);
   }
-static void set_git_ref_qualifier(boost2git::BranchRule& branch, char const* qualifier)
+static void set_git_ref_qualifiers(std::vector<BranchRule>& branches, char const* qualifier)
   {
-  branch.git_ref_qualifier = qualifier;
+  for (std::size_t i = 0; i < branches.size(); ++i)
+    {
+    branches[i].git_ref_qualifier = qualifier;
+    }
   }
 } // namespace boost2git
 
 using namespace boost2git;
-using boost::spirit::make_default_multi_pass;
 
 template<typename Iterator, typename Skipper>
 struct RepositoryGrammar: qi::grammar<Iterator, RepoRule(), Skipper>
   {
-  RepositoryGrammar() : RepositoryGrammar::base_type(repository_)
+  explicit RepositoryGrammar(LineCounter& lines) : RepositoryGrammar::base_type(repository_)
     {
     repository_
      %= (qi::matches["abstract"] >> "repository")
@@ -68,13 +144,13 @@ struct RepositoryGrammar: qi::grammar<Iterator, RepoRule(), Skipper>
     branches_
      %= qi::lit("branches")
       > '{'
-      > +(branch_[phoenix::bind(set_git_ref_qualifier, qi::_1, "refs/heads/")])
+      > +branch_
       > '}'
       ;
     tags_
      %= qi::lit("tags")
       > '{'
-      > +branch_[phoenix::bind(set_git_ref_qualifier, qi::_1, "refs/tags/")]
+      > +branch_
       > '}'
       ;
     branch_
@@ -95,7 +171,7 @@ struct RepositoryGrammar: qi::grammar<Iterator, RepoRule(), Skipper>
       ;
     line_number_ = boost::spirit::repository::qi::iter_pos
       [
-      phoenix::bind(get_line, qi::_val, qi::_1)
+      phoenix::bind(get_line, phoenix::ref(lines), qi::_val, qi::_1)
       ];
     }
   qi::rule<Iterator, RepoRule(), Skipper> repository_;
@@ -108,41 +184,66 @@ struct RepositoryGrammar: qi::grammar<Iterator, RepoRule(), Skipper>
 
 AST parse_rules_file(std::string filename)
   {
-  AST ast;
+  std::vector<RepoRule> rules;
   
-  std::ifstream file(filename.c_str());
-  if (!file)
+  namespace fs = boost::filesystem;
+  boost::system::error_code ec;
+  std::size_t const size = fs::file_size(filename, ec);
+  if (ec)
     {
     throw std::runtime_error("cannot read ruleset: " + filename);
     }
 
-  BaseIterator in_begin(file);
-  ForwardIterator fwd_begin = make_default_multi_pass(in_begin), fwd_end;
-  PosIterator begin(fwd_begin, fwd_end), end;
+  boost::iostreams::mapped_file_source file;
+  if (size > 0)      // empty files can't be mapped
+    {
+    try
+      {
+      file.open(filename);
+      }
+    catch (std::exception const&)
+      {
+      throw std::runtime_error("cannot read ruleset: " + filename);
+      }
+    }
+  Iterator const text_begin = size > 0 ? file.data() : "";
+  Iterator const text_end = text_begin + size;
 
-  BOOST_AUTO(comment
-    , ascii::space
+  BOOST_AUTO(comment, boost::proto::deep_copy(
+      ascii::space
     | boost::spirit::repository::confix("/*", "*/")[*(qi::char_ - "*/")]
     | boost::spirit::repository::confix("//", qi::eol)[*(qi::char_ - qi::eol)]
-    );
-  RepositoryGrammar<PosIterator, BOOST_TYPEOF(comment)> grammar;
+    ));
+  LineCounter lines(text_begin, text_end);
+  RepositoryGrammar<Iterator, BOOST_TYPEOF(comment)> grammar(lines);
   try
     {
-    qi::phrase_parse(begin, end, qi::eps > +grammar, comment, ast);
+    Iterator begin = text_begin;
+    qi::phrase_parse(begin, text_end, qi::eps > +grammar, comment, rules);
     }
-  catch (const qi::expectation_failure<PosIterator>& error)
+  catch (const qi::expectation_failure<Iterator>& error)
     {
-    typedef classic::file_position_base<std::string> Position;
-    const Position& pos = error.first.get_position();
+    int const column = lines.column(error.first);
     std::stringstream msg;
     msg << "parse error at file " << filename
-        << " line " << pos.line
-        << " column " << pos.column << std::endl
-        << "'" << error.first.get_currentline() << "'" << std::endl
-        << std::setw(pos.column) << " " << "^- here"
+        << " line " << lines.line(error.first)
+        << " column " << column << std::endl
+        << "'" << lines.current_line(error.first) << "'" << std::endl
+        << std::setw(column) << " " << "^- here"
       ;
     throw std::runtime_error(msg.str());
     }
+
+  // Semantic actions on the elements of a sequence don't reliably
+  // reach the elements that end up in the container, so the ref
+  // qualifiers are filled in here instead.
+  AST ast;
+  for (std::size_t i = 0; i < rules.size(); ++i)
+    {
+    set_git_ref_qualifiers(rules[i].branch_rules, "refs/heads/");
+    set_git_ref_qualifiers(rules[i].tag_rules, "refs/tags/");
+    ast.insert(rules[i]);
+    }
   return ast;
   }
 
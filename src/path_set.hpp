@@ -5,65 +5,242 @@
 # define PATH_SET_DWA2013615_HPP
 
 #include "path.hpp"
-#include <boost/algorithm/string/predicate.hpp>
+#include <boost/iterator/iterator_facade.hpp>
 #include <algorithm>
+#include <cstring>
+#include <memory>
+#include <string>
 #include <vector>
 
+// A set of paths in which no element is a subdirectory of another:
+// inserting a path that lies beneath an element has no effect, and
+// inserting a parent of some elements replaces them.
+//
+// The paths are stored as a tree of path components, so an insertion
+// costs O(depth) lookups rather than the O(n) shuffling of a sorted
+// vector.  Iteration visits the paths in order of their components,
+// which differs from the order of the paths as strings where a
+// component is a prefix of its sibling: "a/b" comes before "a-b".
 class path_set
 {
-    typedef std::vector<path> storage;
+    struct node
+    {
+        explicit node(std::string component = std::string())
+            : component(std::move(component)), member(false) {}
+
+        node(node const& rhs)
+            : component(rhs.component), member(rhs.member)
+        {
+            children.reserve(rhs.children.size());
+            for (auto const& child : rhs.children)
+                children.emplace_back(new node(*child));
+        }
+
+        node(node&&) = default;
+
+        node& operator=(node rhs)
+        {
+            component = std::move(rhs.component);
+            member = rhs.member;
+            children = std::move(rhs.children);
+            return *this;
+        }
+
+        std::string component;
+        bool member;                  // invariant: members have no children
+
+        // Sorted by component.  A vector of the incomplete node type
+        // itself isn't allowed in C++11.
+        std::vector<std::unique_ptr<node> > children;
+    };
+
+    struct component_less
+    {
+        bool operator()(
+            std::unique_ptr<node> const& n, std::pair<char const*, std::size_t> c) const
+        {
+            int const cmp = n->component.compare(0, n->component.size(), c.first, c.second);
+            return cmp < 0;
+        }
+    };
+
  public:
+    class const_iterator
+        : public boost::iterator_facade<
+              const_iterator, path const, boost::forward_traversal_tag>
+    {
+     public:
+        const_iterator() {}
 
-    path_set() {}
+     private:
+        friend class path_set;
+        friend class boost::iterator_core_access;
 
-    path_set(std::initializer_list<path> const& x)
-        : paths(x)
-    {}
+        struct frame
+        {
+            node const* n;
+            std::size_t next_child;
+            std::size_t text_size;    // of text, before n's component
+        };
 
-    void clear() { paths.clear(); }
+        explicit const_iterator(node const& root)
+        {
+            frame f = { &root, 0, 0 };
+            stack.push_back(f);
+            if (root.member)
+                current = path();
+            else
+                increment();
+        }
 
-    friend bool operator==(path_set const& lhs, path_set const& rhs)
-    { return lhs.paths == rhs.paths; }
+        // Move to the next member, depth first
+        void increment()
+        {
+            while (!stack.empty())
+            {
+                frame& f = stack.back();
+                if (f.next_child == f.n->children.size())
+                {
+                    text.resize(f.text_size);
+                    stack.pop_back();
+                    continue;
+                }
+
+                node const& child = *f.n->children[f.next_child++];
+                frame next = { &child, 0, text.size() };
+                stack.push_back(next);
+                if (next.text_size != 0)
+                    text += '/';
+                text += child.component;
+
+                if (child.member)
+                {
+                    current = path(text);
+                    return;
+                }
+            }
+        }
+
+        bool equal(const_iterator const& rhs) const
+        {
+            return stack.size() == rhs.stack.size()
+                && (stack.empty() || stack.back().n == rhs.stack.back().n);
+        }
+
+        path const& dereference() const { return current; }
 
-    typedef storage::value_type value_type;
-    typedef storage::const_iterator const_iterator;
+     private:
+        std::vector<frame> stack;
+        std::string text;
+        path current;
+    };
+
+    typedef path value_type;
     typedef const_iterator iterator;
 
-    std::size_t size() const { return paths.size(); }
-    const_iterator begin() const { return paths.begin(); }
-    const_iterator end() const { return paths.end(); }
+    path_set() : count(0) {}
+
+    path_set(std::initializer_list<path> const& x)
+        : count(0)
+    {
+        for (auto const& p : x)
+            insert(p);
+    }
 
-    const_iterator insert(const_iterator _, path p)
+    void clear()
     {
-        return insert(std::move(p));
+        root = node();
+        count = 0;
     }
 
-    const_iterator insert(path p)
+    friend bool operator==(path_set const& lhs, path_set const& rhs)
     {
-        auto start = std::lower_bound(paths.begin(), paths.end(), p);
+        return lhs.size() == rhs.size() && std::equal(lhs.begin(), lhs.end(), rhs.begin());
+    }
 
-        // See if a parent path is already in the set
-        if (start != paths.begin() && p.starts_with(*std::prev(start)))
-            return start;  // if so, we're done
+    std::size_t size() const { return count; }
+    const_iterator begin() const { return const_iterator(root); }
+    const_iterator end() const { return const_iterator(); }
 
-        // Find the range of paths in the set that p subsumes
-        auto finish = start;
-        while (finish != paths.end() && finish->starts_with(p))
-            ++finish;
+    // Returns true iff p or one of its parents is in the set
+    bool contains(path const& p) const
+    {
+        node const* n = &root;
+        char const* s = p.str().c_str();
+        char const* const finish = s + p.str().size();
 
-        if (start == finish)
+        while (!n->member)
         {
-            return paths.insert(start, p);
+            if (s == finish)
+                return false;
+
+            char const* const slash = static_cast<char const*>(
+                std::memchr(s, '/', finish - s));
+            char const* const end = slash ? slash : finish;
+            std::pair<char const*, std::size_t> const component(s, end - s);
+
+            auto pos = std::lower_bound(
+                n->children.begin(), n->children.end(), component, component_less());
+            if (pos == n->children.end() || (*pos)->component.compare(0, (*pos)->component.size(), s, end - s) != 0)
+                return false;
+
+            n = pos->get();
+            s = slash ? slash + 1 : finish;
         }
-        else if (*start != p) // don't bother if we already have the path
+        return true;
+    }
+
+    // Returns true iff p was added, i.e. it was not already in the
+    // set or beneath one of its elements
+    bool insert(path const& p)
+    {
+        node* n = &root;
+        char const* s = p.str().c_str();
+        char const* const finish = s + p.str().size();
+
+        while (s != finish)
         {
-            *start = std::move(p);
-            paths.erase(std::next(start), finish);
+            // If a parent path is already in the set, we're done
+            if (n->member)
+                return false;
+
+            char const* const slash = static_cast<char const*>(
+                std::memchr(s, '/', finish - s));
+            char const* const end = slash ? slash : finish;
+            std::pair<char const*, std::size_t> const component(s, end - s);
+
+            auto pos = std::lower_bound(
+                n->children.begin(), n->children.end(), component, component_less());
+            if (pos == n->children.end() || (*pos)->component.compare(0, (*pos)->component.size(), s, end - s) != 0)
+                pos = n->children.insert(pos, std::unique_ptr<node>(new node(std::string(s, end))));
+
+            n = pos->get();
+            s = slash ? slash + 1 : finish;
         }
-        return start;
+
+        if (n->member)
+            return false;
+
+        // p subsumes everything beneath it
+        count -= members(*n);
+        n->children.clear();
+        n->member = true;
+        ++count;
+        return true;
+    }
+
+ private:
+    static std::size_t members(node const& n)
+    {
+        std::size_t result = n.member ? 1 : 0;
+        for (auto const& child : n.children)
+            result += members(*child);
+        return result;
     }
+
  private:
-    storage paths;
+    node root;
+    std::size_t count;
 };
 
 #endif // PATH_SET_DWA2013615_HPP
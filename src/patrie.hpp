@@ -16,6 +16,9 @@
 # include <boost/range/iterator_range.hpp>
 # include <ostream>
 # include <climits>
+# include <algorithm>
+# include <iterator>
+# include <unordered_map>
 
 namespace patrie_ {
 //using boost::container::vector;
@@ -97,6 +100,12 @@ struct patrie
         }
     }
 
+    // Every rule, in the order inserted
+    std::deque<Rule> const& all_rules() const
+    {
+        return rules;
+    }
+
     template <class Range>
     Rule const* longest_match(Range const& r, std::size_t revision) const
     {
@@ -106,6 +115,60 @@ struct patrie
             coverage.match(*v.found_rule, revision);
         return v.found_rule;
     }
+
+    // Stores through out the longest_match of dir/name for each name
+    // in [first, last), the entries of directory dir.  The walk down
+    // to dir is done only once, and the walk beneath it is shared by
+    // consecutive names with a common prefix, so the names should be
+    // sorted.
+    template <class Range, class NameIterator, class OutputIterator>
+    OutputIterator longest_matches(
+        Range const& dir, NameIterator first, NameIterator last,
+        std::size_t revision, OutputIterator out) const
+    {
+        match_cursor base(this->trie, revision);
+        for (auto c : dir)
+            base.step(c, revision);
+        if (!boost::empty(dir))
+            base.step('/', revision);
+
+        // If nothing in the trie extends dir, all its entries match
+        // whatever dir did
+        if (base.n == nullptr)
+        {
+            if (base.found)
+                coverage.match(*base.found, revision);
+            return std::fill_n(out, std::distance(first, last), base.found);
+        }
+
+        // cursors[k] is the search state after the first k characters
+        // of the previous name
+        std::vector<match_cursor> cursors(1, base);
+        std::string previous;
+        for (; first != last; ++first)
+        {
+            auto s = boost::begin(*first), e = boost::end(*first);
+
+            std::size_t common = 0;
+            while (s != e && common < previous.size() && *s == previous[common])
+                ++s, ++common;
+            cursors.resize(common + 1, base);
+            previous.resize(common);
+
+            for (; s != e; ++s)
+            {
+                cursors.push_back(cursors.back());
+                cursors.back().step(*s, revision);
+                previous.push_back(*s);
+            }
+
+            Rule const* const found = cursors.back().finish(revision);
+            if (found)
+                coverage.match(*found, revision);
+            *out++ = found;
+        }
+        return out;
+    }
   
     template <class Range, class OutputIterator>
     void git_subtree_rules(Range const& git_address, std::size_t revision, OutputIterator out) const
@@ -121,6 +184,60 @@ struct patrie
         traverse(&this->rtrie, boost::begin(svn_path), boost::end(svn_path), v);
     }
   
+ public: // Serialization, for the ruleset cache
+    // save_rule(out, rule) writes a rule; load_rule(in) returns one.
+    // Pointers between the parts of the patrie are stored as indices
+    // into its rules.
+    template <class Writer, class SaveRule>
+    void save(Writer& out, SaveRule save_rule) const
+    {
+        std::unordered_map<Rule const*, std::size_t> ids;
+        out.integer(rules.size());
+        for (auto const& r : rules)
+        {
+            std::size_t const id = ids.size();
+            ids[&r] = id;
+            save_rule(out, r);
+        }
+
+        save_node(out, trie, ids);
+        save_node(out, rtrie, ids);
+
+        out.integer(transition_map.size());
+        for (auto const& t : transition_map)
+        {
+            out.integer(t.first);
+            save_rule_ids(out, t.second, ids);
+        }
+    }
+
+    // Must be called on an empty patrie
+    template <class Reader, class LoadRule>
+    void load(Reader& in, LoadRule load_rule)
+    {
+        assert(rules.empty());
+        std::vector<Rule const*> by_id;
+        for (std::size_t n = in.count(); n > 0; --n)
+        {
+            rules.push_back(load_rule(in));
+            by_id.push_back(&rules.back());
+        }
+
+        load_node(in, trie, by_id);
+        load_node(in, rtrie, by_id);
+
+        transition_map.resize(in.count());
+        for (auto& t : transition_map)
+        {
+            t.first = in.integer();
+            load_rule_ids(in, t.second, by_id);
+        }
+
+        // Only now that nothing can fail
+        for (auto const& r : rules)
+            coverage.declare(r);
+    }
+
  private:
     struct node
     {
@@ -252,6 +369,61 @@ struct patrie
         bool allow_overlap;
     };
 
+    // The state of a longest_match search part way through its input
+    struct match_cursor
+    {
+        match_cursor(node const& root, std::size_t revision)
+            : n(&root), matched(0), found(root.find_rule(revision)) {}
+
+        // Consume the next character of the input
+        void step(char c, std::size_t revision)
+        {
+            if (n == nullptr)
+                return;
+
+            if (matched < n->text.size())
+            {
+                if (n->text[matched] == c)
+                    ++matched;
+                else
+                    n = nullptr;
+                return;
+            }
+
+            // We matched all of n; record its rule if that happened
+            // on a directory boundary
+            if (c == '/')
+            {
+                if (auto r = n->find_rule(revision))
+                    found = r;
+            }
+
+            auto p = std::lower_bound(n->next.begin(), n->next.end(), c, node_comparator());
+            if (p == n->next.end() || p->text[0] != c)
+            {
+                n = nullptr;
+                return;
+            }
+            n = &*p;
+            matched = 1;
+        }
+
+        // The result once the input is exhausted
+        Rule const* finish(std::size_t revision) const
+        {
+            if (n != nullptr && matched == n->text.size())
+            {
+                if (auto r = n->find_rule(revision))
+                    return r;
+            }
+            return found;
+        }
+
+        node const* n;              // null once nothing can match
+        std::size_t matched;        // characters of n->text consumed
+        Rule const* found;
+    };
+
     struct search_visitor_base
     {
         search_visitor_base(std::size_t revision)
@@ -394,6 +566,51 @@ struct patrie
         }
     }
 
+ private: // Serialization support
+    template <class Writer>
+    static void save_rule_ids(
+        Writer& out, vector<Rule const*> const& v,
+        std::unordered_map<Rule const*, std::size_t> const& ids)
+    {
+        out.integer(v.size());
+        for (auto r : v)
+            out.integer(ids.find(r)->second);
+    }
+
+    template <class Reader>
+    static void load_rule_ids(Reader& in, vector<Rule const*>& v, std::vector<Rule const*> const& by_id)
+    {
+        v.resize(in.count());
+        for (auto& r : v)
+        {
+            std::size_t const id = in.integer();
+            if (id >= by_id.size())
+                throw std::runtime_error("rule index out of range");
+            r = by_id[id];
+        }
+    }
+
+    template <class Writer>
+    static void save_node(
+        Writer& out, node const& n, std::unordered_map<Rule const*, std::size_t> const& ids)
+    {
+        out.string(n.text);
+        save_rule_ids(out, n.rules, ids);
+        out.integer(n.next.size());
+        for (auto const& n1 : n.next)
+            save_node(out, n1, ids);
+    }
+
+    template <class Reader>
+    static void load_node(Reader& in, node& n, std::vector<Rule const*> const& by_id)
+    {
+        n.text = in.string();
+        load_rule_ids(in, n.rules, by_id);
+        n.next.resize(in.count());
+        for (auto& n1 : n.next)
+            load_node(in, n1, by_id);
+    }
+
  private: // data members
     std::deque<Rule> rules;
     node trie;
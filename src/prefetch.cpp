@@ -0,0 +1,90 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "prefetch.hpp"
+#include "fsfs.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+
+prefetcher::prefetcher(fsfs const& repo, long first, long last, unsigned depth)
+    : repo(repo),
+      last(last),
+      depth(std::max(depth, 1u)),
+      current(first - 1),
+      next(first),
+      stopping(false),
+      open_fd(-1),
+      thread(&prefetcher::run, this)
+{
+}
+
+prefetcher::~prefetcher()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_one();
+    thread.join();
+    if (open_fd >= 0)
+        ::close(open_fd);
+}
+
+void prefetcher::advance(long rev)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        current = rev;
+    }
+    wake.notify_one();
+}
+
+void prefetcher::run()
+{
+    try
+    {
+        for (;;)
+        {
+            long rev;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                // There's no point reading ahead what the importer
+                // has already reached
+                auto const wanted = [&]{ return std::max(next, current + 1); };
+                wake.wait(
+                    guard,
+                    [&]{ return stopping || wanted() <= std::min(last, current + depth); });
+                if (stopping)
+                    return;
+                rev = wanted();
+                next = rev + 1;
+            }
+
+            for (auto const& e : repo.read_ahead(rev))
+                advise(e.filename, e.offset, e.length);
+        }
+    }
+    catch (std::exception const&)
+    {
+        // The importer will report any real problem with the repository
+    }
+}
+
+void prefetcher::advise(std::string const& filename, std::uint64_t offset, std::uint64_t length)
+{
+    if (filename != open_filename)
+    {
+        if (open_fd >= 0)
+            ::close(open_fd);
+        open_filename = filename;
+        open_fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+        if (open_fd < 0)
+            throw std::runtime_error("cannot open " + filename + ": " + std::strerror(errno));
+    }
+    ::posix_fadvise(open_fd, offset, length, POSIX_FADV_WILLNEED);
+}
@@ -0,0 +1,54 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef PREFETCH_DWA2013729_HPP
+# define PREFETCH_DWA2013729_HPP
+
+# include <condition_variable>
+# include <cstdint>
+# include <mutex>
+# include <string>
+# include <thread>
+
+class fsfs;
+
+// Reads ahead of the conversion from a background thread, so that
+// the parts of an FSFS repository the next revisions need are already
+// in the page cache when the importer gets to them, whichever backend
+// it reads them with.  The kernel is asked (with posix_fadvise) to
+// read in each revision's data and properties, and the delta bases of
+// the texts it changes, for up to depth revisions ahead.
+//
+// Prefetching is only advice: any error stops it, without affecting
+// the conversion.
+class prefetcher
+{
+ public:
+    prefetcher(fsfs const& repo, long first, long last, unsigned depth);
+    ~prefetcher();
+
+    // The importer is about to read rev
+    void advance(long rev);
+
+ private:
+    void run();
+    void advise(std::string const& filename, std::uint64_t offset, std::uint64_t length);
+
+ private:
+    fsfs const& repo;
+    long const last;
+    long const depth;
+
+    std::mutex lock;
+    std::condition_variable wake;
+    long current;                       // the revision being imported
+    long next;                          // the next revision to read ahead
+    bool stopping;
+
+    std::string open_filename;          // the last file advised, kept open
+    int open_fd;
+
+    std::thread thread;                 // last, so it starts after the rest
+};
+
+#endif // PREFETCH_DWA2013729_HPP
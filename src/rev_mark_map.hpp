@@ -0,0 +1,181 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef REV_MARK_MAP_DWA2013702_HPP
+# define REV_MARK_MAP_DWA2013702_HPP
+
+# include <algorithm>
+# include <cassert>
+# include <cstdint>
+# include <utility>
+# include <vector>
+
+// An append-only map from SVN revision numbers to the fast-import
+// marks of the commits written for them in a single Git ref.
+//
+// Within a ref, both revisions and marks only ever increase, so
+// instead of storing 16-byte pairs we store each entry as a pair of
+// variable-length deltas from its predecessor.  Entries are grouped
+// into blocks; the first entry of each block is kept verbatim in a
+// sparse index so that lookups can binary-search the index and then
+// decode at most one block.
+class rev_mark_map
+{
+ public:
+    rev_mark_map()
+        : size_(0), last_rev(0), last_mark(0), last_offset(0)
+    {}
+
+    std::size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    // The most recently added (revision, mark) pair
+    std::pair<std::size_t, std::size_t> back() const
+    {
+        assert(!empty());
+        return std::make_pair(last_rev, last_mark);
+    }
+
+    void push_back(std::size_t rev, std::size_t mark)
+    {
+        assert(empty() || (rev > last_rev && mark >= last_mark));
+        assert(rev <= UINT32_MAX && mark <= UINT32_MAX);
+
+        if (size_ % block_size == 0)
+        {
+            block b = {
+                std::uint32_t(rev), std::uint32_t(mark), std::uint32_t(deltas.size())
+            };
+            index.push_back(b);
+            last_offset = deltas.size();
+        }
+        else
+        {
+            last_offset = deltas.size();
+            put_varint(rev - last_rev);
+            put_varint(mark - last_mark);
+        }
+        last_rev = rev;
+        last_mark = mark;
+        ++size_;
+    }
+
+    // Forget the most recently added entry
+    void pop_back()
+    {
+        assert(!empty());
+        if (--size_ % block_size == 0)
+        {
+            deltas.resize(index.back().offset);
+            index.pop_back();
+        }
+        else
+        {
+            deltas.resize(last_offset);
+        }
+
+        // Recover the new last entry by decoding its block
+        last_rev = last_mark = last_offset = 0;
+        if (!index.empty())
+        {
+            for_each_in_block(
+                index.size() - 1,
+                [this](std::size_t rev, std::size_t mark, std::size_t offset)
+                { last_rev = rev; last_mark = mark; last_offset = offset; });
+        }
+    }
+
+    // Return the mark recorded for the greatest revision not
+    // exceeding rev, or zero if there is no such revision.  Marks
+    // written by fast-import are always positive.
+    std::size_t mark_at_or_before(std::size_t rev) const
+    {
+        auto p = std::upper_bound(
+            index.begin(), index.end(), rev,
+            [](std::size_t rev, block const& b) { return rev < b.rev; });
+
+        if (p == index.begin())
+            return 0;
+
+        std::size_t result = 0;
+        for_each_in_block(
+            (p - index.begin()) - 1,
+            [&result, rev](std::size_t r, std::size_t mark, std::size_t)
+            { if (r <= rev) result = mark; });
+        return result;
+    }
+
+    // Call f(revision, mark) for each entry, in order
+    template <class F>
+    void for_each(F f) const
+    {
+        for (std::size_t b = 0; b < index.size(); ++b)
+        {
+            for_each_in_block(
+                b, [&f](std::size_t rev, std::size_t mark, std::size_t)
+                { f(rev, mark); });
+        }
+    }
+
+ private:
+    static std::size_t const block_size = 64;
+
+    struct block
+    {
+        std::uint32_t rev;
+        std::uint32_t mark;
+        std::uint32_t offset; // of the block's second entry in deltas
+    };
+
+    void put_varint(std::size_t x)
+    {
+        while (x >= 0x80)
+        {
+            deltas.push_back(static_cast<unsigned char>(x | 0x80));
+            x >>= 7;
+        }
+        deltas.push_back(static_cast<unsigned char>(x));
+    }
+
+    std::size_t get_varint(std::size_t& offset) const
+    {
+        std::size_t x = 0;
+        for (unsigned shift = 0;; shift += 7)
+        {
+            unsigned char byte = deltas[offset++];
+            x |= std::size_t(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+                return x;
+        }
+    }
+
+    // Call f(revision, mark, offset) for each entry in the bth
+    // block, where offset is the position of the entry's encoding.
+    template <class F>
+    void for_each_in_block(std::size_t b, F f) const
+    {
+        std::size_t rev = index[b].rev;
+        std::size_t mark = index[b].mark;
+        std::size_t offset = index[b].offset;
+        f(rev, mark, offset);
+
+        std::size_t n = std::min(std::size_t(block_size), size_ - b * block_size);
+        for (std::size_t i = 1; i < n; ++i)
+        {
+            std::size_t entry_offset = offset;
+            rev += get_varint(offset);
+            mark += get_varint(offset);
+            f(rev, mark, entry_offset);
+        }
+    }
+
+ private:
+    std::vector<block> index;
+    std::vector<unsigned char> deltas;
+    std::size_t size_;
+    std::size_t last_rev;
+    std::size_t last_mark;
+    std::size_t last_offset;
+};
+
+#endif // REV_MARK_MAP_DWA2013702_HPP
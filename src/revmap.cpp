@@ -0,0 +1,190 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "revmap.hpp"
+#include "mark_sha_map.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace revmap {
+
+static char const magic[8] = { 'S', 'V', 'N', '2', 'G', 'I', 'T', 'R' };
+
+template <class T>
+static void write_array(std::ofstream& out, T const* data, std::size_t count)
+{
+    out.write(reinterpret_cast<char const*>(data), count * sizeof(T));
+}
+
+void write(
+    std::string const& filename,
+    std::vector<std::string> const& ref_names,
+    std::vector<entry> entries)
+{
+    std::sort(
+        entries.begin(), entries.end(),
+        [](entry const& lhs, entry const& rhs)
+        {
+            return lhs.revnum != rhs.revnum ? lhs.revnum < rhs.revnum : lhs.ref < rhs.ref;
+        });
+
+    std::vector<std::uint32_t> sha_order(entries.size());
+    for (std::uint32_t i = 0; i < sha_order.size(); ++i)
+        sha_order[i] = i;
+    std::sort(
+        sha_order.begin(), sha_order.end(),
+        [&entries](std::uint32_t lhs, std::uint32_t rhs)
+        {
+            return std::memcmp(entries[lhs].sha, entries[rhs].sha, sha_size) < 0;
+        });
+
+    std::vector<std::uint32_t> ref_order(sha_order.size());
+    for (std::uint32_t i = 0; i < ref_order.size(); ++i)
+        ref_order[i] = i;
+    std::stable_sort(
+        ref_order.begin(), ref_order.end(),
+        [&entries](std::uint32_t lhs, std::uint32_t rhs)
+        {
+            return entries[lhs].ref < entries[rhs].ref;
+        });
+
+    std::vector<std::uint32_t> ref_starts(ref_names.size() + 1, 0);
+    for (auto const& e : entries)
+        ++ref_starts[e.ref + 1];
+    for (std::size_t ref = 1; ref < ref_starts.size(); ++ref)
+        ref_starts[ref] += ref_starts[ref - 1];
+
+    std::vector<std::uint32_t> ref_offsets;
+    std::string names;
+    for (auto const& name : ref_names)
+    {
+        ref_offsets.push_back(names.size());
+        names += name;
+        names += '\0';
+    }
+    // Keep the file size a multiple of four
+    names.resize((names.size() + 3) & ~std::size_t(3), '\0');
+
+    header hdr;
+    std::memcpy(hdr.magic, magic, sizeof(magic));
+    hdr.version = version;
+    hdr.byte_order = byte_order_mark;
+    hdr.entry_count = entries.size();
+    hdr.ref_count = ref_offsets.size();
+    hdr.names_size = names.size();
+    hdr.reserved = 0;
+
+    std::ofstream out(filename.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out)
+        throw std::runtime_error("cannot write revision map: " + filename);
+
+    write_array(out, &hdr, 1);
+    write_array(out, entries.data(), entries.size());
+    write_array(out, sha_order.data(), sha_order.size());
+    write_array(out, ref_order.data(), ref_order.size());
+    write_array(out, ref_starts.data(), ref_starts.size());
+    write_array(out, ref_offsets.data(), ref_offsets.size());
+    write_array(out, names.data(), names.size());
+
+    if (!out.flush())
+        throw std::runtime_error("error writing revision map: " + filename);
+}
+
+reader::reader(std::string const& filename)
+    : file(filename)
+{
+    if (file.size() < sizeof(header))
+        throw std::runtime_error("truncated revision map: " + filename);
+
+    hdr = reinterpret_cast<header const*>(file.data());
+    if (std::memcmp(hdr->magic, magic, sizeof(magic)) != 0)
+        throw std::runtime_error("not a revision map: " + filename);
+    if (hdr->byte_order != byte_order_mark || hdr->version != version)
+        throw std::runtime_error("incompatible revision map: " + filename);
+
+    std::size_t expected_size = sizeof(header)
+        + hdr->entry_count * (sizeof(entry) + 2 * sizeof(std::uint32_t))
+        + (2 * hdr->ref_count + 1) * sizeof(std::uint32_t)
+        + hdr->names_size;
+    if (file.size() != expected_size)
+        throw std::runtime_error("corrupt revision map: " + filename);
+
+    entries = reinterpret_cast<entry const*>(hdr + 1);
+    sha_order = reinterpret_cast<std::uint32_t const*>(entries + hdr->entry_count);
+    ref_order = sha_order + hdr->entry_count;
+    ref_starts = ref_order + hdr->entry_count;
+    ref_offsets = ref_starts + hdr->ref_count + 1;
+    names = reinterpret_cast<char const*>(ref_offsets + hdr->ref_count);
+}
+
+std::uint32_t reader::find_ref(std::string const& name) const
+{
+    for (std::uint32_t ref = 0; ref < hdr->ref_count; ++ref)
+    {
+        if (name == ref_name(ref))
+            return ref;
+    }
+    return hdr->ref_count;
+}
+
+reader::range reader::revision(std::size_t revnum) const
+{
+    struct by_revnum
+    {
+        bool operator()(entry const& e, std::size_t revnum) const { return e.revnum < revnum; }
+        bool operator()(std::size_t revnum, entry const& e) const { return revnum < e.revnum; }
+    };
+    return std::equal_range(entries, entries + hdr->entry_count, revnum, by_revnum());
+}
+
+entry const* reader::at_or_before(std::size_t revnum, std::uint32_t ref) const
+{
+    std::uint32_t const* first = ref_order + ref_starts[ref];
+    std::uint32_t const* last = ref_order + ref_starts[ref + 1];
+    std::uint32_t const* p = std::upper_bound(
+        first, last, revnum,
+        [this](std::size_t revnum, std::uint32_t i) { return revnum < entries[i].revnum; });
+    return p == first ? nullptr : entries + p[-1];
+}
+
+std::vector<entry const*> reader::find_sha(std::string const& hex_prefix) const
+{
+    std::vector<int> nibbles;
+    for (char c : hex_prefix)
+    {
+        int d = hex_digit(c);
+        if (d < 0 || nibbles.size() == 40)
+            throw std::runtime_error("invalid SHA prefix: " + hex_prefix);
+        nibbles.push_back(d);
+    }
+
+    // Compare the leading nibbles of an entry's SHA with the prefix
+    auto compare = [&](std::uint32_t i) -> int
+    {
+        unsigned char const* sha = entries[i].sha;
+        for (std::size_t n = 0; n < nibbles.size(); ++n)
+        {
+            int d = n % 2 ? sha[n / 2] & 0xF : sha[n / 2] >> 4;
+            if (d != nibbles[n])
+                return d < nibbles[n] ? -1 : 1;
+        }
+        return 0;
+    };
+
+    std::uint32_t const* first = std::lower_bound(
+        sha_order, sha_order + hdr->entry_count, 0,
+        [&](std::uint32_t i, int) { return compare(i) < 0; });
+    std::uint32_t const* last = std::upper_bound(
+        first, sha_order + hdr->entry_count, 0,
+        [&](int, std::uint32_t i) { return compare(i) > 0; });
+
+    std::vector<entry const*> result;
+    for (; first != last; ++first)
+        result.push_back(entries + *first);
+    return result;
+}
+
+} // namespace revmap
@@ -0,0 +1,95 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef REVMAP_DWA2013703_HPP
+# define REVMAP_DWA2013703_HPP
+
+# include <boost/iostreams/device/mapped_file.hpp>
+# include <cstdint>
+# include <string>
+# include <utility>
+# include <vector>
+
+// A per-repository index mapping SVN revisions to the Git commits
+// converted from them, and back.  The file is written once at the
+// end of a conversion and is meant to be memory-mapped by readers,
+// so every lookup is a binary search over data used in place.
+//
+// Layout, in the byte order of the machine that wrote it:
+//
+//   header
+//   entry[entry_count]         sorted by (revnum, ref)
+//   std::uint32_t[entry_count] entry numbers, sorted by entry SHA
+//   std::uint32_t[entry_count] entry numbers, sorted by (ref, revnum)
+//   std::uint32_t[ref_count+1] start of each ref's run in the above
+//   std::uint32_t[ref_count]   offsets of the ref names below
+//   char[names_size]           NUL-terminated ref names
+namespace revmap {
+
+std::uint32_t const version = 1;
+std::uint32_t const byte_order_mark = 0x01020304;
+
+struct header
+{
+    char magic[8];              // "SVN2GITR"
+    std::uint32_t version;
+    std::uint32_t byte_order;   // byte_order_mark
+    std::uint32_t entry_count;
+    std::uint32_t ref_count;
+    std::uint32_t names_size;
+    std::uint32_t reserved;
+};
+
+struct entry
+{
+    std::uint32_t revnum;
+    std::uint32_t ref;          // index into the ref name table
+    std::uint32_t mark;         // as written to git fast-import
+    unsigned char sha[20];
+};
+
+// Write an index of the given entries to filename.  Entries need
+// not be sorted.
+void write(
+    std::string const& filename,
+    std::vector<std::string> const& ref_names,
+    std::vector<entry> entries);
+
+class reader
+{
+ public:
+    typedef std::pair<entry const*, entry const*> range;
+
+    explicit reader(std::string const& filename);
+
+    std::size_t size() const { return hdr->entry_count; }
+    std::size_t ref_count() const { return hdr->ref_count; }
+    char const* ref_name(std::uint32_t ref) const { return names + ref_offsets[ref]; }
+
+    // Returns ref_count() if there is no ref with the given name
+    std::uint32_t find_ref(std::string const& name) const;
+
+    // The commits converted from exactly the given SVN revision
+    range revision(std::size_t revnum) const;
+
+    // The latest commit in ref converted from a revision not
+    // exceeding revnum, or null if there is none
+    entry const* at_or_before(std::size_t revnum, std::uint32_t ref) const;
+
+    // All commits whose SHA starts with the given hex prefix
+    std::vector<entry const*> find_sha(std::string const& hex_prefix) const;
+
+ private:
+    boost::iostreams::mapped_file_source file;
+    header const* hdr;
+    entry const* entries;
+    std::uint32_t const* sha_order;
+    std::uint32_t const* ref_order;
+    std::uint32_t const* ref_starts;
+    std::uint32_t const* ref_offsets;
+    char const* names;
+};
+
+} // namespace revmap
+
+#endif // REVMAP_DWA2013703_HPP
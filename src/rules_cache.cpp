@@ -0,0 +1,237 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "rules_cache.hpp"
+
+#include <boost/crc.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+using namespace boost2git;
+
+namespace {
+
+// Distinct from the revmap's "SVN2GITR", so neither file is mistaken
+// for the other
+char const cache_magic[8] = { 'S', '2', 'G', 'R', 'U', 'L', 'E', 'S' };
+
+// Bump this whenever the cache contents or the meaning of the rules
+// they were compiled from changes
+std::uint32_t const cache_version = 1;
+std::uint32_t const byte_order_mark = 0x01020304;
+
+struct cache_header
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byte_order;
+    std::uint64_t rules_size;   // of the rules file this was built from
+    std::uint32_t rules_crc;    // ditto
+    std::uint32_t crc;          // of the contents following the header
+    std::uint64_t size;         // ditto
+};
+
+std::uint32_t checksum(char const* data, std::size_t size)
+{
+    boost::crc_32_type crc;
+    crc.process_bytes(data, size);
+    return crc.checksum();
+}
+
+void fingerprint(std::string const& rules_file, std::uint64_t& size, std::uint32_t& crc)
+{
+    std::ifstream in(rules_file.c_str(), std::ios::binary);
+    if (!in)
+        throw std::runtime_error("cannot read ruleset: " + rules_file);
+    std::string const text(
+        (std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    size = text.size();
+    crc = checksum(text.data(), text.size());
+}
+
+void save_branches(rules_cache_writer& out, std::vector<BranchRule> const& branches)
+{
+    out.integer(branches.size());
+    for (auto const& b : branches)
+    {
+        out.integer(b.min);
+        out.integer(b.max);
+        out.string(b.svn_path.str());
+        out.string(b.git_branch_or_tag_name);
+        out.integer(b.line);
+    }
+}
+
+void load_branches(
+    rules_cache_reader& in, std::vector<BranchRule>& branches, char const* git_ref_qualifier)
+{
+    branches.resize(in.count());
+    for (auto& b : branches)
+    {
+        b.min = in.integer();
+        b.max = in.integer();
+        b.svn_path = in.string();
+        b.git_branch_or_tag_name = in.string();
+        b.line = int(in.integer());
+        b.git_ref_qualifier = git_ref_qualifier;
+    }
+}
+
+void save_strings(rules_cache_writer& out, std::vector<std::string> const& strings)
+{
+    out.integer(strings.size());
+    for (auto const& s : strings)
+        out.string(s);
+}
+
+void load_strings(rules_cache_reader& in, std::vector<std::string>& strings)
+{
+    strings.resize(in.count());
+    for (auto& s : strings)
+        s = in.string();
+}
+
+}
+
+void rules_cache_reader::malformed()
+{
+    throw std::runtime_error("malformed ruleset cache");
+}
+
+rules_cache_index::rules_cache_index(AST const& ast)
+{
+    for (auto const& repo : ast)
+    {
+        ids[&repo] = repos.size();
+        repos.push_back(&repo);
+        for (auto const& b : repo.branch_rules)
+        {
+            ids[&b] = branches.size();
+            branches.push_back(&b);
+        }
+        for (auto const& t : repo.tag_rules)
+        {
+            ids[&t] = branches.size();
+            branches.push_back(&t);
+        }
+        for (auto const& c : repo.content_rules)
+        {
+            ids[&c] = contents.size();
+            contents.push_back(&c);
+        }
+    }
+}
+
+void save_ast(rules_cache_writer& out, AST const& ast)
+{
+    out.integer(ast.size());
+    for (auto const& repo : ast)
+    {
+        out.integer(repo.is_abstract);
+        out.integer(repo.line);
+        out.string(repo.git_repo_name);
+        save_strings(out, repo.bases);
+        save_strings(out, repo.submodule_info);
+        out.integer(repo.minrev);
+        out.integer(repo.maxrev);
+
+        out.integer(repo.content_rules.size());
+        for (auto const& c : repo.content_rules)
+        {
+            out.string(c.svn_path.str());
+            out.string(c.git_path.str());
+            out.integer(c.line);
+        }
+        save_branches(out, repo.branch_rules);
+        save_branches(out, repo.tag_rules);
+    }
+}
+
+AST load_ast(rules_cache_reader& in)
+{
+    AST ast;
+    for (std::size_t n = in.count(); n > 0; --n)
+    {
+        RepoRule repo;
+        repo.is_abstract = in.integer() != 0;
+        repo.line = int(in.integer());
+        repo.git_repo_name = in.string();
+        load_strings(in, repo.bases);
+        load_strings(in, repo.submodule_info);
+        repo.minrev = in.integer();
+        repo.maxrev = in.integer();
+
+        repo.content_rules.resize(in.count());
+        for (auto& c : repo.content_rules)
+        {
+            c.svn_path = in.string();
+            c.git_path = in.string();
+            c.line = int(in.integer());
+        }
+        load_branches(in, repo.branch_rules, "refs/heads/");
+        load_branches(in, repo.tag_rules, "refs/tags/");
+
+        // Keep rules with the same name in their original order
+        ast.insert(ast.end(), std::move(repo));
+    }
+    return ast;
+}
+
+rules_cache_file::rules_cache_file(std::string const& cache_file, std::string const& rules_file)
+{
+    namespace fs = boost::filesystem;
+    if (!fs::exists(cache_file) || fs::file_size(cache_file) < sizeof(cache_header))
+        return;
+
+    std::uint64_t rules_size;
+    std::uint32_t rules_crc;
+    fingerprint(rules_file, rules_size, rules_crc);
+
+    file.open(cache_file);
+    cache_header const& hdr = *reinterpret_cast<cache_header const*>(file.data());
+    if (std::memcmp(hdr.magic, cache_magic, sizeof(cache_magic)) != 0
+        || hdr.version != cache_version
+        || hdr.byte_order != byte_order_mark
+        || hdr.rules_size != rules_size
+        || hdr.rules_crc != rules_crc
+        || file.size() != sizeof(cache_header) + hdr.size
+        || checksum(file.data() + sizeof(cache_header), hdr.size) != hdr.crc)
+    {
+        file.close();
+    }
+}
+
+rules_cache_reader rules_cache_file::contents() const
+{
+    char const* const start = file.data() + sizeof(cache_header);
+    return rules_cache_reader(start, file.data() + file.size());
+}
+
+void rules_cache_file::write(
+    std::string const& cache_file, std::string const& rules_file,
+    rules_cache_writer const& contents)
+{
+    cache_header hdr;
+    std::memcpy(hdr.magic, cache_magic, sizeof(cache_magic));
+    hdr.version = cache_version;
+    hdr.byte_order = byte_order_mark;
+    fingerprint(rules_file, hdr.rules_size, hdr.rules_crc);
+    hdr.crc = checksum(contents.data().data(), contents.data().size());
+    hdr.size = contents.data().size();
+
+    // Write to a temporary file and rename it into place, so that
+    // concurrent readers never see a partial cache.
+    std::string const tmp_file = cache_file + ".tmp";
+    {
+        std::ofstream out(tmp_file.c_str(), std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<char const*>(&hdr), sizeof(hdr));
+        out.write(contents.data().data(), contents.data().size());
+        if (!out.flush())
+            throw std::runtime_error("error writing ruleset cache " + tmp_file);
+    }
+    boost::filesystem::rename(tmp_file, cache_file);
+}
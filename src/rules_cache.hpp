@@ -0,0 +1,141 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef RULES_CACHE_DWA2013724_HPP
+# define RULES_CACHE_DWA2013724_HPP
+
+// A binary cache of a compiled ruleset, so that a run can start
+// without parsing the rules file or building the rule tries.  The
+// cache records the size and CRC of the rules file it was built from,
+// and is ignored once the rules file changes.
+
+# include "AST.hpp"
+# include <boost/iostreams/device/mapped_file.hpp>
+# include <cstdint>
+# include <string>
+# include <unordered_map>
+# include <vector>
+
+// Accumulates the contents of a cache file; integers are stored as
+// LEB128 varints, strings as a length followed by the characters.
+class rules_cache_writer
+{
+ public:
+    void integer(std::uint64_t x)
+    {
+        do
+        {
+            unsigned char byte = x & 0x7F;
+            x >>= 7;
+            buffer.push_back(char(x ? byte | 0x80 : byte));
+        }
+        while (x);
+    }
+
+    void string(std::string const& s)
+    {
+        integer(s.size());
+        buffer += s;
+    }
+
+    std::string const& data() const { return buffer; }
+
+ private:
+    std::string buffer;
+};
+
+// Reads what rules_cache_writer wrote, throwing on malformed input
+class rules_cache_reader
+{
+ public:
+    rules_cache_reader(char const* start, char const* finish)
+        : pos(start), finish(finish) {}
+
+    std::uint64_t integer()
+    {
+        std::uint64_t x = 0;
+        for (unsigned shift = 0; ; shift += 7)
+        {
+            if (pos == finish || shift > 63)
+                malformed();
+            unsigned char const byte = *pos++;
+            x |= std::uint64_t(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+                return x;
+        }
+    }
+
+    // The size of a sequence; each element takes at least a byte
+    std::size_t count()
+    {
+        std::uint64_t const n = integer();
+        if (n > std::uint64_t(finish - pos))
+            malformed();
+        return std::size_t(n);
+    }
+
+    std::string string()
+    {
+        std::uint64_t const size = integer();
+        if (size > std::uint64_t(finish - pos))
+            malformed();
+        std::string result(pos, pos + size);
+        pos += size;
+        return result;
+    }
+
+    bool at_end() const { return pos == finish; }
+
+    static void malformed();
+
+ private:
+    char const* pos;
+    char const* finish;
+};
+
+// Numbers the rules of an AST, so that pointers to them can be stored
+struct rules_cache_index
+{
+    explicit rules_cache_index(boost2git::AST const& ast);
+
+    std::vector<boost2git::RepoRule const*> repos;
+    std::vector<boost2git::BranchRule const*> branches; // including tags
+    std::vector<boost2git::ContentRule const*> contents;
+
+    std::unordered_map<void const*, std::size_t> ids;
+
+    std::size_t id(void const* rule) const { return ids.find(rule)->second; }
+
+    template <class T>
+    static T const* at(std::vector<T const*> const& v, std::uint64_t id)
+    {
+        if (id >= v.size())
+            rules_cache_reader::malformed();
+        return v[id];
+    }
+};
+
+void save_ast(rules_cache_writer& out, boost2git::AST const& ast);
+boost2git::AST load_ast(rules_cache_reader& in);
+
+// The cache file for a rules file, mapped into memory
+class rules_cache_file
+{
+ public:
+    // Map cache_file, if it exists and was built from the current
+    // contents of rules_file
+    rules_cache_file(std::string const& cache_file, std::string const& rules_file);
+
+    bool valid() const { return file.is_open(); }
+    rules_cache_reader contents() const;
+
+    // Replace cache_file with contents, built from rules_file
+    static void write(
+        std::string const& cache_file, std::string const& rules_file,
+        rules_cache_writer const& contents);
+
+ private:
+    boost::iostreams::mapped_file_source file;
+};
+
+#endif // RULES_CACHE_DWA2013724_HPP
@@ -17,6 +17,7 @@
 
 #include "ruleset.hpp"
 #include "to_string.hpp"
+#include "log.hpp"
 
 #include <boost/foreach.hpp>
 #include <string>
@@ -66,8 +67,26 @@ collect_rule_components(
   append_addresses(content, repo_rule.content_rules);
   }
 
-Ruleset::Ruleset(std::string const& filename)
-    : ast_(parse_rules_file(filename))
+Ruleset::Ruleset(std::string const& filename, std::string const& cache_file)
+  {
+  if (cache_file.empty() || !load_cache(filename, cache_file))
+    {
+    ast_ = parse_rules_file(filename);
+    build();
+
+    if (!cache_file.empty())
+      {
+      save_cache(filename, cache_file);
+      }
+    }
+
+  BOOST_FOREACH(Match const& rule, matcher_.all_rules())
+    {
+    git_index_.insert(&rule);
+    }
+  }
+
+void Ruleset::build()
   {
   BOOST_FOREACH(RepoRule const& repo_rule, ast_)
     {  
@@ -127,6 +146,93 @@ Ruleset::Ruleset(std::string const& filename)
     }
   }
 
+bool Ruleset::load_cache(std::string const& filename, std::string const& cache_file)
+  {
+  rules_cache_file cache(cache_file, filename);
+  if (!cache.valid())
+    {
+    LOG_INFO << "ruleset cache " << cache_file << " is missing or out of date" << std::endl;
+    return false;
+    }
+
+  try
+    {
+    rules_cache_reader in = cache.contents();
+    ast_ = load_ast(in);
+    rules_cache_index const index(ast_);
+
+    repositories_.resize(in.count());
+    BOOST_FOREACH(Repository& repo, repositories_)
+      {
+      repo.name = in.string();
+      repo.submodule_in_repo = in.string();
+      repo.submodule_path = in.string();
+      for (std::size_t n = in.count(); n > 0; --n)
+        {
+        repo.branches.insert(rules_cache_index::at(index.branches, in.integer()));
+        }
+      }
+
+    matcher_.load(
+        in,
+        [&index](rules_cache_reader& in)
+          {
+          RepoRule const* repo_rule = rules_cache_index::at(index.repos, in.integer());
+          BranchRule const* branch_rule = rules_cache_index::at(index.branches, in.integer());
+          std::uint64_t const content = in.integer();
+          return Match(
+              repo_rule, branch_rule,
+              content ? rules_cache_index::at(index.contents, content - 1) : 0);
+          });
+
+    if (!in.at_end())
+      {
+      rules_cache_reader::malformed();
+      }
+    return true;
+    }
+  catch (std::exception const& error)
+    {
+    LOG_WARN << "ignoring ruleset cache " << cache_file << ": " << error.what() << std::endl;
+    matcher_ = patrie<Rule,coverage>();
+    repositories_.clear();
+    ast_.clear();
+    return false;
+    }
+  }
+
+void Ruleset::save_cache(std::string const& filename, std::string const& cache_file) const
+  {
+  rules_cache_writer out;
+  save_ast(out, ast_);
+  rules_cache_index const index(ast_);
+
+  out.integer(repositories_.size());
+  BOOST_FOREACH(Repository const& repo, repositories_)
+    {
+    out.string(repo.name);
+    out.string(repo.submodule_in_repo);
+    out.string(repo.submodule_path);
+    out.integer(repo.branches.size());
+    BOOST_FOREACH(BranchRule const* branch_rule, repo.branches)
+      {
+      out.integer(index.id(branch_rule));
+      }
+    }
+
+  matcher_.save(
+      out,
+      [&index](rules_cache_writer& out, Match const& rule)
+        {
+        out.integer(index.id(rule.repo_rule));
+        out.integer(index.id(rule.branch_rule));
+        out.integer(rule.content_rule ? index.id(rule.content_rule) + 1 : 0);
+        });
+
+  rules_cache_file::write(cache_file, filename, out);
+  LOG_INFO << "wrote ruleset cache " << cache_file << std::endl;
+  }
+
 void report_overlap(Rule const* rule0, Rule const* rule1)
 {
     throw std::runtime_error(
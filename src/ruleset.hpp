@@ -23,9 +23,11 @@
 #include <vector>
 #include <boost/algorithm/string/predicate.hpp>
 #include "patrie.hpp"
+#include "git_subtree_index.hpp"
 #include "rule.hpp"
 #include "AST.hpp"
 #include "coverage.hpp"
+#include "rules_cache.hpp"
 
 boost2git::AST parse_rules_file(std::string filename);
 
@@ -42,12 +44,19 @@ class Ruleset
         std::set<boost2git::BranchRule const*> branches;
     };
  public:
-    Ruleset(std::string const& filename);
+    // If cache_file is given, load the compiled ruleset from it, or
+    // (re-)create it if it's missing or was built from another
+    // version of the rules file
+    Ruleset(std::string const& filename, std::string const& cache_file = std::string());
  public:
     patrie<Rule,coverage> const& matcher() const
     {
         return matcher_;
     }
+    git_subtree_index const& git_index() const
+    {
+        return git_index_;
+    }
     std::vector<Repository> const& repositories() const
     {
         return repositories_;
@@ -56,8 +65,13 @@ class Ruleset
     {
         return ast_;
     }
+ private:
+    void build();
+    bool load_cache(std::string const& filename, std::string const& cache_file);
+    void save_cache(std::string const& filename, std::string const& cache_file) const;
  private:
     patrie<Rule,coverage> matcher_;
+    git_subtree_index git_index_;
     std::vector<Repository> repositories_;
     boost2git::AST ast_;
 };
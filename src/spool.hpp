@@ -0,0 +1,71 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef SPOOL_DWA2013731_HPP
+# define SPOOL_DWA2013731_HPP
+
+// With --spool DIR, svn2git writes each repository's fast-import
+// stream to a gzip-compressed file, DIR/<repository>.fi.gz, instead
+// of to a git fast-import process, and svn2git-replay feeds the files
+// to fast-import later.  The decisions svn2git would otherwise make
+// from fast-import's responses are left to svn2git-replay, through
+// directives that fast-import itself ignores as comments:
+//
+//   #svn2git submodule <repository>
+//       First in the file: this repository is a submodule of the
+//       given one, so it must be replayed no later than that one.
+//
+//   #svn2git close <mark>
+//       In place of an "ls" of the open commit's root: end the
+//       commit, unless it leaves its ref's tree unchanged.  Then the
+//       ref is reset to the commit with the given mark (if not 0),
+//       which the dropped commit's mark is made to refer to.
+//
+//   #svn2git gitlink <mark> <repository> <path>
+//       A gitlink at path to the commit with the given mark in the
+//       given submodule, written as a placeholder for
+//       fix-submodule-refs, or a deletion of path if the commit's
+//       tree is empty.
+
+# include <cstring>
+# include <iomanip>
+# include <sstream>
+# include <string>
+
+namespace spool {
+
+char const suffix[] = ".fi.gz";
+
+char const submodule_directive[] = "#svn2git submodule ";
+char const close_directive[] = "#svn2git close ";
+char const gitlink_directive[] = "#svn2git gitlink ";
+
+inline std::string file_path(std::string const& spool_dir, std::string const& repo_name)
+{
+    return spool_dir + "/" + repo_name + suffix;
+}
+
+// The name of the repository spooled to filename, a path beneath
+// spool_dir (however many separators follow it) ending in suffix
+inline std::string repo_name(std::string const& spool_dir, std::string const& filename)
+{
+    std::string::size_type start = spool_dir.find_last_not_of('/');
+    start = start == std::string::npos ? 0 : start + 1;
+    start = filename.find_first_not_of('/', start);
+    std::size_t const finish = filename.size() - std::strlen(suffix);
+    return start == std::string::npos || start > finish
+        ? std::string() : filename.substr(start, finish - start);
+}
+
+// The 40-digit decimal placeholder that fix-submodule-refs replaces
+// with the SHA of the submodule commit with the given mark
+inline std::string gitlink_placeholder(std::size_t mark)
+{
+    std::ostringstream placeholder;
+    placeholder << std::setw(40) << std::setfill('0') << mark;
+    return placeholder.str();
+}
+
+}
+
+#endif // SPOOL_DWA2013731_HPP
@@ -0,0 +1,313 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "status.hpp"
+#include "importer.hpp"
+#include "log.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+std::string system_error(std::string const& what)
+{
+    return what + ": " + std::strerror(errno);
+}
+
+// Resident set size of this process in bytes, or 0 if unknown
+std::uint64_t resident_set_size()
+{
+    std::ifstream statm("/proc/self/statm");
+    std::uint64_t size = 0, resident = 0;
+    if (!(statm >> size >> resident))
+        return 0;
+    return resident * ::sysconf(_SC_PAGESIZE);
+}
+
+struct bytes
+{
+    explicit bytes(double n) : n(n) {}
+    double n;
+};
+
+std::ostream& operator<<(std::ostream& os, bytes b)
+{
+    static char const* const units[] = { "B", "KiB", "MiB", "GiB", "TiB" };
+    std::size_t unit = 0;
+    for (; b.n >= 1024 && unit + 1 < sizeof(units) / sizeof(*units); ++unit)
+        b.n /= 1024;
+    std::streamsize precision = os.precision(unit ? 1 : 0);
+    os << b.n << " " << units[unit];
+    os.precision(precision);
+    return os;
+}
+
+struct duration
+{
+    explicit duration(double seconds) : seconds(seconds) {}
+    double seconds;
+};
+
+std::ostream& operator<<(std::ostream& os, duration d)
+{
+    long s = long(d.seconds + 0.5);
+    if (s >= 3600)
+        os << s / 3600 << "h ";
+    if (s >= 60)
+        os << s / 60 % 60 << "m ";
+    return os << s % 60 << "s";
+}
+
+double seconds_between(std::chrono::steady_clock::time_point a, std::chrono::steady_clock::time_point b)
+{
+    return std::chrono::duration<double>(b - a).count();
+}
+
+}
+
+status_reporter::status_reporter(
+    importer const& imp, int first_revision, int last_revision,
+    std::string const& status_file, std::string const& socket_path,
+    unsigned interval)
+    : imp(imp),
+      first_revision(first_revision),
+      last_revision(last_revision),
+      status_file(status_file),
+      socket_path(socket_path),
+      interval(std::max(interval, 1u)),
+      recent_rate(0),
+      listen_fd(-1)
+{
+    start = previous = take_sample();
+    last_progress = start.time;
+
+    if (::pipe(wake_fds) != 0)
+        throw std::runtime_error(system_error("cannot create pipe for status reporter"));
+
+    if (!socket_path.empty())
+    {
+        sockaddr_un address;
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (socket_path.size() >= sizeof(address.sun_path))
+            throw std::runtime_error("status socket path too long: " + socket_path);
+        std::strcpy(address.sun_path, socket_path.c_str());
+
+        // Remove a socket left behind by an earlier run
+        ::unlink(socket_path.c_str());
+        listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd < 0
+            || ::bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+            || ::listen(listen_fd, 8) != 0)
+        {
+            throw std::runtime_error(system_error("cannot listen on status socket " + socket_path));
+        }
+        ::fcntl(listen_fd, F_SETFD, FD_CLOEXEC);
+    }
+    ::fcntl(wake_fds[0], F_SETFD, FD_CLOEXEC);
+    ::fcntl(wake_fds[1], F_SETFD, FD_CLOEXEC);
+
+    thread = std::thread(&status_reporter::run, this);
+}
+
+status_reporter::~status_reporter()
+{
+    // The thread uses this object, so we must wait for it.  If the
+    // wake byte can't be written, closing the pipe's write end wakes
+    // the thread's poll instead.
+    char c = 0;
+    ssize_t written;
+    do
+        written = ::write(wake_fds[1], &c, 1);
+    while (written < 0 && errno == EINTR);
+    if (written != 1)
+    {
+        ::close(wake_fds[1]);
+        wake_fds[1] = -1;
+    }
+    thread.join();
+
+    ::close(wake_fds[0]);
+    if (wake_fds[1] >= 0)
+        ::close(wake_fds[1]);
+    if (listen_fd >= 0)
+    {
+        ::close(listen_fd);
+        ::unlink(socket_path.c_str());
+    }
+}
+
+status_reporter::sample status_reporter::take_sample() const
+{
+    sample s;
+    s.time = clock::now();
+    s.revision = imp.completed_revision();
+    imp.for_each_repository(
+        [&s](std::string const& name, git_repository const& repo)
+        {
+            git_fast_import const& fast_import = repo.fast_import();
+            counters c = {
+                fast_import.bytes_written(), fast_import.commits_written(), fast_import.pending_bytes()
+            };
+            s.repositories[name] = c;
+        });
+    return s;
+}
+
+void status_reporter::run()
+{
+    clock::time_point next_write = clock::now();
+    std::string text;
+
+    for (;;)
+    {
+        clock::time_point now = clock::now();
+        if (now >= next_write)
+        {
+            sample current = take_sample();
+            // The first report comes right away; too soon to measure
+            double elapsed = seconds_between(previous.time, current.time);
+            if (elapsed >= interval.count() / 2.0)
+            {
+                double rate = (current.revision - previous.revision) / elapsed;
+                // Smooth the recent rate over about five intervals
+                recent_rate = recent_rate == 0 ? rate : 0.8 * recent_rate + 0.2 * rate;
+            }
+            if (current.revision != previous.revision)
+                last_progress = current.time;
+
+            text = report(current);
+            if (!status_file.empty())
+                write_status_file(text);
+            previous = std::move(current);
+            next_write = now + interval;
+        }
+
+        pollfd fds[2] = { { wake_fds[0], POLLIN, 0 }, { listen_fd, POLLIN, 0 } };
+        int timeout_ms = int(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                 next_write - clock::now()).count());
+        int n = ::poll(fds, listen_fd >= 0 ? 2 : 1, std::max(timeout_ms, 0));
+        if (n < 0 && errno != EINTR)
+        {
+            LOG_ERROR << system_error("status reporter poll failed") << std::endl;
+            return;
+        }
+        if (fds[0].revents)
+            return;
+        if (listen_fd >= 0 && fds[1].revents)
+            serve_client(text);
+    }
+}
+
+std::string status_reporter::report(sample const& now) const
+{
+    std::ostringstream os;
+    double const total_elapsed = seconds_between(start.time, now.time);
+    double const elapsed = seconds_between(previous.time, now.time);
+    auto rate = [](double amount, double seconds) { return seconds > 0 ? amount / seconds : 0.0; };
+
+    std::uint64_t bytes_total = 0, bytes_recent = 0, commits_total = 0, commits_recent = 0;
+    for (auto const& kv : now.repositories)
+    {
+        auto const& was = previous.repositories.find(kv.first)->second;
+        auto const& began = start.repositories.find(kv.first)->second;
+        bytes_total += kv.second.bytes - began.bytes;
+        bytes_recent += kv.second.bytes - was.bytes;
+        commits_total += kv.second.commits - began.commits;
+        commits_recent += kv.second.commits - was.commits;
+    }
+
+    int const done = now.revision - start.revision;
+    int const remaining = std::max(last_revision - std::max(now.revision, first_revision - 1), 0);
+
+    os << std::fixed << std::setprecision(1)
+       << "revision: " << now.revision;
+    if (last_revision > 0)
+        os << " of " << last_revision << " (" << remaining << " remaining)";
+    os << "\n"
+       << "elapsed: " << duration(total_elapsed) << "\n"
+       << "last progress: " << duration(seconds_between(last_progress, now.time)) << " ago\n"
+       << "revisions/s: " << rate(now.revision - previous.revision, elapsed)
+       << " recent, " << rate(done, total_elapsed) << " overall\n"
+       << "commits/s: " << rate(commits_recent, elapsed)
+       << " recent, " << rate(commits_total, total_elapsed) << " overall\n"
+       << "bytes/s: " << bytes(rate(bytes_recent, elapsed))
+       << " recent, " << bytes(rate(bytes_total, total_elapsed)) << " overall\n"
+       << "rss: " << bytes(resident_set_size()) << "\n";
+
+    // Revisions vary enormously in cost, so the estimate is based on
+    // the recent rate rather than the overall one.
+    if (last_revision <= 0)
+        os << "eta: unknown\n";
+    else if (remaining == 0)
+        os << "eta: done\n";
+    else if (recent_rate > 0)
+        os << "eta: " << duration(remaining / recent_rate) << "\n";
+    else
+        os << "eta: unknown\n";
+
+    for (auto const& kv : now.repositories)
+    {
+        auto const& was = previous.repositories.find(kv.first)->second;
+        auto const& began = start.repositories.find(kv.first)->second;
+
+        os << "repository " << kv.first << ":"
+           << " commits " << kv.second.commits
+           << ", " << rate(kv.second.commits - was.commits, elapsed) << " commits/s recent"
+           << ", " << rate(kv.second.commits - began.commits, total_elapsed) << " overall"
+           << "; bytes " << bytes(kv.second.bytes)
+           << ", " << bytes(rate(kv.second.bytes - was.bytes, elapsed)) << "/s recent"
+           << "; pending " << bytes(kv.second.pending) << "\n";
+    }
+    return os.str();
+}
+
+void status_reporter::write_status_file(std::string const& text) const
+{
+    // Replace the file atomically, so readers never see half a report
+    std::string const tmp_file = status_file + ".tmp";
+    {
+        std::ofstream out(tmp_file.c_str(), std::ios::trunc);
+        out << text;
+        if (!out.flush())
+        {
+            LOG_WARN << "cannot write status file " << tmp_file << std::endl;
+            return;
+        }
+    }
+    if (std::rename(tmp_file.c_str(), status_file.c_str()) != 0)
+        LOG_WARN << system_error("cannot rename status file to " + status_file) << std::endl;
+}
+
+void status_reporter::serve_client(std::string const& text) const
+{
+    int client = ::accept(listen_fd, nullptr, nullptr);
+    if (client < 0)
+        return;
+
+    // Clients just read the report; a client that doesn't must not
+    // hold up the reporter
+    ::fcntl(client, F_SETFL, O_NONBLOCK);
+    char const* p = text.data();
+    std::size_t left = text.size();
+    while (left > 0)
+    {
+        ssize_t n = ::send(client, p, left, MSG_NOSIGNAL);
+        if (n <= 0)
+            break;
+        p += n;
+        left -= n;
+    }
+    ::close(client);
+}
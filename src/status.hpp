@@ -0,0 +1,75 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef STATUS_DWA2013722_HPP
+# define STATUS_DWA2013722_HPP
+
+# include <atomic>
+# include <chrono>
+# include <cstdint>
+# include <map>
+# include <string>
+# include <thread>
+
+struct importer;
+
+// Reports the progress of a running conversion from a background
+// thread: throughput overall and per repository, bytes waiting in
+// each fast-import pipe, memory use, and an estimated time to
+// completion.  The report is rewritten to status_file every interval
+// seconds, and sent to every client connecting to the Unix-domain
+// socket at socket_path, who get the report of the latest interval.
+// Either may be empty.
+//
+// last_revision is 0 if it isn't known, as when reading a dump.  The
+// reporter must be destroyed before the importer.
+struct status_reporter
+{
+    status_reporter(
+        importer const& imp, int first_revision, int last_revision,
+        std::string const& status_file, std::string const& socket_path,
+        unsigned interval);
+    ~status_reporter();
+
+ private:
+    typedef std::chrono::steady_clock clock;
+
+    struct counters
+    {
+        std::uint64_t bytes;
+        std::uint64_t commits;
+        std::uint64_t pending;
+    };
+
+    struct sample
+    {
+        clock::time_point time;
+        int revision;
+        std::map<std::string, counters> repositories;
+    };
+
+    void run();
+    sample take_sample() const;
+    std::string report(sample const& now) const;
+    void write_status_file(std::string const& text) const;
+    void serve_client(std::string const& text) const;
+
+ private:
+    importer const& imp;
+    int const first_revision;
+    int const last_revision;
+    std::string const status_file;
+    std::string const socket_path;
+    std::chrono::seconds const interval;
+
+    sample start;            // when the reporter was created
+    sample previous;         // at the previous interval
+    double recent_rate;      // revisions per second, smoothed
+    clock::time_point last_progress;
+
+    int listen_fd;
+    int wake_fds[2];         // written to stop the thread
+    std::thread thread;
+};
+
+#endif // STATUS_DWA2013722_HPP
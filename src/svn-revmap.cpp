@@ -0,0 +1,112 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Query the SVN revision <=> Git commit index written by svn2git.
+//
+//   svn-revmap --map boost/revmap-boost r85000
+//   svn-revmap --map boost/revmap-boost --ref refs/heads/master r85000
+//   svn-revmap --map boost/revmap-boost 3f2a9c
+//
+// Each result is printed as "r<revision> <ref> <sha>".
+#include "revmap.hpp"
+#include "mark_sha_map.hpp"
+
+#include <boost/program_options.hpp>
+#include <cstdlib>
+#include <iostream>
+
+static void print(revmap::reader const& map, revmap::entry const& e)
+{
+    std::cout << "r" << e.revnum << " " << map.ref_name(e.ref) << " "
+              << sha_to_hex(e.sha) << "\n";
+}
+
+// Returns false if nothing was found
+static bool query(revmap::reader const& map, std::string const& q, std::string const& ref_name)
+{
+    bool found = false;
+    std::uint32_t ref = ref_name.empty() ? map.ref_count() : map.find_ref(ref_name);
+    if (!ref_name.empty() && ref == map.ref_count())
+        throw std::runtime_error("no such ref: " + ref_name);
+
+    if (q.size() > 1 && q[0] == 'r' && q.find_first_not_of("0123456789", 1) == std::string::npos)
+    {
+        std::size_t revnum = std::strtoul(q.c_str() + 1, nullptr, 10);
+        if (ref_name.empty())
+        {
+            auto range = map.revision(revnum);
+            for (auto p = range.first; p != range.second; ++p)
+            {
+                print(map, *p);
+                found = true;
+            }
+        }
+        // With a ref, report the commit holding the state of that
+        // ref as of the revision, even if it wasn't changed there.
+        else if (revmap::entry const* e = map.at_or_before(revnum, ref))
+        {
+            print(map, *e);
+            found = true;
+        }
+    }
+    else
+    {
+        for (revmap::entry const* e : map.find_sha(q))
+        {
+            if (ref_name.empty() || e->ref == ref)
+            {
+                print(map, *e);
+                found = true;
+            }
+        }
+    }
+    return found;
+}
+
+int main(int argc, char** argv)
+{
+    std::string map_file;
+    std::string ref_name;
+    std::vector<std::string> queries;
+
+    namespace po = boost::program_options;
+    po::options_description program_options("Allowed options");
+    program_options.add_options()
+        ("help,h", "produce help message")
+        ("map", po::value(&map_file)->value_name("FILENAME")->required(),
+         "revision map written by svn2git")
+        ("ref", po::value(&ref_name)->value_name("REF"),
+         "restrict results to the given ref, e.g. refs/heads/master")
+        ("query", po::value(&queries)->value_name("rREV|SHA"),
+         "SVN revision (r1234) or Git SHA prefix to look up")
+        ;
+    po::positional_options_description positional;
+    positional.add("query", -1);
+
+    try
+    {
+        po::variables_map variables;
+        store(po::command_line_parser(argc, argv)
+              .options(program_options)
+              .positional(positional)
+              .run(), variables);
+        if (variables.count("help"))
+        {
+            std::cout << program_options << std::endl;
+            return 0;
+        }
+        notify(variables);
+
+        revmap::reader map(map_file);
+        bool all_found = true;
+        for (auto const& q : queries)
+            all_found = query(map, q, ref_name) && all_found;
+        return all_found ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    catch (std::exception const& error)
+    {
+        std::cerr << error.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
@@ -30,19 +30,40 @@
 #include "svn_error.hpp"
 #include "apr_init.hpp"
 #include "apr_pool.hpp"
+#include "fsfs.hpp"
+#include "svn_dump.hpp"
 
+#include <apr_hash.h>
+#include <svn_io.h>
 #include <boost/date_time/posix_time/time_parsers.hpp>
 #include <boost/date_time/posix_time/posix_time_io.hpp>
+#include <algorithm>
+#include <cassert>
+#include <map>
 
 AprInit apr_init;
 AprPool svn::global_pool;
 
+// Each revision gets a pool of its own, holding its root and little
+// else; what it allocates to answer each query goes in a scratch pool
+// that is cleared and reused afterwards.  Few revisions are open at
+// once, and scratch pools are rarely nested, so few need keeping.
+static AprPoolRecycler revision_pools(svn::global_pool, 4);
+static AprPoolRecycler scratch_pools(svn::global_pool, 8);
+
+// The total number of directory entries cached
+static std::size_t const directory_entries = 1 << 20;
+
 svn::svn(
-    std::string const& repo_path,
-    std::string const& authors_file_path)
-    : repos(call(svn_repos_open, repo_path.c_str(), global_pool)),
-      fs(svn_repos_fs(repos)),
-      authors(authors_file_path)
+    std::string const& source,
+    std::string const& authors_file_path,
+    backend how)
+    : repos(how != libsvn ? nullptr : call(svn_repos_open, source.c_str(), global_pool)),
+      fs(how != libsvn ? nullptr : svn_repos_fs(repos)),
+      authors(authors_file_path),
+      native(how == native_fs ? new fsfs(source) : nullptr),
+      dump(how == dump_stream ? new svn_dump(source) : nullptr),
+      directories(directory_entries)
 {
 }
 
@@ -51,27 +72,58 @@ svn::~svn()
 
 int svn::latest_revision() const
 {
-    return call(svn_fs_youngest_rev, fs, global_pool);
+    if (native)
+        return native->youngest();
+    if (dump)
+        return dump->youngest();
+    return call(svn_fs_youngest_rev, fs, scratch_pools.acquire());
+}
+
+bool svn::has_revision(int revnum) const
+{
+    if (dump)
+        return dump->read_through(revnum);
+    return revnum <= latest_revision();
 }
 
-static std::string get_string(apr_hash_t *revprops, char const *key)
+static std::map<std::string, std::string> revision_properties(svn const& repo, int revnum)
 {
-    std::string result;
-    svn_string_t *str = (svn_string_t*) apr_hash_get(revprops, key, APR_HASH_KEY_STRING);
-    if (str && !svn_string_isempty(str))
+    if (repo.native)
+        return repo.native->revision_properties(revnum);
+    if (repo.dump)
+    {
+        if (!repo.dump->read_through(revnum))
+            throw std::runtime_error("the svn dump ends before r" + std::to_string(revnum));
+        return repo.dump->revision_properties(revnum);
+    }
+
+    AprPool scope = scratch_pools.acquire();
+    std::map<std::string, std::string> result;
+    apr_hash_t *revprops = svn::call(svn_fs_revision_proplist, repo.fs, revnum, scope);
+    for (apr_hash_index_t *i = apr_hash_first(scope, revprops); i; i = apr_hash_next(i))
     {
-        result.append(str->data, str->len);
+        char const* key;
+        svn_string_t* value;
+        apr_hash_this(i, (void const**)&key, nullptr, (void**)&value);
+        result[key].assign(value->data, value->len);
     }
     return result;
 }
 
+static std::string get_string(std::map<std::string, std::string> const& revprops, char const *key)
+{
+    auto const pos = revprops.find(key);
+    return pos == revprops.end() ? std::string() : pos->second;
+}
+
 svn::revision::revision(svn const& repo, int revnum)
-    : pool(svn::global_pool.make_subpool())
-    , fs_root(call(svn_fs_revision_root, repo.fs, revnum, pool))
+    : repo(repo)
+    , pool(revision_pools.acquire())
+    , fs_root(repo.fs ? call(svn_fs_revision_root, repo.fs, revnum, pool) : nullptr)
     , revnum(revnum)
     , epoch(0)
 {
-    apr_hash_t *revprops = call(svn_fs_revision_proplist, repo.fs, revnum, pool);
+    std::map<std::string, std::string> const revprops = revision_properties(repo, revnum);
 
     author = repo.authors[get_string(revprops, "svn:author")];
     if (author.empty())
@@ -91,3 +143,182 @@ svn::revision::revision(svn const& repo, int revnum)
     if (log_message.empty())
         log_message = "** empty log message **";
 }
+
+// Translate the changes reported by fsfs or svn_dump, whose kinds
+// are enumerated in the same order
+template <class Changes>
+static std::vector<svn::change> translate_changes(Changes const& changes)
+{
+    static svn_fs_path_change_kind_t const change_kinds[] = {
+        svn_fs_path_change_modify, svn_fs_path_change_add,
+        svn_fs_path_change_delete, svn_fs_path_change_replace
+    };
+    static svn_node_kind_t const node_kinds[] = {
+        svn_node_unknown, svn_node_file, svn_node_dir
+    };
+    std::vector<svn::change> result;
+    result.reserve(changes.size());
+    for (auto const& c : changes)
+    {
+        svn::change x = {
+            c.path, change_kinds[c.kind], node_kinds[c.node], c.text_mod,
+            true, c.copyfrom_rev, c.copyfrom_path
+        };
+        result.push_back(std::move(x));
+    }
+    return result;
+}
+
+// Likewise for the kinds of the nodes they find
+template <class Kind>
+static svn_node_kind_t translate_kind(Kind k)
+{
+    static svn_node_kind_t const kinds[] = { svn_node_none, svn_node_file, svn_node_dir };
+    return kinds[k];
+}
+
+std::vector<svn::change> svn::revision::changes() const
+{
+    if (repo.native)
+        return translate_changes(repo.native->changes(revnum));
+    if (repo.dump)
+        return translate_changes(repo.dump->changes(revnum));
+
+    std::vector<change> result;
+
+    AprPool scope = scratch_pools.acquire();
+    apr_hash_t *changes = call(svn_fs_paths_changed2, fs_root, scope);
+    for (apr_hash_index_t *i = apr_hash_first(scope, changes); i; i = apr_hash_next(i))
+    {
+        const char *svn_path = 0;
+        svn_fs_path_change2_t *c = 0;
+        apr_hash_this(i, (const void**) &svn_path, nullptr, (void**) &c);
+        // According to the APR docs, this means the hash entry was
+        // deleted, so it should never happen
+        assert(c != nullptr);
+
+        change x = {
+            svn_path, c->change_kind, c->node_kind, c->text_mod != 0,
+            c->copyfrom_known != 0, c->copyfrom_rev,
+            c->copyfrom_path ? c->copyfrom_path : ""
+        };
+        result.push_back(std::move(x));
+    }
+    return result;
+}
+
+svn_node_kind_t svn::revision::check_path(path const& svn_path) const
+{
+    auto const known = kinds.find(svn_path.str());
+    if (known != kinds.end())
+        return known->second;
+
+    svn_node_kind_t kind;
+    if (repo.native)
+        kind = translate_kind(repo.native->check_path(revnum, svn_path.str()));
+    else if (repo.dump)
+        kind = translate_kind(repo.dump->check_path(revnum, svn_path.str()));
+    else
+        kind = call(svn_fs_check_path, fs_root, svn_path.c_str(), scratch_pools.acquire());
+    kinds[svn_path.str()] = kind;
+    return kind;
+}
+
+template <class Entries>
+static std::shared_ptr<svn::directory const> translate_directory(Entries const& entries)
+{
+    auto result = std::make_shared<svn::directory>();
+    result->reserve(entries.size());
+    for (auto const& e : entries)
+    {
+        svn::dirent const d = { e.name, translate_kind(e.kind), e.id };
+        result->push_back(d);
+    }
+    return result;
+}
+
+std::shared_ptr<svn::directory const> svn::revision::list_directory(path const& svn_path) const
+{
+    if (repo.native)
+        return translate_directory(repo.native->list_directory(revnum, svn_path.str()));
+    if (repo.dump)
+        return translate_directory(repo.dump->list_directory(revnum, svn_path.str()));
+
+    AprPool scope = scratch_pools.acquire();
+    svn_fs_id_t const* id = call(svn_fs_node_id, fs_root, svn_path.c_str(), scope);
+    svn_string_t const* unparsed = svn_fs_unparse_id(id, scope);
+    std::string const key(unparsed->data, unparsed->len);
+    if (auto cached = repo.directories.find(key))
+        return cached;
+
+    apr_hash_t *entries = call(svn_fs_dir_entries, fs_root, svn_path.c_str(), scope);
+    auto result = std::make_shared<directory>();
+    result->reserve(apr_hash_count(entries));
+    for (apr_hash_index_t *i = apr_hash_first(scope, entries); i; i = apr_hash_next(i))
+    {
+        svn_fs_dirent_t* e;
+        apr_hash_this(i, nullptr, nullptr, (void**)&e);
+        svn_string_t const* id = svn_fs_unparse_id(e->id, scope);
+        dirent const d = { e->name, e->kind, std::string(id->data, id->len) };
+        result->push_back(d);
+    }
+    std::sort(
+        result->begin(), result->end(),
+        [](dirent const& x, dirent const& y) { return x.name < y.name; });
+
+    repo.directories.insert(key, result, result->size() + 1);
+    return result;
+}
+
+svn_filesize_t svn::revision::file_length(path const& svn_path) const
+{
+    if (repo.native)
+        return repo.native->file_length(revnum, svn_path.str());
+    if (repo.dump)
+        return repo.dump->file_length(revnum, svn_path.str());
+    return call(svn_fs_file_length, fs_root, svn_path.c_str(), scratch_pools.acquire());
+}
+
+extern "C"
+{
+    static svn_error_t *write_to_function(void *baton, const char *data, apr_size_t *len)
+    {
+        auto const& out = *static_cast<std::function<void(char const*, std::size_t)> const*>(baton);
+        try
+        {
+            out(data, *len);
+            return SVN_NO_ERROR;
+        }
+        catch(std::exception const& e)
+        {
+            return svn_error_createf(APR_EOF, SVN_NO_ERROR, "%s", e.what());
+        }
+        catch(...)
+        {
+            return svn_error_createf(APR_EOF, SVN_NO_ERROR, "unknown error");
+        }
+    }
+}
+
+void svn::revision::file_contents(
+    path const& svn_path, std::function<void(char const*, std::size_t)> const& out) const
+{
+    if (repo.native)
+    {
+        auto const contents = repo.native->file_contents(revnum, svn_path.str());
+        out(contents->data(), contents->size());
+        return;
+    }
+    if (repo.dump)
+    {
+        repo.dump->file_contents(revnum, svn_path.str(), out);
+        return;
+    }
+
+    AprPool scope = scratch_pools.acquire();
+    svn_stream_t* in_stream = call(svn_fs_file_contents, fs_root, svn_path.c_str(), scope);
+    svn_stream_t* out_stream = svn_stream_create(
+        const_cast<std::function<void(char const*, std::size_t)>*>(&out), scope);
+    svn_stream_set_write(out_stream, write_to_function);
+    check_svn(svn_stream_copy3(in_stream, out_stream, nullptr, nullptr, scope));
+}
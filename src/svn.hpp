@@ -21,24 +21,44 @@
 
 #include "apr_pool.hpp"
 #include "authors.hpp"
+#include "lru_cache.hpp"
+#include "path.hpp"
 #include "svn_error.hpp"
 
 #include <svn_fs.h>
 #include <svn_repos.h>
 
+#include <functional>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 class Authors;
+class fsfs;
+class svn_dump;
 
 class svn
 {
  public:
-    svn(std::string const& repo_path, 
-        std::string const& authors_file_path);
+    enum backend
+    {
+        libsvn,                         // a repository, read with libsvn_fs
+        native_fs,                      // an FSFS repository, read with our own reader
+        dump_stream                     // a dump file, or "-" for the standard input
+    };
+
+    svn(std::string const& source, 
+        std::string const& authors_file_path,
+        backend how = libsvn);
     ~svn();
 
+    // For a dump, the latest revision read so far
     int latest_revision() const;
 
+    // Whether revnum exists; for a dump, this reads through revnum
+    bool has_revision(int revnum) const;
+
     // Call an SVN function with proper error reporting
     template <class R, class...P, class...A>
     static R call(svn_error_t* (*f)(R*, P...), A const& ...args)
@@ -48,16 +68,59 @@ class svn
         return result;
     }
 
+    // A path changed in a revision
+    struct change
+    {
+        path svn_path;
+        svn_fs_path_change_kind_t change_kind;
+        svn_node_kind_t node_kind;
+        bool text_mod;
+        bool copyfrom_known;
+        svn_revnum_t copyfrom_rev;
+        std::string copyfrom_path;          // empty if not a copy
+    };
+
+    // An entry of a directory.  Entries with the same id, in any
+    // revisions, are the same node-revision, and so have the same
+    // contents.
+    struct dirent
+    {
+        std::string name;
+        svn_node_kind_t kind;
+        std::string id;
+    };
+    typedef std::vector<dirent> directory;      // sorted by name
+
     struct revision
     {
         revision(svn const& repo, int revnum);
 
+        std::vector<change> changes() const;
+        svn_node_kind_t check_path(path const& svn_path) const;
+
+        // The entries of a directory with their kinds.  With libsvn,
+        // listings are cached by node-revision id, so a directory
+        // that hasn't changed since it was last listed, in this
+        // revision or an earlier one, is not read again.
+        std::shared_ptr<directory const> list_directory(path const& svn_path) const;
+        svn_filesize_t file_length(path const& svn_path) const;
+
+        // Pass the contents of a file to out, in one or more pieces
+        void file_contents(
+            path const& svn_path, std::function<void(char const*, std::size_t)> const& out) const;
+
+        svn const& repo;
         AprPool pool;
-        svn_fs_root_t* fs_root;
+        svn_fs_root_t* fs_root;             // null unless using libsvn
         int revnum;
         std::string author;
         unsigned int epoch;
         std::string log_message;
+
+     private:
+        // The results of check_path, which is asked about the same
+        // paths by each pass over the trees to convert
+        mutable std::unordered_map<std::string, svn_node_kind_t> kinds;
     };
     
     revision operator[](int revnum) const
@@ -69,6 +132,11 @@ class svn
     svn_repos_t* repos;
     svn_fs_t* fs;
     Authors authors;
+    std::unique_ptr<fsfs> native;
+    std::unique_ptr<svn_dump> dump;
+
+ private:
+    mutable lru_cache<std::string, directory> directories;     // by node-revision id
 };
 
 #endif
@@ -0,0 +1,444 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Feed the fast-import streams spooled by "svn2git --spool DIR" to
+// git fast-import, for many repositories at once, and write each
+// repository's revmap as svn2git would have.  Run it where svn2git
+// would have written the repositories:
+//
+//   svn2git-replay --spool DIR
+//
+// The directives svn2git leaves in a spool are described in
+// spool.hpp.  Submodules are replayed no later than the repositories
+// containing them, whose gitlinks depend on them.
+#include "git_executable.hpp"
+#include "git_fast_import.hpp"
+#include "mark_sha_map.hpp"
+#include "marks_file_name.hpp"
+#include "object_pool.hpp"
+#include "options.hpp"
+#include "path.hpp"
+#include "revmap.hpp"
+#include "spool.hpp"
+
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/file.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/process.hpp>
+#include <boost/program_options.hpp>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+Options options;
+
+namespace {
+
+namespace fs = boost::filesystem;
+namespace iostreams = boost::iostreams;
+
+std::string const empty_tree_sha("4b825dc642cb6eb9a060e54bf8d69288fbee4904");
+
+std::mutex output_lock;
+
+// A repository to replay, and how far its replay has got, for the
+// replays of the repositories containing it
+struct spooled_repository
+{
+    spooled_repository() : depth(0), closed_mark(0), finished(false) {}
+
+    std::string name;                   // also the path of the Git repository
+    std::string filename;
+    std::string super_name;             // empty unless it is a submodule
+    std::size_t depth;                  // of submodule nesting
+    boost::uintmax_t size;
+
+    std::mutex lock;
+    std::condition_variable progress;
+    std::size_t closed_mark;            // of the last commit closed
+    bool finished;
+    std::map<std::size_t, bool> empty_trees;    // by the mark of each commit closed
+};
+
+typedef std::map<std::string, std::unique_ptr<spooled_repository> > repository_map;
+
+bool starts_with(std::string const& s, char const* prefix)
+{
+    return s.compare(0, std::strlen(prefix), prefix) == 0;
+}
+
+std::size_t parse_number(std::string const& s, std::size_t start = 0)
+{
+    if (start >= s.size() || s.find_first_not_of("0123456789", start) < s.find(' ', start))
+        throw std::runtime_error("expected a number in \"" + s + "\"");
+    return std::strtoul(s.c_str() + start, nullptr, 10);
+}
+
+void open_spool(iostreams::filtering_istream& in, std::string const& filename)
+{
+    in.push(iostreams::gzip_decompressor());
+    in.push(iostreams::file_source(filename, std::ios::binary));
+}
+
+// Find the spool files beneath dir, and read which repositories are
+// submodules of which
+repository_map find_spools(std::string const& dir)
+{
+    repository_map result;
+    std::size_t const suffix = std::strlen(spool::suffix);
+    for (fs::recursive_directory_iterator p(dir), end; p != end; ++p)
+    {
+        std::string const filename = p->path().string();
+        if (!fs::is_regular_file(p->status())
+            || filename.size() < suffix
+            || filename.compare(filename.size() - suffix, suffix, spool::suffix) != 0)
+        {
+            continue;
+        }
+
+        std::unique_ptr<spooled_repository> r(new spooled_repository);
+        r->name = spool::repo_name(dir, filename);
+        if (r->name.empty())
+            continue;
+        r->filename = filename;
+        r->size = fs::file_size(filename);
+
+        iostreams::filtering_istream in;
+        open_spool(in, filename);
+        std::string line;
+        if (std::getline(in, line) && starts_with(line, spool::submodule_directive))
+            r->super_name = line.substr(std::strlen(spool::submodule_directive));
+
+        std::string const name = r->name;
+        result[name] = std::move(r);
+    }
+
+    for (auto& kv : result)
+    {
+        std::size_t depth = 0;
+        for (std::string super = kv.second->super_name; !super.empty(); ++depth)
+        {
+            auto const pos = result.find(super);
+            if (pos == result.end() || depth > result.size())
+                break;
+            super = pos->second->super_name;
+        }
+        kv.second->depth = depth;
+    }
+    return result;
+}
+
+void ensure_repository(std::string const& git_dir)
+{
+    namespace process = boost::process;
+    using namespace process::initializers;
+
+    if (!fs::exists(git_dir))
+    {
+        fs::create_directories(git_dir);
+        std::array<std::string, 4> const git_args = { git_executable(), "init", "--bare", "--quiet" };
+        auto git_init = process::execute(
+            run_exe(git_executable()), set_args(git_args), start_in_dir(git_dir), throw_on_error());
+        process::wait_for_exit(git_init);
+    }
+
+    if (!options.object_pool.empty())
+        object_pool::share(options.object_pool, git_dir);
+}
+
+// Replays one spool
+class replay
+{
+ public:
+    replay(spooled_repository& repo, repository_map const& repositories)
+        : repo(repo), repositories(repositories), fast_import(repo.name), revnum(0), mark(0)
+    {}
+
+    void run()
+    {
+        iostreams::filtering_istream in;
+        open_spool(in, repo.filename);
+
+        std::string line;
+        std::vector<char> buffer(1 << 16);
+        while (std::getline(in, line))
+        {
+            if (starts_with(line, spool::close_directive))
+            {
+                close_commit(parse_number(line, std::strlen(spool::close_directive)));
+                continue;
+            }
+            if (starts_with(line, spool::gitlink_directive))
+            {
+                write_gitlink(line.substr(std::strlen(spool::gitlink_directive)));
+                continue;
+            }
+            if (starts_with(line, spool::submodule_directive))
+                continue;
+
+            fast_import.write_raw(line.data(), line.size()) << LF;
+
+            if (starts_with(line, "data "))
+            {
+                for (std::size_t n = parse_number(line, 5); n > 0;)
+                {
+                    std::size_t const chunk = std::min(n, buffer.size());
+                    if (!in.read(buffer.data(), chunk))
+                        throw std::runtime_error("unexpected end of " + repo.filename + " in data");
+                    fast_import.write_raw(buffer.data(), chunk);
+                    n -= chunk;
+                }
+            }
+            else if (starts_with(line, "# SVN revision "))
+            {
+                revnum = parse_number(line, 15);
+            }
+            else if (starts_with(line, "commit "))
+            {
+                ref = line.substr(7);
+            }
+            else if (starts_with(line, "mark :"))
+            {
+                mark = parse_number(line, 6);
+                commits[ref].push_back(std::make_pair(revnum, mark));
+            }
+        }
+        if (!in.eof())
+            throw std::runtime_error("error reading " + repo.filename);
+
+        fast_import.wait();
+        write_revmap();
+
+        // Replays started after this one find its objects in the pool
+        if (!options.object_pool.empty())
+            object_pool::move_packs(options.object_pool, repo.name);
+    }
+
+ private:
+    // End the open commit, or drop it if its tree is unchanged
+    void close_commit(std::size_t previous_mark)
+    {
+        fast_import.send_ls("\"\"");
+        std::string const response = fast_import.readline();
+        if (response.size() < 41 || response.back() != '\t')
+        {
+            throw std::runtime_error(
+                "unrecognized response \"" + response + "\" from ls in ref " + ref);
+        }
+        std::string const tree = response.substr(response.size() - 41, 40);
+
+        std::string& head_tree = head_trees[ref];
+        if (tree == head_tree && previous_mark != 0)
+        {
+            // Later references to the dropped commit's mark, from
+            // this repository or (through fix-submodule-refs) from
+            // others, get the previous commit
+            fast_import.reset(ref, previous_mark);
+            fast_import << "alias" << LF
+                        << "mark :" << mark << LF
+                        << "to :" << previous_mark << LF << LF;
+            commits[ref].pop_back();
+        }
+        else
+        {
+            fast_import << LF;
+        }
+        head_tree = tree;
+
+        {
+            std::lock_guard<std::mutex> guard(repo.lock);
+            repo.empty_trees[mark] = tree == empty_tree_sha;
+            repo.closed_mark = mark;
+        }
+        repo.progress.notify_all();
+    }
+
+    // "<mark> <repository> <path>"
+    void write_gitlink(std::string const& args)
+    {
+        std::size_t const space1 = args.find(' ');
+        std::size_t const space2 = args.find(' ', space1 + 1);
+        if (space1 == std::string::npos || space2 == std::string::npos)
+            throw std::runtime_error("malformed gitlink directive: " + args);
+        std::size_t const sub_mark = parse_number(args);
+        std::string const sub_name = args.substr(space1 + 1, space2 - space1 - 1);
+        path const gitlink_path(args.substr(space2 + 1));
+
+        auto const pos = repositories.find(sub_name);
+        if (pos == repositories.end())
+            throw std::runtime_error("no spool for submodule " + sub_name);
+        spooled_repository& sub = *pos->second;
+
+        bool empty;
+        {
+            std::unique_lock<std::mutex> guard(sub.lock);
+            sub.progress.wait(guard, [&]{ return sub.finished || sub.closed_mark >= sub_mark; });
+            auto const tree = sub.empty_trees.find(sub_mark);
+            if (tree == sub.empty_trees.end())
+                throw std::runtime_error("no commit :" + std::to_string(sub_mark) + " in " + sub_name);
+            empty = tree->second;
+        }
+
+        // An empty submodule tree means the submodule's ref was deleted
+        if (empty)
+            fast_import.filedelete(gitlink_path);
+        else
+            fast_import.filemodify_gitlink(gitlink_path, spool::gitlink_placeholder(sub_mark));
+    }
+
+    void write_revmap()
+    {
+        mark_sha_map shas;
+        shas.load(marks_file_path(repo.name));
+
+        std::vector<std::string> ref_names;
+        std::vector<revmap::entry> entries;
+        for (auto const& kv : commits)
+        {
+            std::uint32_t const ref_id = ref_names.size();
+            ref_names.push_back(kv.first);
+            for (auto const& rev_mark : kv.second)
+            {
+                unsigned char const* sha = shas.find(rev_mark.second);
+                if (sha == nullptr)
+                {
+                    throw std::runtime_error(
+                        "no SHA for mark :" + std::to_string(rev_mark.second) + " in ref " + kv.first);
+                }
+                revmap::entry e = {
+                    std::uint32_t(rev_mark.first), ref_id, std::uint32_t(rev_mark.second), {}
+                };
+                std::copy(sha, sha + sha_size, e.sha);
+                entries.push_back(e);
+            }
+        }
+        revmap::write(revmap_file_path(repo.name), ref_names, std::move(entries));
+    }
+
+ private:
+    spooled_repository& repo;
+    repository_map const& repositories;
+    git_fast_import fast_import;
+
+    std::size_t revnum;                 // of the commit being read
+    std::string ref;
+    std::size_t mark;
+
+    std::map<std::string, std::string> head_trees;      // by ref
+    std::map<std::string, std::vector<std::pair<std::size_t, std::size_t> > > commits;
+};
+
+// Replay every spool, running up to jobs replays at once (all of them
+// if jobs is 0).  Submodules are started before the repositories
+// containing them, so a replay only ever waits for one that has
+// started; otherwise the largest spools go first.
+bool replay_all(repository_map& repositories, unsigned jobs)
+{
+    std::vector<spooled_repository*> order;
+    for (auto& kv : repositories)
+        order.push_back(kv.second.get());
+    std::stable_sort(
+        order.begin(), order.end(),
+        [](spooled_repository const* lhs, spooled_repository const* rhs)
+        {
+            return lhs->depth != rhs->depth ? lhs->depth > rhs->depth : lhs->size > rhs->size;
+        });
+
+    std::atomic<std::size_t> next_job(0);
+    std::atomic<bool> failed(false);
+
+    auto worker = [&]
+    {
+        for (std::size_t i; (i = next_job++) < order.size();)
+        {
+            spooled_repository& repo = *order[i];
+            {
+                std::lock_guard<std::mutex> guard(output_lock);
+                std::cerr << "replaying " << repo.name << std::endl;
+            }
+            try
+            {
+                ensure_repository(repo.name);
+                replay(repo, repositories).run();
+            }
+            catch (std::exception const& error)
+            {
+                std::lock_guard<std::mutex> guard(output_lock);
+                std::cerr << repo.name << ": " << error.what() << std::endl;
+                failed = true;
+            }
+            {
+                std::lock_guard<std::mutex> guard(repo.lock);
+                repo.finished = true;
+            }
+            repo.progress.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    std::size_t const thread_count = jobs == 0 ? order.size() : std::min<std::size_t>(jobs, order.size());
+    for (std::size_t i = 0; i < thread_count; ++i)
+        threads.push_back(std::thread(worker));
+    for (auto& t : threads)
+        t.join();
+
+    return !failed;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    namespace po = boost::program_options;
+    std::string spool_dir;
+    unsigned jobs = 0;
+
+    po::options_description program_options("Allowed options");
+    program_options.add_options()
+        ("help,h", "produce help message")
+        ("spool", po::value(&spool_dir)->value_name("DIR")->required(), "directory of the spool files written by svn2git --spool")
+        ("jobs,j", po::value(&jobs)->value_name("NUMBER")->default_value(0), "number of repositories to replay at once; 0 for all of them")
+        ("object-pool", po::value(&options.object_pool)->value_name("DIR"), "keep the objects of all repositories in one bare repository DIR, as with svn2git --object-pool; a replay shares the objects of those finished before it started")
+        ("git", po::value(&options.git_executable)->value_name("PATH"), "Git executable to use")
+        ;
+
+    try
+    {
+        po::variables_map variables;
+        store(po::command_line_parser(argc, argv).options(program_options).run(), variables);
+        if (variables.count("help"))
+        {
+            std::cout << program_options << std::endl;
+            return EXIT_SUCCESS;
+        }
+        notify(variables);
+
+        repository_map repositories = find_spools(spool_dir);
+        if (repositories.empty())
+            throw std::runtime_error("no spool files in " + spool_dir);
+
+        // A write to a fast-import that died should fail that
+        // replay only
+        ::signal(SIGPIPE, SIG_IGN);
+        return replay_all(repositories, jobs) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    catch (std::exception const& error)
+    {
+        std::cerr << error.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,678 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "svn_dump.hpp"
+#include "svndiff.hpp"
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/iostreams/device/file_descriptor.hpp>
+#include <boost/iostreams/filter/bzip2.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/stream.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace iostreams = boost::iostreams;
+
+namespace {
+
+// Directories' entries are kept in sorted chunks of at most this
+// many, so that changing one entry copies only its chunk
+std::size_t const max_chunk_entries = 64;
+
+std::size_t const read_buffer_size = 1 << 16;
+
+void malformed(std::string const& what)
+{
+    throw std::runtime_error("malformed svn dump: " + what);
+}
+
+std::uint64_t to_uint(std::string const& s)
+{
+    if (s.empty() || s.find_first_not_of("0123456789") != std::string::npos)
+        malformed("expected a number, got \"" + s + "\"");
+    return std::strtoull(s.c_str(), nullptr, 10);
+}
+
+std::string get(std::map<std::string, std::string> const& h, char const* key)
+{
+    auto const pos = h.find(key);
+    return pos == h.end() ? std::string() : pos->second;
+}
+
+std::uint64_t get_uint(std::map<std::string, std::string> const& h, char const* key)
+{
+    auto const pos = h.find(key);
+    return pos == h.end() ? 0 : to_uint(pos->second);
+}
+
+std::string strip_slashes(std::string const& p)
+{
+    std::string::size_type const first = p.find_first_not_of('/');
+    if (first == std::string::npos)
+        return std::string();
+    return p.substr(first, p.find_last_not_of('/') + 1 - first);
+}
+
+// Call f with each component of p, ignoring extra slashes
+template <class F>
+void for_each_component(std::string const& p, F f)
+{
+    std::string::size_type start = 0;
+    while (start < p.size())
+    {
+        std::string::size_type end = p.find('/', start);
+        if (end == std::string::npos)
+            end = p.size();
+        if (end != start)
+            f(p.substr(start, end - start));
+        start = end + 1;
+    }
+}
+
+// Parse a property block ("K <len>\n<key>\nV <len>\n<value>\n"...
+// "PROPS-END\n"), calling f with each key and value.  In property
+// deltas, "D <len>\n<key>\n" deletes a property, which we don't need.
+template <class F>
+void parse_props(std::string const& props, F f)
+{
+    std::string::size_type pos = 0;
+    auto line = [&]() -> std::string
+    {
+        std::string::size_type const nl = props.find('\n', pos);
+        if (nl == std::string::npos)
+            malformed("unterminated property line");
+        std::string result = props.substr(pos, nl - pos);
+        pos = nl + 1;
+        return result;
+    };
+    auto field = [&](std::string const& header) -> std::string
+    {
+        std::uint64_t const n = to_uint(header.substr(2));
+        if (pos + n + 1 > props.size() || props[pos + n] != '\n')
+            malformed("bad property data");
+        std::string result = props.substr(pos, n);
+        pos += n + 1;
+        return result;
+    };
+
+    while (pos < props.size())
+    {
+        std::string const header = line();
+        if (header == "PROPS-END")
+            return;
+        if (header.size() < 3 || header[1] != ' ')
+            malformed("bad property line \"" + header + "\"");
+        if (header[0] == 'D')
+        {
+            field(header);
+            continue;
+        }
+        if (header[0] != 'K')
+            malformed("bad property line \"" + header + "\"");
+        std::string const key = field(header);
+        std::string const vheader = line();
+        if (vheader.size() < 3 || vheader[0] != 'V' || vheader[1] != ' ')
+            malformed("bad property line \"" + vheader + "\"");
+        f(key, field(vheader));
+    }
+    malformed("property block without PROPS-END");
+}
+
+}
+
+struct svn_dump::node
+{
+    struct entry
+    {
+        std::string name;
+        node_ptr child;
+    };
+
+    struct chunk
+    {
+        long rev;                       // the revision that made it
+        std::vector<entry> entries;     // sorted by name
+    };
+
+    node(long rev, node_kind kind) : rev(rev), kind(kind), text(nullptr) {}
+
+    // The copy of n to be changed in rev
+    node(node const& n, long rev) : rev(rev), kind(n.kind), text(n.text), chunks(n.chunks) {}
+
+    node_ptr find(std::string const& name) const
+    {
+        auto const c = chunk_for(name);
+        if (c == chunks.end())
+            return node_ptr();
+        auto const& entries = (*c)->entries;
+        auto const e = std::lower_bound(entries.begin(), entries.end(), name, entry_less());
+        return e != entries.end() && e->name == name ? e->child : node_ptr();
+    }
+
+    // Only for nodes made in rev, as are the following
+    void set(std::string const& name, node_ptr child)
+    {
+        if (chunks.empty())
+        {
+            chunks.push_back(std::make_shared<chunk>(chunk{rev, std::vector<entry>(1, entry{name, child})}));
+            return;
+        }
+        auto c = chunk_for(name);
+        if (c == chunks.end())
+            --c;
+        auto& entries = own(c).entries;
+        auto const e = std::lower_bound(entries.begin(), entries.end(), name, entry_less());
+        if (e != entries.end() && e->name == name)
+        {
+            e->child = std::move(child);
+            return;
+        }
+        entries.insert(e, entry{name, std::move(child)});
+
+        if (entries.size() > max_chunk_entries)
+        {
+            std::size_t const half = entries.size() / 2;
+            auto upper = std::make_shared<chunk>(
+                chunk{rev, std::vector<entry>(entries.begin() + half, entries.end())});
+            entries.erase(entries.begin() + half, entries.end());
+            chunks.insert(c + 1, std::move(upper));
+        }
+    }
+
+    bool erase(std::string const& name)
+    {
+        auto const c = chunk_for(name);
+        if (c == chunks.end())
+            return false;
+        auto const& found = (*c)->entries;
+        auto e = std::lower_bound(found.begin(), found.end(), name, entry_less());
+        if (e == found.end() || e->name != name)
+            return false;
+
+        std::size_t const index = e - found.begin();
+        auto& entries = own(c).entries;
+        entries.erase(entries.begin() + index);
+        if (entries.empty())
+            chunks.erase(c);
+        return true;
+    }
+
+    // Nodes are shared between revisions until they change, so a
+    // node's address identifies it
+    std::vector<dirent> list() const
+    {
+        std::vector<dirent> result;
+        for (auto const& c : chunks)
+        {
+            for (auto const& e : c->entries)
+            {
+                dirent const d = {
+                    e.name, e.child->kind,
+                    std::to_string(reinterpret_cast<std::uintptr_t>(e.child.get()))
+                };
+                result.push_back(d);
+            }
+        }
+        return result;
+    }
+
+    long rev;                           // the revision that made it
+    node_kind kind;
+    content const* text;                // for files
+    std::vector<std::shared_ptr<chunk> > chunks;     // for directories
+
+ private:
+    struct entry_less
+    {
+        bool operator()(entry const& e, std::string const& name) const { return e.name < name; }
+    };
+
+    // The first chunk that could hold name
+    std::vector<std::shared_ptr<chunk> >::const_iterator chunk_for(std::string const& name) const
+    {
+        return std::lower_bound(
+            chunks.begin(), chunks.end(), name,
+            [](std::shared_ptr<chunk> const& c, std::string const& name)
+            { return c->entries.back().name < name; });
+    }
+
+    std::vector<std::shared_ptr<chunk> >::iterator chunk_for(std::string const& name)
+    {
+        return chunks.begin() + (static_cast<node const&>(*this).chunk_for(name) - chunks.cbegin());
+    }
+
+    // *c, copied first if an earlier revision shares it
+    chunk& own(std::vector<std::shared_ptr<chunk> >::iterator c)
+    {
+        if ((*c)->rev != rev)
+            *c = std::make_shared<chunk>(chunk{rev, (*c)->entries});
+        return **c;
+    }
+};
+
+svn_dump::svn_dump(std::string const& filename)
+    : current(-1), spool(-1), spool_size(0)
+{
+    int const fd = filename == "-" ? STDIN_FILENO : ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("cannot read " + filename + ": " + std::strerror(errno));
+    source.reset(
+        new iostreams::stream<iostreams::file_descriptor_source>(
+            iostreams::file_descriptor_source(
+                fd, fd == STDIN_FILENO ? iostreams::never_close_handle : iostreams::close_handle),
+            read_buffer_size));
+
+    auto* const decompressed = new iostreams::filtering_istream;
+    in.reset(decompressed);
+    switch (source->peek())
+    {
+    case 0x1f: decompressed->push(iostreams::gzip_decompressor(), read_buffer_size); break;
+    case 'B': decompressed->push(iostreams::bzip2_decompressor(), read_buffer_size); break;
+    }
+    decompressed->push(*source, read_buffer_size);
+
+    headers h;
+    if (!read_headers(h) || !h.count("SVN-fs-dump-format-version"))
+        throw std::runtime_error(filename + " is not an svn dump");
+    if (to_uint(h["SVN-fs-dump-format-version"]) > 3)
+        throw std::runtime_error("unsupported svn dump format version " + h["SVN-fs-dump-format-version"]);
+
+    namespace fs = boost::filesystem;
+    fs::path const spool_path = fs::temp_directory_path() / fs::unique_path("svn2git-%%%%-%%%%-%%%%-%%%%");
+    spool = ::open(spool_path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (spool < 0)
+        throw std::runtime_error("cannot create " + spool_path.string() + ": " + std::strerror(errno));
+    ::unlink(spool_path.c_str());
+}
+
+svn_dump::~svn_dump()
+{
+    if (spool >= 0)
+        ::close(spool);
+}
+
+// Read a record's header block into h; false at the end of the stream
+bool svn_dump::read_headers(headers& h)
+{
+    h.clear();
+    std::string line;
+    do
+    {
+        if (!std::getline(*in, line))
+            return false;
+    }
+    while (line.empty());
+
+    do
+    {
+        std::string::size_type const colon = line.find(": ");
+        if (colon == std::string::npos)
+            malformed("bad header line \"" + line + "\"");
+        h[line.substr(0, colon)] = line.substr(colon + 2);
+    }
+    while (std::getline(*in, line) && !line.empty());
+    return true;
+}
+
+std::string svn_dump::read_bytes(std::uint64_t n)
+{
+    std::string result(n, '\0');
+    if (n != 0 && !in->read(&result[0], n))
+        malformed("truncated record");
+    return result;
+}
+
+void svn_dump::skip(std::uint64_t n)
+{
+    if (n != 0 && std::uint64_t(in->ignore(n).gcount()) != n)
+        malformed("truncated record");
+}
+
+bool svn_dump::read_through(long rev)
+{
+    while (current < rev)
+    {
+        if (!read_revision())
+            return false;
+    }
+    return true;
+}
+
+bool svn_dump::read_revision()
+{
+    headers h;
+    h.swap(pending);
+    while (!h.count("Revision-number"))
+    {
+        // Skip the UUID record, and anything else before the first revision
+        if (!h.empty())
+            skip(get_uint(h, "Content-length"));
+        if (!read_headers(h))
+            return false;
+    }
+
+    long const rev = to_uint(h["Revision-number"]);
+    if (current >= 0 && rev != current + 1)
+        malformed("r" + h["Revision-number"] + " follows r" + std::to_string(current));
+
+    std::uint64_t const prop_length = get_uint(h, "Prop-content-length");
+    std::string const props = read_bytes(prop_length);
+    skip(std::max(get_uint(h, "Content-length"), prop_length) - prop_length);
+    revprops.clear();
+    parse_props(props, [&](std::string const& k, std::string const& v) { revprops[k] = v; });
+
+    roots.resize(rev + 1);
+    roots[rev] = current >= 0 ? roots[current] : std::make_shared<node>(rev, dir);
+    current = rev;
+    changed.clear();
+
+    while (read_headers(h))
+    {
+        if (h.count("Revision-number"))
+        {
+            pending.swap(h);
+            break;
+        }
+        if (h.count("Node-path"))
+            apply_node(h);
+        else
+            skip(get_uint(h, "Content-length"));
+    }
+
+    changes_.clear();
+    for (auto& kv : changed)
+        changes_.push_back(std::move(kv.second));
+    changed.clear();
+    return true;
+}
+
+void svn_dump::apply_node(headers& h)
+{
+    std::string const path = strip_slashes(h["Node-path"]);
+    std::string const action = h["Node-action"];
+    std::string const kind_name = get(h, "Node-kind");
+    node_kind const kind = kind_name == "file" ? file : kind_name == "dir" ? dir : none;
+
+    std::uint64_t const prop_length = get_uint(h, "Prop-content-length");
+    std::uint64_t const text_length = get_uint(h, "Text-content-length");
+    bool const has_text = h.count("Text-content-length") > 0;
+    std::uint64_t const length =
+        h.count("Content-length") ? get_uint(h, "Content-length") : prop_length + text_length;
+    if (prop_length + text_length > length)
+        malformed(path + ": inconsistent content lengths");
+
+    std::string::size_type const slash = path.rfind('/');
+    std::string const parent = slash == std::string::npos ? std::string() : path.substr(0, slash);
+    std::string const name = slash == std::string::npos ? path : path.substr(slash + 1);
+
+    change c = { path, modify, kind, has_text, prop_length > 0, -1, std::string() };
+
+    if (action == "delete" || action == "replace")
+    {
+        node const* const old = find(current, path);
+        if (old == nullptr || path.empty())
+            malformed("r" + std::to_string(current) + " deletes " + path + ", which doesn't exist");
+        if (action == "delete")
+        {
+            c.kind = deleted;
+            c.node = old->kind;
+            c.text_mod = false;
+            record(c);
+        }
+        mutable_node(parent)->erase(name);
+    }
+
+    if (action == "add" || action == "replace")
+    {
+        node_ptr n;
+        c.kind = action == "add" ? add : replace;
+        if (h.count("Node-copyfrom-rev"))
+        {
+            c.copyfrom_rev = to_uint(h["Node-copyfrom-rev"]);
+            c.copyfrom_path = strip_slashes(get(h, "Node-copyfrom-path"));
+            if (c.copyfrom_rev >= current)
+                malformed(path + " is copied from the future");
+            node const* const source = find(c.copyfrom_rev, c.copyfrom_path);
+            if (source == nullptr)
+            {
+                malformed(
+                    "r" + std::to_string(current) + " copies " + path + " from "
+                    + c.copyfrom_path + "@" + std::to_string(c.copyfrom_rev) + ", which doesn't exist");
+            }
+            n = std::make_shared<node>(*source, current);
+        }
+        else
+        {
+            n = std::make_shared<node>(current, kind);
+        }
+        c.node = n->kind;
+        record(c);
+        node* const p = mutable_node(parent);
+        if (p->kind != dir)
+            malformed(path + " is added beneath a file");
+        p->set(name, n);
+    }
+    else if (action == "change")
+    {
+        node const* const existing = find(current, path);
+        if (existing == nullptr)
+            malformed("r" + std::to_string(current) + " changes " + path + ", which doesn't exist");
+        c.node = existing->kind;
+        record(c);
+    }
+    else if (action != "delete")
+    {
+        malformed(path + " has unknown action \"" + action + "\"");
+    }
+
+    skip(prop_length);
+    if (has_text)
+    {
+        node* const target = mutable_node(path);
+        if (target->kind != file)
+            malformed(path + " is a directory with text");
+
+        // The checksums are of the full text, even in deltas
+        std::string key = get(h, "Text-content-sha1");
+        if (key.empty())
+            key = get(h, "Text-content-md5");
+        auto const known = key.empty() ? contents.end() : contents.find(key);
+        if (known != contents.end())
+        {
+            skip(text_length);
+            target->text = &known->second;
+        }
+        else
+        {
+            std::string data = read_bytes(text_length);
+            if (get(h, "Text-delta") == "true")
+                data = svndiff::apply(data.data(), data.size(), text(target->text));
+            target->text = store(key, data);
+        }
+    }
+    skip(length - prop_length - text_length);
+}
+
+// Fold c into the changes of the current revision
+void svn_dump::record(change c)
+{
+    if (c.kind == deleted)
+    {
+        // Changes beneath a deleted path are moot
+        std::string const prefix = c.path.empty() ? c.path : c.path + "/";
+        auto const first = changed.lower_bound(prefix);
+        auto last = first;
+        while (last != changed.end() && last->first.compare(0, prefix.size(), prefix) == 0)
+            ++last;
+        changed.erase(first, last);
+    }
+
+    auto const pos = changed.find(c.path);
+    if (pos == changed.end())
+    {
+        changed.insert(std::make_pair(c.path, std::move(c)));
+        return;
+    }
+
+    change& was = pos->second;
+    switch (c.kind)
+    {
+    case deleted:
+        if (was.kind == add)
+            changed.erase(pos);
+        else
+            was = c;
+        break;
+    case add:
+    case replace:
+        if (was.kind == deleted)
+            c.kind = replace;
+        was = c;
+        break;
+    case modify:
+        was.text_mod = was.text_mod || c.text_mod;
+        was.prop_mod = was.prop_mod || c.prop_mod;
+        break;
+    }
+}
+
+svn_dump::node const* svn_dump::find(long rev, std::string const& path) const
+{
+    if (rev < 0 || rev >= long(roots.size()) || !roots[rev])
+        throw std::runtime_error("r" + std::to_string(rev) + " is not in the svn dump");
+    node const* n = roots[rev].get();
+    for_each_component(
+        path,
+        [&](std::string const& name)
+        {
+            if (n == nullptr)
+                return;
+            node_ptr const child = n->find(name);
+            n = child.get();
+        });
+    return n;
+}
+
+// The node at path in the current revision, made safe to change by
+// copying it and its ancestors where they are shared with earlier ones
+svn_dump::node* svn_dump::mutable_node(std::string const& path)
+{
+    node_ptr& root = roots[current];
+    if (root->rev != current)
+        root = std::make_shared<node>(*root, current);
+    node* n = root.get();
+    for_each_component(
+        path,
+        [&](std::string const& name)
+        {
+            node_ptr child = n->find(name);
+            if (!child)
+                malformed("r" + std::to_string(current) + " changes " + path + ", which doesn't exist");
+            if (child->rev != current)
+            {
+                child = std::make_shared<node>(*child, current);
+                n->set(name, child);
+            }
+            n = child.get();
+        });
+    return n;
+}
+
+svn_dump::content const* svn_dump::store(std::string const& key, std::string const& data)
+{
+    for (std::size_t done = 0; done < data.size();)
+    {
+        ssize_t const n = ::pwrite(spool, data.data() + done, data.size() - done, spool_size + done);
+        if (n < 0)
+            throw std::runtime_error(std::string("cannot write the svn dump spool: ") + std::strerror(errno));
+        done += n;
+    }
+    content const c = { spool_size, data.size() };
+    spool_size += data.size();
+    return &(contents[key.empty() ? "@" + std::to_string(c.offset) : key] = c);
+}
+
+void svn_dump::read_spool(
+    content const& c, std::function<void(char const*, std::size_t)> const& out) const
+{
+    std::vector<char> buffer(std::min<std::uint64_t>(c.length, read_buffer_size));
+    for (std::uint64_t done = 0; done < c.length;)
+    {
+        ssize_t const n = ::pread(
+            spool, buffer.data(), std::min<std::uint64_t>(c.length - done, buffer.size()), c.offset + done);
+        if (n <= 0)
+            throw std::runtime_error(std::string("cannot read the svn dump spool: ") + std::strerror(errno));
+        out(buffer.data(), n);
+        done += n;
+    }
+}
+
+std::string svn_dump::text(content const* c) const
+{
+    std::string result;
+    if (c != nullptr)
+        read_spool(*c, [&](char const* data, std::size_t n) { result.append(data, n); });
+    return result;
+}
+
+std::map<std::string, std::string> const& svn_dump::revision_properties(long rev) const
+{
+    if (rev != current)
+        throw std::runtime_error("only the latest revision's properties are kept from an svn dump");
+    return revprops;
+}
+
+std::vector<svn_dump::change> const& svn_dump::changes(long rev) const
+{
+    if (rev != current)
+        throw std::runtime_error("only the latest revision's changes are kept from an svn dump");
+    return changes_;
+}
+
+svn_dump::node_kind svn_dump::check_path(long rev, std::string const& path) const
+{
+    node const* const n = find(rev, path);
+    return n ? n->kind : none;
+}
+
+std::vector<std::string> svn_dump::dir_entries(long rev, std::string const& path) const
+{
+    std::vector<std::string> result;
+    for (auto const& e : list_directory(rev, path))
+        result.push_back(e.name);
+    return result;
+}
+
+std::vector<svn_dump::dirent> svn_dump::list_directory(long rev, std::string const& path) const
+{
+    node const* const n = find(rev, path);
+    if (n == nullptr || n->kind != dir)
+        throw std::runtime_error(path + "@" + std::to_string(rev) + " is not a directory");
+    return n->list();
+}
+
+std::uint64_t svn_dump::file_length(long rev, std::string const& path) const
+{
+    node const* const n = find(rev, path);
+    if (n == nullptr || n->kind != file)
+        throw std::runtime_error(path + "@" + std::to_string(rev) + " is not a file");
+    return n->text ? n->text->length : 0;
+}
+
+void svn_dump::file_contents(
+    long rev, std::string const& path,
+    std::function<void(char const*, std::size_t)> const& out) const
+{
+    node const* const n = find(rev, path);
+    if (n == nullptr || n->kind != file)
+        throw std::runtime_error(path + "@" + std::to_string(rev) + " is not a file");
+    if (n->text)
+        read_spool(*n->text, out);
+}
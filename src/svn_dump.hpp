@@ -0,0 +1,124 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef SVN_DUMP_DWA2013728_HPP
+# define SVN_DUMP_DWA2013728_HPP
+
+// A reader for the output of "svnadmin dump" or svnrdump, which
+// consumes the stream in one sequential pass.  The history read so
+// far is modeled as a tree per revision, with revisions sharing the
+// nodes they have in common, so copies from any earlier revision can
+// be resolved.  File contents are spooled to an unlinked temporary
+// file, keyed by their checksums, so each distinct text is stored
+// once; delta dumps ("svnadmin dump --deltas") are supported.
+//
+// Revisions must be visited in order: after read_through(rev), the
+// trees of all revisions up to rev can be examined, but only rev's
+// properties and changes are kept.  Not safe for use by more than one
+// thread at a time.
+
+# include <cstdint>
+# include <functional>
+# include <istream>
+# include <map>
+# include <memory>
+# include <string>
+# include <unordered_map>
+# include <vector>
+
+class svn_dump
+{
+ public:
+    // Read from filename, or from the standard input if it is "-".
+    // Streams compressed with gzip or bzip2 are recognized.
+    explicit svn_dump(std::string const& filename);
+    ~svn_dump();
+
+    enum node_kind { none, file, dir };
+    enum change_kind { modify, add, deleted, replace };
+
+    struct change
+    {
+        std::string path;               // without the leading slash
+        change_kind kind;
+        node_kind node;
+        bool text_mod;
+        bool prop_mod;
+        long copyfrom_rev;              // -1 if not a copy
+        std::string copyfrom_path;
+    };
+
+    // Read the stream through the end of rev; false if it ends first
+    bool read_through(long rev);
+
+    // The last revision read, or -1
+    long youngest() const { return current; }
+
+    // Of the last revision read only
+    std::map<std::string, std::string> const& revision_properties(long rev) const;
+    std::vector<change> const& changes(long rev) const;     // sorted by path
+
+    // Paths are relative to the repository root
+    node_kind check_path(long rev, std::string const& path) const;
+    std::vector<std::string> dir_entries(long rev, std::string const& path) const;
+
+    // An entry of a directory.  Entries with the same id are the
+    // same node, and so have the same contents.
+    struct dirent
+    {
+        std::string name;
+        node_kind kind;
+        std::string id;
+    };
+
+    // The entries of a directory, sorted by name
+    std::vector<dirent> list_directory(long rev, std::string const& path) const;
+    std::uint64_t file_length(long rev, std::string const& path) const;
+    void file_contents(
+        long rev, std::string const& path,
+        std::function<void(char const*, std::size_t)> const& out) const;
+
+ private:
+    typedef std::map<std::string, std::string> headers;
+
+    // Where a text is in the spool file
+    struct content
+    {
+        std::uint64_t offset;
+        std::uint64_t length;
+    };
+
+    struct node;
+    typedef std::shared_ptr<node> node_ptr;
+
+    bool read_headers(headers& h);
+    std::string read_bytes(std::uint64_t n);
+    void skip(std::uint64_t n);
+    bool read_revision();
+    void apply_node(headers& h);
+    void record(change c);
+
+    node const* find(long rev, std::string const& path) const;
+    node* mutable_node(std::string const& path);
+    content const* store(std::string const& key, std::string const& text);
+    void read_spool(content const& c, std::function<void(char const*, std::size_t)> const& out) const;
+    std::string text(content const* c) const;
+
+ private:
+    std::unique_ptr<std::istream> source;   // the raw stream
+    std::unique_ptr<std::istream> in;       // after any decompression
+
+    long current;                           // the last revision read
+    headers pending;                        // of the record after it
+    std::vector<node_ptr> roots;            // by revision; null if not in the dump
+
+    std::map<std::string, std::string> revprops;
+    std::map<std::string, change> changed;
+    std::vector<change> changes_;
+
+    int spool;                              // file descriptor
+    std::uint64_t spool_size;
+    std::unordered_map<std::string, content> contents;      // by checksum
+};
+
+#endif // SVN_DUMP_DWA2013728_HPP
@@ -0,0 +1,145 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "svndiff.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <zlib.h>
+
+namespace {
+
+void malformed(std::string const& what)
+{
+    throw std::runtime_error("malformed svndiff data: " + what);
+}
+
+struct cursor
+{
+    cursor(char const* pos, char const* end) : pos(pos), end(end) {}
+
+    // An unsigned integer in svndiff's encoding: seven bits per byte,
+    // most significant first, the high bit set on all but the last
+    std::uint64_t varint()
+    {
+        std::uint64_t x = 0;
+        for (int n = 0; ; ++n)
+        {
+            if (pos == end || n == 10)
+                malformed("bad svndiff integer");
+            unsigned char const byte = *pos++;
+            x = (x << 7) | (byte & 0x7F);
+            if (!(byte & 0x80))
+                return x;
+        }
+    }
+
+    char const* pos;
+    char const* end;
+};
+
+}
+
+namespace svndiff {
+
+std::string decompress(char const* data, std::size_t size)
+{
+    cursor in(data, data + size);
+    std::uint64_t const length = in.varint();
+    std::size_t const stored = in.end - in.pos;
+    if (stored == length)
+        return std::string(in.pos, in.end);
+
+    std::string result(length, '\0');
+    uLongf result_size = length;
+    if (::uncompress(
+            reinterpret_cast<Bytef*>(&result[0]), &result_size,
+            reinterpret_cast<Bytef const*>(in.pos), stored) != Z_OK
+        || result_size != length)
+    {
+        malformed("bad compressed data");
+    }
+    return result;
+}
+
+std::string apply(char const* data, std::size_t size, std::string const& source)
+{
+    if (size < 4 || std::memcmp(data, "SVN", 3) != 0)
+        malformed("bad svndiff header");
+    int const version = data[3];
+    if (version > 1)
+        throw std::runtime_error("unsupported svndiff version " + std::to_string(version));
+
+    std::string result;
+    cursor in(data + 4, data + size);
+    while (in.pos != in.end)
+    {
+        std::uint64_t const source_offset = in.varint();
+        std::uint64_t const source_length = in.varint();
+        std::uint64_t const target_length = in.varint();
+        std::uint64_t const instructions_length = in.varint();
+        std::uint64_t const new_data_length = in.varint();
+        if (source_offset + source_length > source.size()
+            || instructions_length + new_data_length > std::uint64_t(in.end - in.pos))
+        {
+            malformed("bad svndiff window");
+        }
+
+        std::string instructions(in.pos, in.pos + instructions_length);
+        in.pos += instructions_length;
+        std::string new_data(in.pos, in.pos + new_data_length);
+        in.pos += new_data_length;
+        if (version == 1)
+        {
+            instructions = decompress(instructions.data(), instructions.size());
+            new_data = decompress(new_data.data(), new_data.size());
+        }
+
+        char const* const view = source.data() + source_offset;
+        std::size_t const target_start = result.size();
+        std::size_t new_data_pos = 0;
+        cursor ops(instructions.data(), instructions.data() + instructions.size());
+        while (ops.pos != ops.end)
+        {
+            unsigned char const op = *ops.pos++;
+            std::uint64_t length = op & 0x3F;
+            if (length == 0)
+                length = ops.varint();
+
+            switch (op >> 6)
+            {
+            case 0:     // copy from the source view
+            {
+                std::uint64_t const offset = ops.varint();
+                if (offset + length > source_length)
+                    malformed("svndiff source copy out of range");
+                result.append(view + offset, length);
+                break;
+            }
+            case 1:     // copy from the target view; may overlap itself
+            {
+                std::uint64_t const offset = ops.varint();
+                if (offset >= result.size() - target_start)
+                    malformed("svndiff target copy out of range");
+                for (std::size_t i = target_start + offset; length > 0; --length)
+                    result.push_back(result[i++]);
+                break;
+            }
+            case 2:     // copy from the new data
+                if (new_data_pos + length > new_data.size())
+                    malformed("svndiff new data out of range");
+                result.append(new_data, new_data_pos, length);
+                new_data_pos += length;
+                break;
+            default:
+                malformed("bad svndiff instruction");
+            }
+        }
+        if (result.size() - target_start != target_length)
+            malformed("svndiff window has the wrong length");
+    }
+    return result;
+}
+
+}
@@ -0,0 +1,25 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef SVNDIFF_DWA2013728_HPP
+# define SVNDIFF_DWA2013728_HPP
+
+// Decoding of svndiff, the delta format of both FSFS representations
+// and dump files, versions 0 and 1.  Malformed input is reported by
+// throwing std::runtime_error.
+
+# include <cstddef>
+# include <string>
+
+namespace svndiff {
+
+// Apply the delta [data, data + size) to source
+std::string apply(char const* data, std::size_t size, std::string const& source);
+
+// Undo svn__compress: the original length, then the data, which is
+// zlib-compressed unless that would not have made it smaller
+std::string decompress(char const* data, std::size_t size);
+
+}
+
+#endif // SVNDIFF_DWA2013728_HPP
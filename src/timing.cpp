@@ -0,0 +1,321 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "timing.hpp"
+
+#ifdef SVN2GIT_TIMING
+
+# include "log.hpp"
+
+# include <algorithm>
+# include <cstdint>
+# include <fstream>
+# include <iomanip>
+# include <unordered_map>
+# include <unordered_set>
+# include <utility>
+# include <vector>
+# include <sys/resource.h>
+
+namespace {
+
+typedef std::pair<char const*, std::string const*> phase_repo;
+
+struct phase_repo_hash
+{
+    std::size_t operator()(phase_repo const& k) const
+    {
+        return std::hash<void const*>()(k.first) * 31 + std::hash<void const*>()(k.second);
+    }
+};
+
+struct totals
+{
+    std::uint64_t calls;
+    std::uint64_t ns;
+    std::uint64_t max_ns;
+    std::uint64_t peak_growth_kb;       // of the process's peak RSS
+    bool rss_sampled;
+};
+
+// A single timed scope, kept only when tracing
+struct event
+{
+    char const* phase;
+    std::string const* repo;
+    std::uint32_t revnum;
+    std::uint64_t start_ns;
+    std::uint64_t duration_ns;
+};
+
+// The time spent in each phase during one SVN revision
+struct revision_totals
+{
+    std::size_t revnum;
+    std::uint64_t start_ns;
+    std::uint64_t finish_ns;
+    long peak_growth_kb;
+    std::vector<std::pair<char const*, std::uint64_t> > phases;
+};
+
+// Bounds the memory used for tracing, at 40 bytes per event
+std::size_t const max_events = 1 << 24;
+
+timing::clock::time_point const origin = timing::clock::now();
+std::unordered_map<phase_repo, totals, phase_repo_hash> all_totals;
+
+// The repository names timed, interned so that totals and events can
+// refer to them by address
+std::unordered_set<std::string> repo_names;
+std::size_t current_revnum = 0;
+revision_totals current_revision;
+long revision_start_peak_kb = 0;
+std::vector<revision_totals> slowest_revisions; // a heap, see below
+std::vector<revision_totals> hungriest_revisions; // likewise
+std::size_t const slowest_revisions_kept = 10;
+
+std::string trace_file;
+std::vector<event> events;
+std::vector<revision_totals> revisions;
+
+bool slower(revision_totals const& lhs, revision_totals const& rhs)
+{
+    return lhs.finish_ns - lhs.start_ns > rhs.finish_ns - rhs.start_ns;
+}
+
+bool hungrier(revision_totals const& lhs, revision_totals const& rhs)
+{
+    return lhs.peak_growth_kb > rhs.peak_growth_kb;
+}
+
+// Keep the greatest revisions, as ordered by greater, in a min-heap,
+// least on top
+template <class Greater>
+void keep_greatest(std::vector<revision_totals>& heap, revision_totals const& r, Greater greater)
+{
+    heap.push_back(r);
+    std::push_heap(heap.begin(), heap.end(), greater);
+    if (heap.size() > slowest_revisions_kept)
+    {
+        std::pop_heap(heap.begin(), heap.end(), greater);
+        heap.pop_back();
+    }
+}
+
+void finish_revision()
+{
+    long const peak_kb = timing::peak_rss_kb();
+    current_revision.peak_growth_kb = peak_kb - revision_start_peak_kb;
+    revision_start_peak_kb = peak_kb;
+    if (current_revision.phases.empty())
+        return;
+
+    keep_greatest(slowest_revisions, current_revision, slower);
+    if (current_revision.peak_growth_kb > 0)
+        keep_greatest(hungriest_revisions, current_revision, hungrier);
+
+    if (!trace_file.empty())
+        revisions.push_back(current_revision);
+    current_revision.phases.clear();
+}
+
+std::ostream& write_json_string(std::ostream& os, std::string const& s)
+{
+    os << '"';
+    for (char c : s)
+    {
+        if (c == '"' || c == '\\')
+            os << '\\' << c;
+        else if (static_cast<unsigned char>(c) < 0x20)
+            os << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c)
+               << std::dec << std::setfill(' ');
+        else
+            os << c;
+    }
+    return os << '"';
+}
+
+// Chrome timestamps are in (fractional) microseconds
+std::ostream& write_us(std::ostream& os, std::uint64_t ns)
+{
+    return os << ns / 1000 << '.' << std::setw(3) << std::setfill('0') << ns % 1000
+              << std::setfill(' ');
+}
+
+void write_trace()
+{
+    std::ofstream out(trace_file.c_str());
+    out << "{\"traceEvents\":[\n"
+        << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+        << "\"args\":{\"name\":\"revisions\"}},\n"
+        << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,"
+        << "\"args\":{\"name\":\"phases\"}}";
+
+    // One event per revision, carrying the revision's phase totals
+    for (auto const& r : revisions)
+    {
+        out << ",\n{\"name\":\"r" << r.revnum << "\",\"ph\":\"X\",\"pid\":1,\"tid\":0,\"ts\":";
+        write_us(out, r.start_ns) << ",\"dur\":";
+        write_us(out, r.finish_ns - r.start_ns) << ",\"args\":{";
+        for (std::size_t i = 0; i < r.phases.size(); ++i)
+        {
+            write_json_string(out << (i ? "," : ""), r.phases[i].first) << ':';
+            write_us(out, r.phases[i].second);
+        }
+        out << "}}";
+    }
+
+    for (auto const& e : events)
+    {
+        write_json_string(out << ",\n{\"name\":", e.phase)
+            << ",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":";
+        write_us(out, e.start_ns) << ",\"dur\":";
+        write_us(out, e.duration_ns) << ",\"args\":{\"revision\":" << e.revnum;
+        if (e.repo)
+            write_json_string(out << ",\"repository\":", *e.repo);
+        out << "}}";
+    }
+    out << "\n]}\n";
+
+    if (!out.flush())
+        LOG_ERROR << "error writing timing trace " << trace_file << std::endl;
+}
+
+void write_summary()
+{
+    typedef std::pair<phase_repo, totals> row;
+    std::vector<row> rows(all_totals.begin(), all_totals.end());
+    std::sort(
+        rows.begin(), rows.end(),
+        [](row const& lhs, row const& rhs) { return lhs.second.ns > rhs.second.ns; });
+
+    if (Log::get_level() < Log::Info)
+        return;
+    Log::line report(Log::Info);
+    std::ostream& os = report.stream();
+    os << "Time spent, by phase and repository (nested phases are included in their callers),\n"
+       << "and the growth of the process's peak RSS during the phases that sample it:\n"
+       << std::left << std::setw(24) << "phase" << std::setw(24) << "repository" << std::right
+       << std::setw(12) << "calls" << std::setw(12) << "total s"
+       << std::setw(12) << "mean us" << std::setw(12) << "max ms"
+       << std::setw(16) << "peak RSS +MB" << "\n";
+
+    os << std::fixed;
+    for (auto const& r : rows)
+    {
+        totals const& t = r.second;
+        os << std::left << std::setw(24) << r.first.first
+           << std::setw(24) << (r.first.second ? *r.first.second : std::string("-"))
+           << std::right << std::setw(12) << t.calls
+           << std::setprecision(3) << std::setw(12) << t.ns / 1e9
+           << std::setprecision(1) << std::setw(12) << t.ns / 1e3 / t.calls
+           << std::setprecision(3) << std::setw(12) << t.max_ns / 1e6
+           << std::setprecision(1) << std::setw(16);
+        if (t.rss_sampled)
+            os << t.peak_growth_kb / 1024.0 << "\n";
+        else
+            os << "-" << "\n";
+    }
+
+    std::sort_heap(slowest_revisions.begin(), slowest_revisions.end(), slower);
+    os << "Slowest revisions:\n";
+    for (auto const& r : slowest_revisions)
+    {
+        os << "  r" << r.revnum << std::setprecision(3) << std::setw(12)
+           << (r.finish_ns - r.start_ns) / 1e9 << " s\n";
+    }
+
+    std::sort_heap(hungriest_revisions.begin(), hungriest_revisions.end(), hungrier);
+    os << "Revisions raising the process's peak RSS most:\n";
+    for (auto const& r : hungriest_revisions)
+    {
+        os << "  r" << r.revnum << std::setprecision(1) << std::setw(12)
+           << r.peak_growth_kb / 1024.0 << " MB\n";
+    }
+    os.unsetf(std::ios::floatfield);
+    os << std::flush;
+}
+
+}
+
+void timing::set_revision(std::size_t revnum)
+{
+    finish_revision();
+    current_revnum = revnum;
+}
+
+void timing::trace_to(std::string const& filename)
+{
+    trace_file = filename;
+}
+
+std::string const* timing::intern(std::string const& repo)
+{
+    return &*repo_names.insert(repo).first;
+}
+
+void timing::record(
+    char const* phase, std::string const* repo,
+    clock::time_point start, clock::time_point finish, long peak_growth_kb)
+{
+    std::uint64_t const start_ns
+        = std::chrono::duration_cast<std::chrono::nanoseconds>(start - origin).count();
+    std::uint64_t const ns
+        = std::chrono::duration_cast<std::chrono::nanoseconds>(finish - start).count();
+
+    totals& t = all_totals[phase_repo(phase, repo)];
+    ++t.calls;
+    t.ns += ns;
+    t.max_ns = std::max(t.max_ns, ns);
+    if (peak_growth_kb >= 0)
+    {
+        t.peak_growth_kb += peak_growth_kb;
+        t.rss_sampled = true;
+    }
+
+    // Per-revision totals are by phase only; there are few phases,
+    // so a linear search is fine
+    if (current_revision.phases.empty())
+    {
+        current_revision.revnum = current_revnum;
+        current_revision.start_ns = start_ns;
+        current_revision.finish_ns = start_ns + ns;
+    }
+    current_revision.start_ns = std::min(current_revision.start_ns, start_ns);
+    current_revision.finish_ns = std::max(current_revision.finish_ns, start_ns + ns);
+    auto p = std::find_if(
+        current_revision.phases.begin(), current_revision.phases.end(),
+        [phase](std::pair<char const*, std::uint64_t> const& x) { return x.first == phase; });
+    if (p == current_revision.phases.end())
+        current_revision.phases.push_back(std::make_pair(phase, ns));
+    else
+        p->second += ns;
+
+    if (!trace_file.empty() && events.size() < max_events)
+    {
+        event e = { phase, repo, std::uint32_t(current_revnum), start_ns, ns };
+        events.push_back(e);
+    }
+}
+
+long timing::peak_rss_kb()
+{
+    // On Linux, ru_maxrss is in kilobytes
+    rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+void timing::report()
+{
+    finish_revision();
+    if (!trace_file.empty())
+    {
+        if (events.size() == max_events)
+            LOG_WARN << "timing trace truncated at " << max_events << " events" << std::endl;
+        write_trace();
+    }
+    write_summary();
+}
+
+#endif // SVN2GIT_TIMING
@@ -0,0 +1,95 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef TIMING_DWA2013720_HPP
+# define TIMING_DWA2013720_HPP
+
+// Scoped timers for finding out where conversion time goes.  They
+// are compiled in only when SVN2GIT_TIMING is defined (configure
+// with -DTIMING=ON); otherwise the macros below expand to nothing.
+//
+//   TIMED_SCOPE("phase");            // time until the end of scope
+//   TIMED_REPO_SCOPE("phase", repo); // ditto, attributed to a repository
+//   TIMED_RSS_SCOPE("phase");        // ditto, also sampling peak RSS
+//   TIMED_REVISION(revnum);          // attribute what follows to revnum
+//
+// Phase names must be string literals.  Repository names are passed
+// as returned by timing::intern(), once per repository, so that the
+// timers on hot paths only store a pointer.
+//
+// Each revision records how far it raised the process's peak resident
+// set size, which is how to find out which revision memory use blew
+// up in.  Sampling it costs two system calls, so only the coarse
+// phases of a revision, timed with TIMED_RSS_SCOPE, record it too.
+# ifdef SVN2GIT_TIMING
+
+#  include <boost/preprocessor/cat.hpp>
+#  include <chrono>
+#  include <cstdlib>
+#  include <string>
+
+struct timing
+{
+    typedef std::chrono::steady_clock clock;
+
+    struct scope
+    {
+        explicit scope(char const* phase, std::string const* repo = nullptr, bool sample_rss = false)
+            : phase(phase), repo(repo), start(clock::now()),
+              start_peak_kb(sample_rss ? peak_rss_kb() : -1) {}
+
+        ~scope()
+        {
+            record(phase, repo, start, clock::now(),
+                   start_peak_kb < 0 ? -1 : peak_rss_kb() - start_peak_kb);
+        }
+
+     private:
+        scope(scope const&);
+        char const* phase;
+        std::string const* repo;
+        clock::time_point start;
+        long start_peak_kb;             // -1 if not sampling
+    };
+
+    static void set_revision(std::size_t revnum);
+
+    // The name to pass to TIMED_REPO_SCOPE for the named repository;
+    // it lives until exit
+    static std::string const* intern(std::string const& repo);
+
+    // Also keep every timed scope, to be written as a Chrome
+    // trace-event file (chrome://tracing) by report()
+    static void trace_to(std::string const& filename);
+
+    // Write the summary table, and the trace file if requested
+    static void report();
+
+    // The peak resident set size of the process so far
+    static long peak_rss_kb();
+
+ private:
+    static void record(
+        char const* phase, std::string const* repo,
+        clock::time_point start, clock::time_point finish,
+        long peak_growth_kb);           // -1 if not sampled
+};
+
+#  define TIMED_SCOPE(phase) \
+    timing::scope BOOST_PP_CAT(timed_scope_, __LINE__)(phase)
+#  define TIMED_REPO_SCOPE(phase, repo) \
+    timing::scope BOOST_PP_CAT(timed_scope_, __LINE__)(phase, repo)
+#  define TIMED_RSS_SCOPE(phase) \
+    timing::scope BOOST_PP_CAT(timed_scope_, __LINE__)(phase, nullptr, true)
+#  define TIMED_REVISION(revnum) timing::set_revision(revnum)
+
+# else
+
+#  define TIMED_SCOPE(phase)
+#  define TIMED_REPO_SCOPE(phase, repo)
+#  define TIMED_RSS_SCOPE(phase)
+#  define TIMED_REVISION(revnum)
+
+# endif
+
+#endif // TIMING_DWA2013720_HPP
@@ -0,0 +1,171 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Run svn2git over a repository made by generate_svn_repo, and report
+// its throughput, and the cpu time and peak memory use of it and the
+// git processes it starts:
+//
+//   benchmark --svn2git PATH --svnrepo PATH --work-dir DIR [-- svn2git options]
+//
+// The Git repositories are written to a fresh work directory, so that
+// runs are comparable.
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace fs = boost::filesystem;
+
+struct repository_info
+{
+    std::uint64_t revisions;
+    std::uint64_t content_bytes;
+    std::string rules;
+};
+
+// Read what generate_svn_repo recorded about the repository
+repository_info read_info(std::string const& svn_repo)
+{
+    std::string const filename = svn_repo + "/benchmark.txt";
+    std::ifstream in(filename.c_str());
+    if (!in)
+        throw std::runtime_error("cannot read " + filename + "; was the repository made by generate_svn_repo?");
+
+    repository_info info = { 0, 0, svn_repo + "/repositories.txt" };
+    std::string key;
+    while (in >> key)
+    {
+        if (key == "revisions")
+            in >> info.revisions;
+        else if (key == "content_bytes")
+            in >> info.content_bytes;
+        else if (key == "rules")
+            in >> info.rules;
+        else
+            in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    }
+    return info;
+}
+
+// Run argv in work_dir, returning its resource usage
+rusage run(std::vector<std::string> const& args, std::string const& work_dir)
+{
+    std::vector<char*> argv;
+    for (auto const& a : args)
+        argv.push_back(const_cast<char*>(a.c_str()));
+    argv.push_back(nullptr);
+
+    pid_t pid = ::fork();
+    if (pid < 0)
+        throw std::runtime_error(std::string("fork failed: ") + std::strerror(errno));
+    if (pid == 0)
+    {
+        if (::chdir(work_dir.c_str()) == 0)
+            ::execv(argv[0], argv.data());
+        std::cerr << "cannot run " << argv[0] << ": " << std::strerror(errno) << std::endl;
+        ::_exit(127);
+    }
+
+    int status;
+    rusage usage;
+    while (::wait4(pid, &status, 0, &usage) < 0)
+    {
+        if (errno != EINTR)
+            throw std::runtime_error(std::string("wait4 failed: ") + std::strerror(errno));
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        throw std::runtime_error(args[0] + " failed");
+    return usage;
+}
+
+double seconds(timeval const& t)
+{
+    return t.tv_sec + t.tv_usec / 1e6;
+}
+
+int main(int argc, char** argv)
+{
+    std::string svn2git, svn_repo, work_dir;
+    std::vector<std::string> extra_args;
+
+    namespace po = boost::program_options;
+    po::options_description program_options("Allowed options");
+    program_options.add_options()
+        ("help,h", "produce help message")
+        ("svn2git", po::value(&svn2git)->value_name("PATH")->required(), "the svn2git to measure")
+        ("svnrepo", po::value(&svn_repo)->value_name("PATH")->required(),
+         "SVN repository made by generate_svn_repo")
+        ("work-dir", po::value(&work_dir)->value_name("DIR")->required(),
+         "where to write the Git repositories; emptied first")
+        ("svn2git-args", po::value(&extra_args)->value_name("ARGS"),
+         "further arguments to svn2git, also accepted after --")
+        ;
+    po::positional_options_description positional;
+    positional.add("svn2git-args", -1);
+
+    try
+    {
+        po::variables_map variables;
+        store(po::command_line_parser(argc, argv).options(program_options).positional(positional).run(),
+              variables);
+        if (variables.count("help"))
+        {
+            std::cout << "usage: " << argv[0] << " [options] [-- svn2git options]\n"
+                      << program_options << std::endl;
+            return EXIT_SUCCESS;
+        }
+        notify(variables);
+
+        repository_info const info = read_info(svn_repo);
+        svn2git = fs::absolute(svn2git).string();
+        fs::remove_all(work_dir);
+        fs::create_directories(work_dir);
+
+        std::vector<std::string> args = {
+            svn2git, "--quiet",
+            "--svnrepo", fs::absolute(svn_repo).string(),
+            "--rules", fs::absolute(info.rules).string()
+        };
+        args.insert(args.end(), extra_args.begin(), extra_args.end());
+
+        auto const start = std::chrono::steady_clock::now();
+        rusage const usage = run(args, work_dir);
+        double const wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        // svn2git waits for its fast-import and git processes, so
+        // their usage is included in its own: cpu times are summed
+        // and the peak RSS is that of the largest of them
+        double const mb = info.content_bytes / 1e6;
+        std::cout << std::fixed << std::setprecision(2)
+                  << "revisions:                       " << info.revisions << "\n"
+                  << "content:                         " << mb << " MB\n"
+                  << "wall time:                       " << wall << " s\n"
+                  << "cpu time (svn2git and children): " << seconds(usage.ru_utime) << " s user, "
+                  << seconds(usage.ru_stime) << " s system\n"
+                  << "revisions/sec:                   " << info.revisions / wall << "\n"
+                  << "MB/sec:                          " << mb / wall << "\n"
+                  // ru_maxrss is in kilobytes on Linux
+                  << "peak RSS (svn2git and children): " << usage.ru_maxrss / 1024.0 << " MiB"
+                  << std::endl;
+        return EXIT_SUCCESS;
+    }
+    catch (std::exception const& error)
+    {
+        std::cerr << error.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,169 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Read a repository through both svn backends, check that they agree,
+// and time a sequential scan of its whole history with each:
+//
+//   fsfs_check --svnrepo PATH [--no-compare]
+//
+// Every revision's properties and changes are compared, and then
+// every changed node is read: files' lengths and contents, and
+// directories' entries.  The repository must be physically
+// addressed, e.g. one made by generate_svn_repo.
+#include "svn.hpp"
+
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::string describe(svn::revision const& rev, path const& p)
+{
+    return "r" + std::to_string(rev.revnum) + " /" + p.str();
+}
+
+void check(bool condition, svn::revision const& rev, path const& p, char const* what)
+{
+    if (!condition)
+        throw std::runtime_error(describe(rev, p) + ": the backends disagree about the " + what);
+}
+
+std::string contents(svn::revision const& rev, path const& p)
+{
+    std::string result;
+    rev.file_contents(p, [&](char const* data, std::size_t n) { result.append(data, n); });
+    return result;
+}
+
+void compare_node(svn::revision const& a, svn::revision const& b, path const& p)
+{
+    svn_node_kind_t const kind = a.check_path(p);
+    check(kind == b.check_path(p), a, p, "node kind");
+    if (kind == svn_node_file)
+    {
+        check(a.file_length(p) == b.file_length(p), a, p, "file length");
+        check(contents(a, p) == contents(b, p), a, p, "file contents");
+    }
+    else if (kind == svn_node_dir)
+    {
+        auto const da = a.list_directory(p), db = b.list_directory(p);
+        check(da->size() == db->size(), a, p, "number of directory entries");
+        for (std::size_t i = 0; i < da->size(); ++i)
+        {
+            check((*da)[i].name == (*db)[i].name, a, p, "directory entries");
+            check((*da)[i].kind == (*db)[i].kind, a, p / (*da)[i].name, "directory entry kind");
+        }
+    }
+}
+
+void compare(svn const& lib, svn const& native)
+{
+    for (int revnum = 0; revnum <= lib.latest_revision(); ++revnum)
+    {
+        svn::revision const a = lib[revnum], b = native[revnum];
+        path const root("");
+        check(a.author == b.author, a, root, "author");
+        check(a.epoch == b.epoch, a, root, "date");
+        check(a.log_message == b.log_message, a, root, "log message");
+
+        std::vector<svn::change> const ca = a.changes(), cb = b.changes();
+        check(ca.size() == cb.size(), a, root, "number of changes");
+        for (std::size_t i = 0; i < ca.size(); ++i)
+        {
+            path const& p = ca[i].svn_path;
+            check(p == cb[i].svn_path, a, p, "changed path");
+            check(ca[i].change_kind == cb[i].change_kind, a, p, "change kind");
+            if (ca[i].node_kind != svn_node_unknown && cb[i].node_kind != svn_node_unknown)
+                check(ca[i].node_kind == cb[i].node_kind, a, p, "changed node's kind");
+            check(ca[i].text_mod == cb[i].text_mod, a, p, "text modification");
+            check(ca[i].copyfrom_path == cb[i].copyfrom_path, a, p, "copy source");
+            if (!ca[i].copyfrom_path.empty())
+                check(ca[i].copyfrom_rev == cb[i].copyfrom_rev, a, p, "copy source revision");
+            if (ca[i].change_kind != svn_fs_path_change_delete)
+                compare_node(a, b, p);
+        }
+    }
+}
+
+// Read every file changed in the repository's history, the way the
+// importer does, and return the number of bytes read
+std::uint64_t scan(svn const& repo)
+{
+    std::uint64_t bytes = 0;
+    for (int revnum = 1; revnum <= repo.latest_revision(); ++revnum)
+    {
+        svn::revision const rev = repo[revnum];
+        for (auto const& c : rev.changes())
+        {
+            if (c.change_kind == svn_fs_path_change_delete || !c.text_mod
+                || rev.check_path(c.svn_path) != svn_node_file)
+            {
+                continue;
+            }
+            rev.file_contents(c.svn_path, [&](char const*, std::size_t n) { bytes += n; });
+        }
+    }
+    return bytes;
+}
+
+double time_scan(char const* name, svn const& repo)
+{
+    auto const start = std::chrono::steady_clock::now();
+    std::uint64_t const bytes = scan(repo);
+    double const seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    std::cout << name << ": " << bytes << " bytes in " << seconds << " s" << std::endl;
+    return seconds;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    namespace po = boost::program_options;
+    std::string svn_repo;
+    po::options_description options("Options");
+    options.add_options()
+        ("help,h", "produce help message")
+        ("svnrepo", po::value(&svn_repo)->required(), "path to the SVN repository")
+        ("no-compare", "only time the scans")
+        ;
+    try
+    {
+        po::variables_map vm;
+        po::store(po::parse_command_line(argc, argv, options), vm);
+        if (vm.count("help"))
+        {
+            std::cout << options << std::endl;
+            return 0;
+        }
+        po::notify(vm);
+
+        if (!vm.count("no-compare"))
+        {
+            svn const lib(svn_repo, "");
+            svn const native(svn_repo, "", svn::native_fs);
+            if (lib.latest_revision() != native.latest_revision())
+                throw std::runtime_error("the backends disagree about the youngest revision");
+            compare(lib, native);
+            std::cout << "backends agree on " << lib.latest_revision() + 1 << " revisions" << std::endl;
+        }
+
+        // Fresh repository objects, so the comparison hasn't warmed any caches
+        double const lib_time = time_scan("libsvn", svn(svn_repo, ""));
+        double const native_time = time_scan("fsfs", svn(svn_repo, "", svn::native_fs));
+        std::cout << "speedup: " << lib_time / native_time << std::endl;
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << "error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,301 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Reads a small FSFS repository, written out by hand, with the native
+// reader: a packed shard and an unpacked one, plain and delta
+// representations in both svndiff versions, copies, and packed
+// revision properties.
+#undef NDEBUG
+#include "fsfs.hpp"
+#include <boost/filesystem.hpp>
+#include <cassert>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+std::string const md5(32, '0');
+
+void write_file(fs::path const& p, std::string const& contents)
+{
+    fs::create_directories(p.parent_path());
+    std::ofstream out(p.string().c_str(), std::ios::binary);
+    out << contents;
+}
+
+std::string varint(std::uint64_t x)
+{
+    std::string result(1, char(x & 0x7F));
+    while (x >>= 7)
+        result.insert(result.begin(), char(0x80 | (x & 0x7F)));
+    return result;
+}
+
+// svn__compress, always compressing so that both paths get exercised
+std::string compress(std::string const& data, bool really)
+{
+    if (!really)
+        return varint(data.size()) + data;
+    std::vector<Bytef> out(compressBound(data.size()));
+    uLongf size = out.size();
+    ::compress(&out[0], &size, reinterpret_cast<Bytef const*>(data.data()), data.size());
+    return varint(data.size()) + std::string(out.begin(), out.begin() + size);
+}
+
+std::string hash(std::vector<std::pair<std::string, std::string> > const& entries)
+{
+    std::string result;
+    for (auto const& e : entries)
+    {
+        result += "K " + std::to_string(e.first.size()) + "\n" + e.first + "\n";
+        result += "V " + std::to_string(e.second.size()) + "\n" + e.second + "\n";
+    }
+    return result + "END\n";
+}
+
+// Builds the contents of one revision file
+struct revision_builder
+{
+    explicit revision_builder(long rev) : rev(rev) {}
+
+    // Returns the "text:" value for a representation
+    std::string rep(std::string const& header, std::string const& data, std::size_t expanded)
+    {
+        std::string const where = std::to_string(rev) + " " + std::to_string(contents.size());
+        contents += header + "\n" + data + "ENDREP\n";
+        return where + " " + std::to_string(data.size()) + " " + std::to_string(expanded) + " " + md5;
+    }
+
+    std::string plain(std::string const& text)
+    {
+        return rep("PLAIN", text, text.size());
+    }
+
+    // Returns the node-revision's id
+    std::string node(char const* type, std::string const& text, std::string const& cpath)
+    {
+        std::string const id = "0.0.r" + std::to_string(rev) + "/" + std::to_string(contents.size());
+        contents += "id: " + id + "\ntype: " + type + "\ncount: 0\n";
+        if (!text.empty())
+            contents += "text: " + text + "\n";
+        contents += "cpath: " + cpath + "\n\n";
+        return id;
+    }
+
+    std::string finish(std::string const& root_id, std::string const& changes)
+    {
+        std::string const changes_offset = std::to_string(contents.size());
+        contents += changes;
+        contents += "\n" + root_id.substr(root_id.find('/') + 1) + " " + changes_offset + "\n";
+        return contents;
+    }
+
+    long rev;
+    std::string contents;
+};
+
+std::string read_all(fsfs const& repo, long rev, std::string const& path)
+{
+    return *repo.file_contents(rev, path);
+}
+
+}
+
+int main()
+{
+    fs::path const repo = fs::temp_directory_path() / fs::unique_path("fsfs_test-%%%%-%%%%");
+    fs::path const db = repo / "db";
+    write_file(db / "format", "6\nlayout sharded 2\n");
+    write_file(db / "current", "3\n");
+    write_file(db / "min-unpacked-rev", "2\n");
+
+    // r0: an empty root
+    revision_builder r0(0);
+    std::string const root0 = r0.node("dir", r0.plain("END\n"), "/");
+    std::string const rev0 = r0.finish(root0, "");
+
+    // r1: /trunk/a.txt, plain, and /trunk/b.txt, a delta against
+    // nothing
+    revision_builder r1(1);
+    std::string const a1_text = r1.plain("hello\n");
+    std::string const a1 = r1.node("file", a1_text, "/trunk/a.txt");
+    std::string const b1 = r1.node(
+        "file", r1.rep("DELTA", std::string("SVN\0", 4) + varint(0) + varint(0) + varint(3)
+                       + varint(1) + varint(3) + "\x83" "bbb", 3),
+        "/trunk/b.txt");
+    std::string const trunk1_text = r1.plain(hash({ { "a.txt", "file " + a1 }, { "b.txt", "file " + b1 } }));
+    std::string const trunk1 = r1.node("dir", trunk1_text, "/trunk");
+    std::string const root1 = r1.node("dir", r1.plain(hash({ { "trunk", "dir " + trunk1 } })), "/");
+    std::string const rev1 = r1.finish(
+        root1,
+        trunk1 + " add-dir false false /trunk\n\n"
+        + a1 + " add-file true false /trunk/a.txt\n\n"
+        + b1 + " add-file true false /trunk/b.txt\n\n");
+
+    // Pack r0 and r1
+    write_file(db / "revs" / "0.pack" / "pack", rev0 + rev1);
+    write_file(db / "revs" / "0.pack" / "manifest", "0\n" + std::to_string(rev0.size()) + "\n");
+
+    // r2: /trunk/a.txt becomes a version 1 delta against r1's, with
+    // copies from the source and the target; /trunk/b.txt goes away,
+    // and /tags/t1 is copied from /trunk@1.
+    revision_builder r2(2);
+    std::string const instructions = std::string("\x06\x00", 2) + "\x86" + "\x46\x06";
+    std::string const window = compress(instructions, false) + compress("world\n", true);
+    std::string const a2 = r2.node(
+        "file",
+        r2.rep("DELTA 1 " + a1_text.substr(2, a1_text.find(' ', 2) - 2) + " 6",
+               std::string("SVN\1", 4) + varint(0) + varint(6) + varint(18)
+               + varint(compress(instructions, false).size())
+               + varint(compress("world\n", true).size()) + window,
+               18),
+        "/trunk/a.txt");
+    std::string const trunk2 = r2.node("dir", r2.plain(hash({ { "a.txt", "file " + a2 } })), "/trunk");
+    std::string const t1 = r2.node("dir", trunk1_text, "/tags/t1");
+    std::string const tags2 = r2.node("dir", r2.plain(hash({ { "t1", "dir " + t1 } })), "/tags");
+    std::string const root2 = r2.node(
+        "dir", r2.plain(hash({ { "tags", "dir " + tags2 }, { "trunk", "dir " + trunk2 } })), "/");
+    write_file(
+        db / "revs" / "1" / "2",
+        r2.finish(
+            root2,
+            a2 + " modify-file true false /trunk/a.txt\n\n"
+            + b1 + " delete-file false false /trunk/b.txt\n\n"
+            + tags2 + " add-dir false false /tags\n\n"
+            + t1 + " add-dir false false /tags/t1\n1 /trunk\n"));
+
+    // r3: an empty file, in the newer format with a mergeinfo flag,
+    // and a change that is reset away
+    revision_builder r3(3);
+    std::string const empty = r3.node("file", "", "/trunk/empty");
+    std::string const trunk3 = r3.node(
+        "dir", r3.plain(hash({ { "a.txt", "file " + a2 }, { "empty", "file " + empty } })), "/trunk");
+    std::string const root3 = r3.node(
+        "dir", r3.plain(hash({ { "tags", "dir " + tags2 }, { "trunk", "dir " + trunk3 } })), "/");
+    write_file(
+        db / "revs" / "1" / "3",
+        r3.finish(
+            root3,
+            empty + " add-file true false false /trunk/empty\n\n"
+            + trunk3 + " modify-dir false true false /trunk\n\n"
+            + t1 + " modify-dir false true false /tags/t1\n\n"
+            + t1 + " reset false false false /tags/t1\n\n"));
+
+    // Revision properties: r0 unpacked, r1 in a pack with it; r2 and
+    // r3 unpacked
+    std::string const props0 = hash({ { "svn:date", "2013-07-01T00:00:00.000000Z" } });
+    std::string const props1 = hash({ { "svn:author", "alice" }, { "svn:log", "import" } });
+    write_file(db / "revprops" / "0" / "0", props0);
+    write_file(
+        db / "revprops" / "0.pack" / "0.0",
+        compress(
+            "0\n2\n" + std::to_string(props0.size()) + "\n" + std::to_string(props1.size())
+            + "\n\n" + props0 + props1, true));
+    write_file(db / "revprops" / "0.pack" / "manifest", "0.0\n0.0\n");
+    write_file(db / "revprops" / "1" / "2", hash({ { "svn:author", "bob" } }));
+    write_file(db / "revprops" / "1" / "3", hash({ { "svn:log", "multi\nline" } }));
+
+    {
+        fsfs r(repo.string());
+        assert(r.youngest() == 3);
+
+        assert(r.revision_properties(0).at("svn:date") == "2013-07-01T00:00:00.000000Z");
+        assert(r.revision_properties(1).at("svn:author") == "alice");
+        assert(r.revision_properties(1).at("svn:log") == "import");
+        assert(r.revision_properties(2).at("svn:author") == "bob");
+        assert(r.revision_properties(3).at("svn:log") == "multi\nline");
+
+        assert(r.check_path(0, "") == fsfs::dir);
+        assert(r.dir_entries(0, "").empty());
+        assert(r.changes(0).empty());
+
+        auto const c1 = r.changes(1);
+        assert(c1.size() == 3);
+        assert(c1[0].path == "trunk" && c1[0].kind == fsfs::add && c1[0].node == fsfs::dir);
+        assert(c1[1].path == "trunk/a.txt" && c1[1].text_mod && c1[1].copyfrom_rev == -1);
+        assert(r.check_path(1, "trunk/a.txt") == fsfs::file);
+        assert(r.check_path(1, "trunk/c.txt") == fsfs::none);
+        assert(r.check_path(1, "trunk/a.txt/x") == fsfs::none);
+        assert(read_all(r, 1, "trunk/a.txt") == "hello\n");
+        assert(read_all(r, 1, "trunk/b.txt") == "bbb");
+        assert(r.file_length(1, "trunk/b.txt") == 3);
+
+        auto const c2 = r.changes(2);
+        assert(c2.size() == 4);
+        assert(c2[0].path == "tags" && c2[0].kind == fsfs::add);
+        assert(c2[1].path == "tags/t1" && c2[1].copyfrom_rev == 1 && c2[1].copyfrom_path == "trunk");
+        assert(c2[2].path == "trunk/a.txt" && c2[2].kind == fsfs::modify);
+        assert(c2[3].path == "trunk/b.txt" && c2[3].kind == fsfs::deleted);
+        assert(read_all(r, 2, "trunk/a.txt") == "hello\nworld\nworld\n");
+        assert(r.file_length(2, "trunk/a.txt") == 18);
+        assert(r.check_path(2, "trunk/b.txt") == fsfs::none);
+        assert(read_all(r, 2, "tags/t1/b.txt") == "bbb");
+        assert((r.dir_entries(2, "") == std::vector<std::string>{ "tags", "trunk" }));
+        auto const listing = r.list_directory(2, "tags/t1");
+        assert(listing.size() == 2);
+        assert(listing[0].name == "a.txt" && listing[0].kind == fsfs::file);
+        assert(listing[1].name == "b.txt" && listing[1].kind == fsfs::file);
+        assert(r.list_directory(2, "")[0].kind == fsfs::dir);
+
+        // The tag shares its files with the trunk it was copied from
+        // until they change
+        assert(listing[1].id == r.list_directory(1, "trunk")[1].id);
+        assert(listing[0].id != r.list_directory(2, "trunk")[0].id);
+
+        auto const c3 = r.changes(3);
+        assert(c3.size() == 2);
+        assert(c3[0].path == "trunk" && !c3[0].text_mod && c3[0].prop_mod);
+        assert(c3[1].path == "trunk/empty" && c3[1].node == fsfs::file);
+        assert(read_all(r, 3, "trunk/empty").empty());
+        assert(r.file_length(3, "trunk/empty") == 0);
+        assert(read_all(r, 3, "/trunk/a.txt/") == "hello\nworld\nworld\n");
+    }
+
+    // What converting r1 and r2 reads: the revisions, their
+    // properties, and the texts they change with their delta bases
+    {
+        fsfs r(repo.string());
+        std::string const pack = (db / "revs" / "0.pack" / "pack").string();
+        auto const e1 = r.read_ahead(1);
+        assert(e1.size() == 4);
+        assert(e1[0].filename == pack && e1[0].offset == rev0.size() && e1[0].length == rev1.size());
+        assert(e1[1].filename == (db / "revprops" / "0.pack" / "0.0").string());
+        assert(e1[2].filename == pack && e1[3].filename == pack);
+
+        std::uint64_t const a1_offset = std::stoull(a1_text.substr(2, a1_text.find(' ', 2) - 2));
+        auto const e2 = r.read_ahead(2);
+        assert(e2.size() == 4);
+        assert(e2[0].filename == (db / "revs" / "1" / "2").string() && e2[0].offset == 0);
+        assert(e2[1].filename == (db / "revprops" / "1" / "2").string());
+        assert(e2[2].filename == e2[0].filename);
+        assert(e2[3].filename == pack && e2[3].offset == rev0.size() + a1_offset);
+        assert(e2[3].length == std::string("PLAIN\nhello\n").size());
+    }
+
+    // Packing r2 and r3 behind the reader's back
+    {
+        fsfs r(repo.string());
+        assert(read_all(r, 3, "trunk/a.txt") == "hello\nworld\nworld\n");
+
+        std::ifstream in2((db / "revs" / "1" / "2").string().c_str(), std::ios::binary);
+        std::ifstream in3((db / "revs" / "1" / "3").string().c_str(), std::ios::binary);
+        std::string const data2((std::istreambuf_iterator<char>(in2)), std::istreambuf_iterator<char>());
+        std::string const data3((std::istreambuf_iterator<char>(in3)), std::istreambuf_iterator<char>());
+        write_file(db / "revs" / "1.pack" / "pack", data2 + data3);
+        write_file(db / "revs" / "1.pack" / "manifest", "0\n" + std::to_string(data2.size()) + "\n");
+        write_file(db / "min-unpacked-rev", "4\n");
+        fs::remove_all(db / "revs" / "1");
+
+        assert(r.changes(2).size() == 4);
+        assert(read_all(r, 2, "tags/t1/b.txt") == "bbb");
+    }
+
+    fs::remove_all(repo);
+    std::cout << "ok" << std::endl;
+}
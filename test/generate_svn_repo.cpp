@@ -0,0 +1,387 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Generate a synthetic SVN repository for benchmarking svn2git, using
+// the libsvn_fs API directly.  The layout is the usual one:
+//
+//   /trunk/<project>/d0/d1/.../f<n>.txt
+//   /branches/b<n>/<project>/...          copies of /trunk
+//   /tags/t<n>/<project>/...              copies of /trunk
+//
+// Besides the repository, this writes repositories.txt, a ruleset
+// mapping each project to its own Git repository, and benchmark.txt,
+// which records what was generated for the benchmark runner.
+#define SVN_DEPRECATED
+
+#include "apr_init.hpp"
+#include "apr_pool.hpp"
+#include "svn_error.hpp"
+
+#include <apr_hash.h>
+#include <svn_fs.h>
+#include <svn_repos.h>
+
+#include <boost/program_options.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+struct parameters
+{
+    std::string repo_path;
+    unsigned revisions;
+    unsigned projects;
+    unsigned files;             // initial files per project
+    unsigned depth;             // directory levels above each file
+    unsigned fanout;            // subdirectories per directory
+    unsigned changes;           // files modified per revision
+    unsigned branch_every;      // revisions between branch copies
+    unsigned tag_every;         // revisions between tag copies
+    std::size_t file_size;      // median file size
+    std::size_t max_file_size;
+    unsigned seed;
+};
+
+class generator
+{
+ public:
+    explicit generator(parameters const& p)
+        : p(p), rng(p.seed), content_bytes(0), revnum(0), branches(0), tags(0)
+    {
+        // File contents are slices of a block of pseudo-text, which
+        // compresses about as well as source code does
+        static char const* const words[] = {
+            "template", "class", "struct", "return", "const", "std::size_t", "if", "for",
+            "namespace", "boost", "typename", "void", "int", "while", "{", "}", ";", "\n"
+        };
+        std::uniform_int_distribution<std::size_t> word(0, sizeof(words) / sizeof(*words) - 1);
+        while (text.size() < p.max_file_size * 2)
+        {
+            text += words[word(rng)];
+            text += ' ';
+        }
+    }
+
+    void run();
+
+    std::uint64_t bytes_written() const { return content_bytes; }
+    unsigned branch_count() const { return branches; }
+    unsigned tag_count() const { return tags; }
+
+ private:
+    struct transaction;
+
+    std::size_t random_size();
+    void write_file(transaction& txn, std::string const& path);
+    void initial_tree(transaction& txn);
+    void copy_trunk(transaction& txn, std::string const& to);
+    void modify(transaction& txn);
+
+ private:
+    parameters const& p;
+    AprPool pool;
+    std::mt19937 rng;
+    std::string text;
+    std::uint64_t content_bytes;
+    svn_repos_t* repos;
+    svn_fs_t* fs;
+    svn_revnum_t revnum;
+    unsigned branches;
+    unsigned tags;
+
+    // The files on each line of development, by SVN path of the
+    // line (e.g. "/trunk"), relative to it
+    std::map<std::string, std::vector<std::string> > files;
+
+    // Directories where new files may be added, relative to a line
+    std::vector<std::string> leaf_dirs;
+};
+
+// A transaction against the latest revision, committed by commit()
+struct generator::transaction
+{
+    transaction(generator& g, char const* log_message)
+        : g(g), pool(g.pool.data())
+    {
+        check_svn(svn_fs_begin_txn2(&txn, g.fs, g.revnum, 0, pool.data()));
+        check_svn(svn_fs_txn_root(&root, txn, pool.data()));
+        check_svn(svn_fs_change_txn_prop(
+                      txn, "svn:author", svn_string_create("benchmark", pool.data()), pool.data()));
+        check_svn(svn_fs_change_txn_prop(
+                      txn, "svn:log", svn_string_create(log_message, pool.data()), pool.data()));
+    }
+
+    void commit()
+    {
+        char const* conflict = nullptr;
+        check_svn(svn_repos_fs_commit_txn(&conflict, g.repos, &g.revnum, txn, pool.data()));
+    }
+
+    generator& g;
+    AprPool pool;
+    svn_fs_txn_t* txn;
+    svn_fs_root_t* root;
+};
+
+// A log-normal distribution around the median, which gives the long
+// tail of large files real repositories have
+std::size_t generator::random_size()
+{
+    std::lognormal_distribution<double> size(std::log(double(std::max<std::size_t>(p.file_size, 1))), 1.0);
+    return std::min(std::size_t(size(rng)), p.max_file_size);
+}
+
+void generator::write_file(transaction& txn, std::string const& path)
+{
+    std::size_t length = random_size();
+    std::size_t offset = std::uniform_int_distribution<std::size_t>(0, text.size() - length)(rng);
+
+    svn_stream_t* stream;
+    check_svn(svn_fs_apply_text(&stream, txn.root, path.c_str(), nullptr, txn.pool.data()));
+    apr_size_t written = length;
+    check_svn(svn_stream_write(stream, text.data() + offset, &written));
+    check_svn(svn_stream_close(stream));
+    content_bytes += length;
+}
+
+void generator::initial_tree(transaction& txn)
+{
+    for (char const* dir : { "/trunk", "/branches", "/tags" })
+        check_svn(svn_fs_make_dir(txn.root, dir, txn.pool.data()));
+
+    // Build the directory skeleton of one project, breadth first
+    std::vector<std::string> level(1, "");
+    for (unsigned d = 0; d < p.depth; ++d)
+    {
+        std::vector<std::string> next;
+        for (auto const& parent : level)
+        {
+            for (unsigned i = 0; i < p.fanout; ++i)
+                next.push_back(parent + "/d" + std::to_string(i));
+        }
+        level.swap(next);
+    }
+
+    std::vector<std::string>& trunk = files["/trunk"];
+    for (unsigned project = 0; project < p.projects; ++project)
+    {
+        std::string const project_dir = "/p" + std::to_string(project);
+        check_svn(svn_fs_make_dir(txn.root, ("/trunk" + project_dir).c_str(), txn.pool.data()));
+
+        // Create the directories on the way to each leaf
+        for (auto const& leaf : level)
+        {
+            std::string dir = "/trunk" + project_dir;
+            for (std::size_t slash = 1; slash <= leaf.size(); slash = leaf.find('/', slash) + 1)
+            {
+                std::size_t end = leaf.find('/', slash);
+                if (end == std::string::npos)
+                    end = leaf.size();
+                std::string const sub = dir + leaf.substr(0, end);
+                svn_node_kind_t kind;
+                check_svn(svn_fs_check_path(&kind, txn.root, sub.c_str(), txn.pool.data()));
+                if (kind == svn_node_none)
+                    check_svn(svn_fs_make_dir(txn.root, sub.c_str(), txn.pool.data()));
+                if (end == leaf.size())
+                    break;
+            }
+            leaf_dirs.push_back(project_dir + leaf);
+        }
+
+        for (unsigned f = 0; f < p.files; ++f)
+        {
+            std::string const file = leaf_dirs[leaf_dirs.size() - level.size() + f % level.size()]
+                + "/f" + std::to_string(f) + ".txt";
+            check_svn(svn_fs_make_file(txn.root, ("/trunk" + file).c_str(), txn.pool.data()));
+            write_file(txn, "/trunk" + file);
+            trunk.push_back(file);
+        }
+    }
+}
+
+void generator::copy_trunk(transaction& txn, std::string const& to)
+{
+    svn_fs_root_t* from_root;
+    check_svn(svn_fs_revision_root(&from_root, fs, revnum, txn.pool.data()));
+    check_svn(svn_fs_copy(from_root, "/trunk", txn.root, to.c_str(), txn.pool.data()));
+}
+
+// Modify, add and delete a few files on a line of development
+void generator::modify(transaction& txn)
+{
+    // Most work happens on trunk
+    auto line = files.begin();
+    if (files.size() > 1 && std::uniform_int_distribution<int>(0, 4)(rng) == 0)
+        std::advance(line, std::uniform_int_distribution<std::size_t>(0, files.size() - 1)(rng));
+    std::vector<std::string>& line_files = line->second;
+
+    for (unsigned i = 0; i < p.changes && !line_files.empty(); ++i)
+    {
+        auto const& file = line_files[
+            std::uniform_int_distribution<std::size_t>(0, line_files.size() - 1)(rng)];
+        write_file(txn, line->first + file);
+    }
+
+    std::uniform_int_distribution<int> percent(0, 99);
+    if (percent(rng) < 10)
+    {
+        std::string const file = leaf_dirs[
+            std::uniform_int_distribution<std::size_t>(0, leaf_dirs.size() - 1)(rng)]
+            + "/n" + std::to_string(revnum) + ".txt";
+        check_svn(svn_fs_make_file(txn.root, (line->first + file).c_str(), txn.pool.data()));
+        write_file(txn, line->first + file);
+        line_files.push_back(file);
+    }
+    if (percent(rng) < 3 && line_files.size() > 1)
+    {
+        std::size_t victim = std::uniform_int_distribution<std::size_t>(0, line_files.size() - 1)(rng);
+        check_svn(svn_fs_delete(txn.root, (line->first + line_files[victim]).c_str(), txn.pool.data()));
+        line_files[victim] = line_files.back();
+        line_files.pop_back();
+    }
+}
+
+void generator::run()
+{
+    // Subversion 1.9 and later default to logically addressed FSFS,
+    // which the native reader in fsfs.cpp can't read
+    apr_hash_t* fs_config = apr_hash_make(pool.data());
+    apr_hash_set(fs_config, "compatible-version", APR_HASH_KEY_STRING, "1.8");
+    check_svn(svn_repos_create(&repos, p.repo_path.c_str(), nullptr, nullptr, nullptr, fs_config,
+                               pool.data()));
+    fs = svn_repos_fs(repos);
+    check_svn(svn_fs_youngest_rev(&revnum, fs, pool.data()));
+
+    {
+        transaction txn(*this, "Initial import");
+        initial_tree(txn);
+        txn.commit();
+    }
+
+    while (unsigned(revnum) < p.revisions)
+    {
+        unsigned const next = revnum + 1;
+        if (p.branch_every && next % p.branch_every == 0)
+        {
+            std::string const branch = "/branches/b" + std::to_string(++branches);
+            transaction txn(*this, ("Create branch " + branch).c_str());
+            copy_trunk(txn, branch);
+            files[branch] = files["/trunk"];
+            txn.commit();
+        }
+        else if (p.tag_every && next % p.tag_every == 0)
+        {
+            std::string const tag = "/tags/t" + std::to_string(++tags);
+            transaction txn(*this, ("Create tag " + tag).c_str());
+            copy_trunk(txn, tag);
+            txn.commit();
+        }
+        else
+        {
+            transaction txn(*this, "Modify files");
+            modify(txn);
+            txn.commit();
+        }
+    }
+}
+
+// A ruleset sending each project to a repository of its own
+void write_rules(std::string const& filename, parameters const& p, generator const& g)
+{
+    std::ofstream rules(filename.c_str());
+    for (unsigned project = 0; project < p.projects; ++project)
+    {
+        std::string const dir = "p" + std::to_string(project);
+        rules << "repository " << dir << "\n{\n  branches\n  {\n"
+              << "    [:] \"/trunk/" << dir << "/\" : \"master\";\n";
+        for (unsigned b = 1; b <= g.branch_count(); ++b)
+            rules << "    [:] \"/branches/b" << b << "/" << dir << "/\" : \"b" << b << "\";\n";
+        rules << "  }\n";
+        if (g.tag_count() > 0)
+        {
+            rules << "  tags\n  {\n";
+            for (unsigned t = 1; t <= g.tag_count(); ++t)
+                rules << "    [:] \"/tags/t" << t << "/" << dir << "/\" : \"t" << t << "\";\n";
+            rules << "  }\n";
+        }
+        rules << "}\n\n";
+    }
+    if (!rules.flush())
+        throw std::runtime_error("error writing " + filename);
+}
+
+int main(int argc, char** argv)
+{
+    parameters p;
+    std::string rules_file;
+
+    namespace po = boost::program_options;
+    po::options_description program_options("Allowed options");
+    program_options.add_options()
+        ("help,h", "produce help message")
+        ("repo", po::value(&p.repo_path)->value_name("PATH")->required(),
+         "SVN repository to create")
+        ("rules", po::value(&rules_file)->value_name("FILENAME"),
+         "where to write the ruleset; default: <repo>/repositories.txt")
+        ("revisions", po::value(&p.revisions)->default_value(1000), "number of revisions")
+        ("projects", po::value(&p.projects)->default_value(4), "number of projects, each one Git repository")
+        ("files", po::value(&p.files)->default_value(200), "initial number of files per project")
+        ("depth", po::value(&p.depth)->default_value(3), "directory depth of the files in a project")
+        ("fanout", po::value(&p.fanout)->default_value(4), "subdirectories per directory")
+        ("changes", po::value(&p.changes)->default_value(5), "files modified per revision")
+        ("branch-every", po::value(&p.branch_every)->default_value(100),
+         "revisions between branch copies; 0 for none")
+        ("tag-every", po::value(&p.tag_every)->default_value(250),
+         "revisions between tag copies; 0 for none")
+        ("file-size", po::value(&p.file_size)->default_value(4096), "median file size in bytes")
+        ("max-file-size", po::value(&p.max_file_size)->default_value(1 << 20), "largest file size in bytes")
+        ("seed", po::value(&p.seed)->default_value(1), "random seed")
+        ;
+
+    try
+    {
+        po::variables_map variables;
+        store(po::command_line_parser(argc, argv).options(program_options).run(), variables);
+        if (variables.count("help"))
+        {
+            std::cout << program_options << std::endl;
+            return EXIT_SUCCESS;
+        }
+        notify(variables);
+        if (p.projects == 0 || p.fanout == 0)
+            throw std::runtime_error("--projects and --fanout must be positive");
+        if (rules_file.empty())
+            rules_file = p.repo_path + "/repositories.txt";
+
+        AprInit apr_init;
+
+        generator g(p);
+        g.run();
+        write_rules(rules_file, p, g);
+
+        std::ofstream info((p.repo_path + "/benchmark.txt").c_str());
+        info << "revisions " << p.revisions << "\n"
+             << "content_bytes " << g.bytes_written() << "\n"
+             << "rules " << rules_file << "\n";
+        if (!info.flush())
+            throw std::runtime_error("error writing benchmark.txt");
+
+        std::cout << "generated " << p.revisions << " revisions, "
+                  << g.bytes_written() / (1 << 20) << " MiB of file contents in "
+                  << p.repo_path << std::endl;
+        return EXIT_SUCCESS;
+    }
+    catch (std::exception const& error)
+    {
+        std::cerr << error.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,192 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Checks the Git subtree index, at revisions on either side of the
+// rules' transitions, against a scan of every rule and against the
+// rule matcher's string search.  The string search misses rules that
+// share a Git address with another, and rules beneath a directory
+// that no rule maps into, so the index must only find everything it
+// does.
+
+#undef NDEBUG
+#include "ruleset.hpp"
+#include "options.hpp"
+
+#include <boost/filesystem.hpp>
+#include <boost/function_output_iterator.hpp>
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+#include <string>
+#include <vector>
+
+Options options;
+
+namespace {
+
+char const rules_text[] =
+    "repository boost\n"
+    "{\n"
+    "  content\n"
+    "  {\n"
+    "    \"boost/\" : \"include/boost/\";\n"
+    "    \"libs/foo/\" : \"libs/foo\";\n"
+    "    \"libs/bar/\" : \"libs/bar\";\n"
+    "  }\n"
+    "  branches\n"
+    "  {\n"
+    "    [   :  99] \"/trunk/\" : \"master\";\n"
+    "    [100:    ] \"/devel/\" : \"master\";\n"
+    "    [ 50: 120] \"/sandbox/\" : \"master\";\n"
+    "    [   :    ] \"/branches/x/\" : \"x\";\n"
+    "  }\n"
+    "}\n"
+    "\n"
+    "repository tools\n"
+    "{\n"
+    "  minrev 30;\n"
+    "  maxrev 149;\n"
+    "  branches\n"
+    "  {\n"
+    "    [:] \"/trunk/tools/\" : \"master\";\n"
+    "  }\n"
+    "}\n";
+
+std::vector<Rule const*> sorted(std::vector<Rule const*> rules)
+{
+    std::sort(rules.begin(), rules.end());
+    return rules;
+}
+
+// The rules in effect during revision that map into the subtree of
+// match's Git ref at git_path
+std::vector<Rule const*> scan(
+    Ruleset const& ruleset, Rule const& match, path const& git_path, std::size_t revision)
+{
+    std::vector<Rule const*> result;
+    for (auto const& r : ruleset.matcher().all_rules())
+    {
+        if (r.git_repo_name() == match.git_repo_name()
+            && r.git_ref_name() == match.git_ref_name()
+            && r.git_path().starts_with(git_path)
+            && r.min <= revision && revision <= r.max)
+        {
+            result.push_back(&r);
+        }
+    }
+    return sorted(result);
+}
+
+bool includes(std::vector<Rule const*> const& rules, std::vector<Rule const*> const& subset)
+{
+    return std::includes(rules.begin(), rules.end(), subset.begin(), subset.end());
+}
+
+// The rules the matcher finds in the subtree of match's Git ref at
+// git_path, during revision
+std::vector<Rule const*> search(
+    Ruleset const& ruleset, Rule const& match, path const& git_path, std::size_t revision)
+{
+    std::vector<Rule const*> result;
+    ruleset.matcher().git_subtree_rules(
+        match.git_repo_name() + ":" + match.git_ref_name() + ":" + git_path.str(),
+        revision,
+        boost::make_function_output_iterator([&](Rule const* r) { result.push_back(r); }));
+    return sorted(result);
+}
+
+}
+
+int main()
+{
+    namespace fs = boost::filesystem;
+    fs::path const rules_file = fs::temp_directory_path() / fs::unique_path();
+    {
+        std::ofstream out(rules_file.string().c_str());
+        out << rules_text;
+    }
+    options.rules_file = rules_file.string();
+    Ruleset const ruleset(rules_file.string());
+    fs::remove(rules_file);
+
+    git_subtree_index const& index = ruleset.git_index();
+    std::size_t const revisions[]
+        = { 0, 1, 29, 30, 49, 50, 99, 100, 101, 120, 121, 149, 150, 1000 };
+
+    // Every Git directory some rule maps into, or that contains one
+    std::vector<path> git_paths;
+    for (auto const& r : ruleset.matcher().all_rules())
+    {
+        std::string p = r.git_path().str();
+        for (;;)
+        {
+            if (std::find(git_paths.begin(), git_paths.end(), path(p)) == git_paths.end())
+                git_paths.push_back(path(p));
+            if (p.empty())
+                break;
+            std::string::size_type const slash = p.rfind('/');
+            p.erase(slash == std::string::npos ? 0 : slash);
+        }
+    }
+
+    std::size_t searched = 0;
+    for (auto const& r : ruleset.matcher().all_rules())
+    {
+        for (auto const& git_path : git_paths)
+        {
+            for (std::size_t i = 1; i < sizeof(revisions) / sizeof(*revisions); ++i)
+            {
+                std::size_t const before = revisions[i - 1], after = revisions[i];
+
+                // Alternate between the two revisions, as when
+                // comparing a tree across a transition, so each lookup
+                // after the first two is answered from the cache
+                for (int pass = 0; pass < 2; ++pass)
+                {
+                    std::size_t const revs[] = { before, after };
+                    for (auto rev : revs)
+                    {
+                        std::vector<Rule const*> const found
+                            = sorted(index.subtree_rules(r, git_path, rev));
+                        assert(found == scan(ruleset, r, git_path, rev));
+                        std::vector<Rule const*> const old = search(ruleset, r, git_path, rev);
+                        assert(includes(found, old));
+                        searched += old.size();
+                    }
+                }
+            }
+        }
+    }
+    assert(searched > 0);
+
+    // Spot checks: at the transition to /devel/, the trunk rules give
+    // way to the devel ones beneath the same Git paths
+    for (auto const& r : ruleset.matcher().all_rules())
+    {
+        if (r.git_repo_name() != "boost" || r.git_ref_name() != "refs/heads/master"
+            || r.git_path().str() != "libs/foo")
+        {
+            continue;
+        }
+
+        std::vector<Rule const*> const at99 = index.subtree_rules(r, path("libs"), 99);
+        std::vector<Rule const*> const at100 = index.subtree_rules(r, path("libs"), 100);
+        std::vector<Rule const*> const at121 = index.subtree_rules(r, path("libs"), 121);
+
+        // trunk and sandbox, then devel and sandbox, then devel alone;
+        // each maps libs/foo and libs/bar
+        assert(at99.size() == 4);
+        assert(at100.size() == 4);
+        assert(at121.size() == 2);
+        for (auto m : at99)
+            assert(m->branch_rule->svn_path != "devel");
+        for (auto m : at100)
+            assert(m->branch_rule->svn_path != "trunk");
+        for (auto m : at121)
+            assert(m->branch_rule->svn_path == "devel");
+
+        // A path no rule maps into
+        assert(index.subtree_rules(r, path("libs/baz"), 100).empty());
+    }
+}
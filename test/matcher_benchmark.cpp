@@ -0,0 +1,434 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Microbenchmarks for the rule matcher and the path types, run over a
+// real ruleset:
+//
+//   matcher_benchmark --rules repositories.txt [--paths FILE]
+//
+// Each line of a paths file is "<revision> <svn path>"; without one,
+// paths are generated beneath the ruleset's branch directories.  For
+// each operation we report the time, heap allocations and (where
+// perf_event_open is allowed) cache misses per operation, taking the
+// fastest of several runs.  Batch matching is measured over the
+// entries of a single large directory.
+#include "ruleset.hpp"
+#include "options.hpp"
+#include "path_set.hpp"
+
+#include <boost/function_output_iterator.hpp>
+#include <boost/program_options.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <new>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+Options options;
+
+// Count every heap allocation in the program
+static std::uint64_t allocations = 0;
+
+void* operator new(std::size_t size)
+{
+    ++allocations;
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+namespace {
+
+// A hardware event counter for this thread, or nothing if the kernel
+// won't give us one
+struct perf_counter
+{
+    perf_counter(std::uint32_t type, std::uint64_t config)
+    {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = int(::syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+    ~perf_counter()
+    {
+        if (fd >= 0)
+            ::close(fd);
+    }
+
+    bool available() const { return fd >= 0; }
+
+    void start()
+    {
+        if (fd < 0)
+            return;
+        ::ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ::ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    std::uint64_t stop()
+    {
+        std::uint64_t count = 0;
+        if (fd < 0)
+            return count;
+        ::ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (::read(fd, &count, sizeof(count)) != sizeof(count))
+            count = 0;
+        return count;
+    }
+
+ private:
+    perf_counter(perf_counter const&);
+    int fd;
+};
+
+struct sample
+{
+    std::size_t revision;
+    std::string svn_path;
+};
+
+struct measurement
+{
+    double ns;
+    double allocations;
+    double cache_misses;
+};
+
+// Run f, which performs ops operations, iterations times, and report
+// the fastest run
+template <class F>
+void measure(char const* name, std::size_t ops, unsigned iterations, F f)
+{
+    static perf_counter cache_misses(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+
+    measurement best = { 0, 0, 0 };
+    for (unsigned i = 0; i < iterations; ++i)
+    {
+        std::uint64_t const allocations0 = allocations;
+        cache_misses.start();
+        auto const start = std::chrono::steady_clock::now();
+        f();
+        auto const finish = std::chrono::steady_clock::now();
+        std::uint64_t const misses = cache_misses.stop();
+
+        measurement m = {
+            std::chrono::duration<double, std::nano>(finish - start).count() / ops,
+            double(allocations - allocations0) / ops,
+            double(misses) / ops
+        };
+        if (i == 0 || m.ns < best.ns)
+            best = m;
+    }
+
+    std::cout << std::left << std::setw(28) << name << std::right
+              << std::setw(10) << ops
+              << std::fixed << std::setprecision(1) << std::setw(12) << best.ns
+              << std::setprecision(2) << std::setw(12) << best.allocations;
+    if (cache_misses.available())
+        std::cout << std::setw(14) << best.cache_misses;
+    else
+        std::cout << std::setw(14) << "n/a";
+    std::cout << std::endl;
+}
+
+std::vector<sample> read_samples(std::string const& filename)
+{
+    std::ifstream in(filename.c_str());
+    if (!in)
+        throw std::runtime_error("cannot read " + filename);
+
+    std::vector<sample> samples;
+    sample s;
+    while (in >> s.revision && std::getline(in >> std::ws, s.svn_path))
+        samples.push_back(s);
+    return samples;
+}
+
+// Paths beneath the SVN directories of the ruleset's rules, at
+// revisions where those are in effect, plus some that match nothing
+std::vector<sample> generate_samples(
+    Ruleset const& ruleset, std::size_t count, std::size_t max_revision, unsigned seed)
+{
+    struct target
+    {
+        boost2git::BranchRule const* branch;
+        std::vector<boost2git::ContentRule> const* content;
+    };
+    std::vector<target> targets;
+    for (auto const& repo : ruleset.repositories())
+    {
+        boost2git::RepoRule key;
+        key.git_repo_name = repo.name;
+        auto const repo_rule = ruleset.getAST().find(key);
+        for (auto const b : repo.branches)
+        {
+            target t = { b, &repo_rule->content_rules };
+            targets.push_back(t);
+        }
+    }
+    if (targets.empty())
+        throw std::runtime_error("the ruleset has no branches");
+
+    static char const* const components[] = {
+        "boost", "libs", "detail", "test", "doc", "src", "include", "impl", "example", "build"
+    };
+    std::size_t const n_components = sizeof(components) / sizeof(*components);
+
+    std::mt19937 rng(seed);
+    std::vector<sample> samples;
+    samples.reserve(count);
+    while (samples.size() < count)
+    {
+        sample s;
+        std::string suffix;
+        for (int depth = std::uniform_int_distribution<int>(0, 5)(rng); depth > 0; --depth)
+            suffix += std::string("/") + components[rng() % n_components];
+        suffix += "/file" + std::to_string(rng() % 100) + ".cpp";
+
+        if (rng() % 10 == 0)
+        {
+            s.revision = 1 + rng() % max_revision;
+            s.svn_path = "unmapped" + suffix;
+        }
+        else
+        {
+            target const& t = targets[rng() % targets.size()];
+            std::size_t const last = std::min(t.branch->max, max_revision);
+            s.revision = std::uniform_int_distribution<std::size_t>(
+                std::min(t.branch->min, last), last)(rng);
+            path prefix = t.branch->svn_path;
+            if (!t.content->empty())
+                prefix = prefix / (*t.content)[rng() % t.content->size()].svn_path;
+            s.svn_path = prefix.str() + suffix;
+        }
+        samples.push_back(s);
+    }
+    return samples;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    std::string paths_file;
+    std::size_t count, max_revision, batch, dir_entries;
+    unsigned iterations, seed;
+
+    namespace po = boost::program_options;
+    po::options_description program_options("Allowed options");
+    program_options.add_options()
+        ("help,h", "produce help message")
+        ("rules", po::value(&options.rules_file)->value_name("FILENAME")->required(),
+         "the ruleset to match against")
+        ("paths", po::value(&paths_file)->value_name("FILENAME"),
+         "lines of \"<revision> <svn path>\" to match; by default, paths are generated")
+        ("count", po::value(&count)->default_value(100000), "number of paths to generate")
+        ("max-revision", po::value(&max_revision)->default_value(86000),
+         "latest revision of generated paths")
+        ("batch", po::value(&batch)->default_value(1000),
+         "paths inserted into each path_set, as in one revision")
+        ("dir-entries", po::value(&dir_entries)->default_value(10000),
+         "entries of the directory matched as a batch")
+        ("iterations", po::value(&iterations)->default_value(5), "runs of each benchmark")
+        ("seed", po::value(&seed)->default_value(1), "random seed for generated paths")
+        ;
+
+    try
+    {
+        po::variables_map variables;
+        store(po::command_line_parser(argc, argv).options(program_options).run(), variables);
+        if (variables.count("help"))
+        {
+            std::cout << program_options << std::endl;
+            return EXIT_SUCCESS;
+        }
+        notify(variables);
+        iterations = std::max(iterations, 1u);
+        batch = std::max<std::size_t>(batch, 1);
+
+        auto const load_start = std::chrono::steady_clock::now();
+        Ruleset ruleset(options.rules_file);
+        std::cout << "loaded " << options.rules_file << " in "
+                  << std::chrono::duration<double, std::milli>(
+                      std::chrono::steady_clock::now() - load_start).count()
+                  << " ms" << std::endl;
+        auto const& matcher = ruleset.matcher();
+
+        std::vector<sample> const samples = paths_file.empty()
+            ? generate_samples(ruleset, count, max_revision, seed)
+            : read_samples(paths_file);
+        if (samples.empty())
+            throw std::runtime_error("no paths to match");
+
+        // Inputs for the subtree searches, prepared the way the
+        // importer does: the parent directory of each path, and the
+        // Git address each matched path maps to
+        std::vector<std::string> svn_dirs, git_addresses;
+        std::vector<std::size_t> git_revisions;
+        std::vector<Rule const*> git_matches;
+        std::vector<path> git_paths;
+        std::vector<path> paths;
+        std::size_t matched = 0;
+        for (auto const& s : samples)
+        {
+            std::string::size_type slash = s.svn_path.rfind('/');
+            svn_dirs.push_back(s.svn_path.substr(0, slash == std::string::npos ? 0 : slash));
+            paths.push_back(s.svn_path);
+            if (Rule const* match = matcher.longest_match(s.svn_path, s.revision))
+            {
+                ++matched;
+                path const suffix = path(s.svn_path).sans_prefix(match->svn_path());
+                git_addresses.push_back(
+                    match->git_address() + (match->git_path().str().empty() ? "" : "/") + suffix.str());
+                git_revisions.push_back(s.revision);
+                git_matches.push_back(match);
+                git_paths.push_back(match->git_path() / suffix);
+            }
+        }
+        std::cout << samples.size() << " paths, " << matched << " matched" << std::endl;
+
+        std::cout << std::left << std::setw(28) << "operation" << std::right
+                  << std::setw(10) << "ops" << std::setw(12) << "ns/op"
+                  << std::setw(12) << "allocs/op" << std::setw(14) << "misses/op" << std::endl;
+
+        // Keeps the optimizer from discarding results
+        std::size_t volatile sink = 0;
+        auto count_rules = boost::make_function_output_iterator([&](Rule const*) { ++sink; });
+
+        measure("longest_match", samples.size(), iterations, [&]{
+                for (auto const& s : samples)
+                    sink += matcher.longest_match(s.svn_path, s.revision) != nullptr;
+            });
+
+        measure("svn_subtree_rules", samples.size(), iterations, [&]{
+                for (std::size_t i = 0; i < samples.size(); ++i)
+                    matcher.svn_subtree_rules(svn_dirs[i], samples[i].revision, count_rules);
+            });
+
+        if (!git_addresses.empty())
+        {
+            measure("git_subtree_rules", git_addresses.size(), iterations, [&]{
+                    for (std::size_t i = 0; i < git_addresses.size(); ++i)
+                        matcher.git_subtree_rules(git_addresses[i], git_revisions[i], count_rules);
+                });
+
+            measure("git_index subtree_rules", git_matches.size(), iterations, [&]{
+                    for (std::size_t i = 0; i < git_matches.size(); ++i)
+                    {
+                        sink += ruleset.git_index().subtree_rules(
+                            *git_matches[i], git_paths[i], git_revisions[i]).size();
+                    }
+                });
+        }
+
+        // The entries of one large directory, matched one by one and
+        // as a batch, as the importer does when converting a tree.  We
+        // use the directory holding the most rules' SVN paths, padded
+        // with entries that match no further rule.
+        {
+            std::map<std::string, std::set<std::string> > children;
+            for (auto const& repo : ruleset.repositories())
+            {
+                for (auto const b : repo.branches)
+                {
+                    std::string const p = path(b->svn_path).str();
+                    std::string::size_type slash = p.rfind('/');
+                    if (slash == std::string::npos)
+                        children[""].insert(p);
+                    else
+                        children[p.substr(0, slash)].insert(p.substr(slash + 1));
+                }
+            }
+            auto const largest = std::max_element(
+                children.begin(), children.end(),
+                [](std::pair<std::string const, std::set<std::string> > const& lhs,
+                   std::pair<std::string const, std::set<std::string> > const& rhs)
+                { return lhs.second.size() < rhs.second.size(); });
+            std::string const dir = largest == children.end() ? "" : largest->first;
+            std::size_t const revision = max_revision;
+
+            std::vector<std::string> names;
+            if (largest != children.end())
+                names.assign(largest->second.begin(), largest->second.end());
+            for (std::size_t n = 0; names.size() < dir_entries; ++n)
+                names.push_back("entry" + std::to_string(n) + ".cpp");
+            std::sort(names.begin(), names.end());
+
+            std::vector<std::string> entry_paths;
+            for (auto const& name : names)
+                entry_paths.push_back(dir.empty() ? name : dir + "/" + name);
+
+            std::vector<Rule const*> matches(names.size());
+            matcher.longest_matches(dir, names.begin(), names.end(), revision, matches.begin());
+            for (std::size_t n = 0; n < names.size(); ++n)
+            {
+                if (matches[n] != matcher.longest_match(entry_paths[n], revision))
+                    throw std::runtime_error("longest_matches disagrees with longest_match for " + entry_paths[n]);
+            }
+
+            measure("longest_match (one dir)", names.size(), iterations, [&]{
+                    for (auto const& p : entry_paths)
+                        sink += matcher.longest_match(p, revision) != nullptr;
+                });
+
+            measure("longest_matches (one dir)", names.size(), iterations, [&]{
+                    matcher.longest_matches(dir, names.begin(), names.end(), revision, matches.begin());
+                    sink += matches.back() != nullptr;
+                });
+        }
+
+        measure("path construction", samples.size(), iterations, [&]{
+                for (auto const& s : samples)
+                    sink += path(s.svn_path).str().size();
+            });
+
+        measure("path::starts_with", samples.size(), iterations, [&]{
+                for (std::size_t i = 0; i < paths.size(); ++i)
+                    sink += paths[i].starts_with(paths[(i * 7919) % paths.size()]);
+            });
+
+        measure("path_set::insert", paths.size(), iterations, [&]{
+                path_set s;
+                for (std::size_t i = 0; i < paths.size(); ++i)
+                {
+                    if (i % batch == 0)
+                        s.clear();
+                    s.insert(paths[i]);
+                }
+                sink += s.size();
+            });
+        return EXIT_SUCCESS;
+    }
+    catch (std::exception const& error)
+    {
+        std::cerr << error.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
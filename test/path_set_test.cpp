@@ -4,8 +4,102 @@
 
 #undef NDEBUG
 #include "path_set.hpp"
+#include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+// The obvious implementation, to check against
+std::set<std::string> reference_insert(std::set<std::string> const& s, path const& p)
+{
+    for (auto const& x : s)
+    {
+        if (p.starts_with(x))
+            return s;
+    }
+    std::set<std::string> result;
+    for (auto const& x : s)
+    {
+        if (!path(x).starts_with(p))
+            result.insert(x);
+    }
+    result.insert(p.str());
+    return result;
+}
+
+path random_path(std::mt19937& rng)
+{
+    // Few distinct components, so that paths often nest
+    static char const* const components[] = { "a", "b", "ab", "a-b", "c", "b.c" };
+    std::string result;
+    for (int depth = std::uniform_int_distribution<int>(0, 4)(rng); depth > 0; --depth)
+    {
+        if (!result.empty())
+            result += '/';
+        result += components[rng() % (sizeof(components) / sizeof(*components))];
+    }
+    return result;
+}
+
+void randomized_test()
+{
+    std::mt19937 rng(42);
+    for (int trial = 0; trial < 200; ++trial)
+    {
+        path_set s;
+        std::set<std::string> expected;
+        for (int i = 0; i < 50; ++i)
+        {
+            path p = random_path(rng);
+            std::set<std::string> next = reference_insert(expected, p);
+            bool const added = next.count(p.str()) && !expected.count(p.str());
+            assert(s.insert(p) == added);
+            expected.swap(next);
+            assert(s.size() == expected.size());
+        }
+
+        for (int i = 0; i < 50; ++i)
+        {
+            path const p = random_path(rng);
+            bool covered = false;
+            for (auto const& e : expected)
+                covered = covered || p.starts_with(e);
+            assert(s.contains(p) == covered);
+        }
+
+        std::set<std::string> actual;
+        for (auto const& p : s)
+            assert(actual.insert(p.str()).second);
+        assert(actual == expected);
+    }
+}
+
+// Tens of thousands of paths in a revision must not take quadratic time
+void timing_test()
+{
+    std::vector<path> paths;
+    for (int i = 0; i < 200; ++i)
+    {
+        for (int j = 0; j < 500; ++j)
+            paths.push_back("trunk/libs/lib" + std::to_string(i) + "/src/file" + std::to_string(j) + ".cpp");
+    }
+    std::shuffle(paths.begin(), paths.end(), std::mt19937(1));
+
+    auto const start = std::chrono::steady_clock::now();
+    path_set s;
+    for (auto const& p : paths)
+        s.insert(p);
+    assert(s.size() == paths.size());
+    s.insert("trunk/libs");
+    assert(s.size() == 1);
+    double const ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+    std::cout << "inserted " << paths.size() << " paths in " << ms << " ms" << std::endl;
+}
 
 int main()
 {
@@ -20,6 +114,8 @@ int main()
 
     path_set expected = { "x/foo", "y/bar", "y/fu" };
     assert(s == expected);
+    assert(s.contains("x/foo") && s.contains("x/foo/bar") && s.contains("y/fu/bar"));
+    assert(!s.contains("x") && !s.contains("x/fo") && !s.contains("y/bar2") && !s.contains(""));
 
     path_set s1;
     s1.insert("/website/public_html/live/");
@@ -30,4 +126,12 @@ int main()
     for (auto p : s1)
         std::cout << p << std::endl;
     assert(s1 == expected1);
+
+    path_set s2 = { "x", "y/z" };
+    assert(s2.insert(""));
+    assert(s2.size() == 1 && s2.begin()->str().empty());
+    assert(!s2.insert("x"));
+
+    randomized_test();
+    timing_test();
 }
@@ -75,4 +75,25 @@ int main()
         assert(*p.longest_match(test, 2) == rules[2]);
         assert(p.longest_match(test, 5) == 0);
     }
+
+    // Batch matching agrees with matching each path separately
+    {
+        std::string const dirs[] = { "", "abra", "abra/cadabra", "abracadabra", "quantico" };
+        std::string const names[] = {
+            "", "abra", "cadabra", "cadaver", "hams", "hams/on", "sives", "x"
+        };
+        for (auto const& dir : dirs)
+        {
+            for (std::size_t rev = 0; rev < 7; ++rev)
+            {
+                Rule const* matches[8];
+                p.longest_matches(dir, names, names + 8, rev, matches);
+                for (std::size_t i = 0; i < 8; ++i)
+                {
+                    std::string const test = dir.empty() ? names[i] : dir + "/" + names[i];
+                    assert(matches[i] == p.longest_match(test, rev));
+                }
+            }
+        }
+    }
 };
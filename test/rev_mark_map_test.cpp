@@ -0,0 +1,90 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#undef NDEBUG
+#include "rev_mark_map.hpp"
+#include <cassert>
+#include <cstdlib>
+#include <map>
+
+// Check m against a reference implementation built on std::map
+void check(rev_mark_map const& m, std::map<std::size_t, std::size_t> const& expected)
+{
+    assert(m.size() == expected.size());
+    if (expected.empty())
+    {
+        assert(m.empty());
+        return;
+    }
+    assert(m.back().first == expected.rbegin()->first);
+    assert(m.back().second == expected.rbegin()->second);
+
+    auto p = expected.begin();
+    m.for_each(
+        [&](std::size_t rev, std::size_t mark)
+        {
+            assert(p != expected.end());
+            assert(p->first == rev && p->second == mark);
+            ++p;
+        });
+    assert(p == expected.end());
+
+    for (std::size_t rev = 0; rev <= expected.rbegin()->first + 1; ++rev)
+    {
+        auto q = expected.upper_bound(rev);
+        std::size_t mark = q == expected.begin() ? 0 : std::prev(q)->second;
+        assert(m.mark_at_or_before(rev) == mark);
+    }
+}
+
+int main()
+{
+    rev_mark_map m;
+    assert(m.empty());
+    assert(m.mark_at_or_before(100) == 0);
+
+    m.push_back(5, 1);
+    m.push_back(7, 3);
+    assert(m.mark_at_or_before(4) == 0);
+    assert(m.mark_at_or_before(5) == 1);
+    assert(m.mark_at_or_before(6) == 1);
+    assert(m.mark_at_or_before(7) == 3);
+    m.pop_back();
+    assert(m.back() == std::make_pair(std::size_t(5), std::size_t(1)));
+    m.pop_back();
+    assert(m.empty());
+
+    // Random appends, with occasional pops, spanning many blocks and
+    // including deltas too large for a single byte.
+    std::srand(42);
+    std::map<std::size_t, std::size_t> expected;
+    std::size_t rev = 0, mark = 0;
+    for (int i = 0; i < 3000; ++i)
+    {
+        if (!expected.empty() && std::rand() % 5 == 0)
+        {
+            expected.erase(std::prev(expected.end()));
+            m.pop_back();
+        }
+        else
+        {
+            rev += 1 + (std::rand() % 8 == 0 ? std::rand() % 100000 : std::rand() % 3);
+            mark += 1 + std::rand() % 300;
+            expected[rev] = mark;
+            m.push_back(rev, mark);
+        }
+        if (i % 250 == 0)
+            check(m, expected);
+    }
+    check(m, expected);
+
+    while (!expected.empty())
+    {
+        expected.erase(std::prev(expected.end()));
+        m.pop_back();
+        if (expected.size() % 61 == 0)
+            check(m, expected);
+    }
+    check(m, expected);
+}
@@ -0,0 +1,57 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#undef NDEBUG
+#include "spool.hpp"
+
+#include <boost/filesystem.hpp>
+#include <cassert>
+#include <fstream>
+#include <set>
+#include <string>
+
+namespace fs = boost::filesystem;
+
+// The names of the repositories spooled beneath dir, found the way
+// svn2git-replay does
+std::set<std::string> spooled_names(std::string const& dir)
+{
+    std::set<std::string> result;
+    for (fs::recursive_directory_iterator p(dir), end; p != end; ++p)
+    {
+        if (fs::is_regular_file(p->status()))
+            result.insert(spool::repo_name(dir, p->path().string()));
+    }
+    return result;
+}
+
+int main()
+{
+    assert(spool::repo_name("sp", "sp/boost.fi.gz") == "boost");
+    assert(spool::repo_name("sp/", "sp/boost.fi.gz") == "boost");
+    assert(spool::repo_name("sp//", "sp//boost.fi.gz") == "boost");
+    assert(spool::repo_name("sp/", "sp/sub/x.fi.gz") == "sub/x");
+    assert(spool::repo_name(".", "./boost.fi.gz") == "boost");
+    assert(spool::repo_name("/", "/boost.fi.gz") == "boost");
+    assert(spool::repo_name("sp", "sp/.fi.gz") == "");
+
+    // Each name round-trips through the file's path
+    assert(spool::repo_name("sp", spool::file_path("sp", "sub/x")) == "sub/x");
+    assert(spool::repo_name("sp/", spool::file_path("sp/", "sub/x")) == "sub/x");
+
+    // The paths a directory iteration yields, with and without a
+    // trailing separator on the directory
+    fs::path const dir = fs::temp_directory_path() / fs::unique_path();
+    fs::create_directories(dir / "sub");
+    std::ofstream((dir / "boost.fi.gz").string().c_str());
+    std::ofstream((dir / "sub" / "x.fi.gz").string().c_str());
+
+    std::set<std::string> expected;
+    expected.insert("boost");
+    expected.insert("sub/x");
+    assert(spooled_names(dir.string()) == expected);
+    assert(spooled_names(dir.string() + "/") == expected);
+
+    fs::remove_all(dir);
+}
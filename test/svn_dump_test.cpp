@@ -0,0 +1,238 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Reads a small svn dump, written out by hand, plain and compressed:
+// full and delta texts, property-only changes, copies from earlier
+// revisions, replacements, and changes that cancel out within a
+// revision.
+#undef NDEBUG
+#include "svn_dump.hpp"
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/file_descriptor.hpp>
+#include <boost/iostreams/filter/bzip2.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace fs = boost::filesystem;
+namespace iostreams = boost::iostreams;
+
+namespace {
+
+typedef std::map<std::string, std::string> properties;
+
+std::string props(properties const& p)
+{
+    std::string result;
+    for (auto const& kv : p)
+    {
+        result += "K " + std::to_string(kv.first.size()) + "\n" + kv.first + "\n";
+        result += "V " + std::to_string(kv.second.size()) + "\n" + kv.second + "\n";
+    }
+    return result + "PROPS-END\n";
+}
+
+std::string revision(long rev, std::string const& log)
+{
+    properties p;
+    p["svn:date"] = "2013-07-28T12:00:0" + std::to_string(rev) + ".000000Z";
+    if (rev > 0)
+    {
+        p["svn:author"] = "alice";
+        p["svn:log"] = log;
+    }
+    std::string const content = props(p);
+    return "Revision-number: " + std::to_string(rev) + "\n"
+        + "Prop-content-length: " + std::to_string(content.size()) + "\n"
+        + "Content-length: " + std::to_string(content.size()) + "\n\n"
+        + content + "\n";
+}
+
+// A node record; text is omitted if has_text is false
+std::string node(
+    std::string const& headers, std::string const& prop_block = std::string(),
+    bool has_text = false, std::string const& text = std::string())
+{
+    std::string result = headers;
+    if (!prop_block.empty())
+        result += "Prop-content-length: " + std::to_string(prop_block.size()) + "\n";
+    if (has_text)
+        result += "Text-content-length: " + std::to_string(text.size()) + "\n";
+    if (!prop_block.empty() || has_text)
+        result += "Content-length: " + std::to_string(prop_block.size() + text.size()) + "\n";
+    return result + "\n" + prop_block + text + "\n\n";
+}
+
+std::string file(std::string const& path, std::string const& action, std::string const& key, std::string const& text)
+{
+    return node(
+        "Node-path: " + path + "\nNode-kind: file\nNode-action: " + action
+        + "\nText-content-md5: " + key + "\n",
+        props(properties()), true, text);
+}
+
+std::string dir(std::string const& path, std::string const& extra = std::string())
+{
+    return node("Node-path: " + path + "\nNode-kind: dir\nNode-action: add\n" + extra);
+}
+
+std::string make_dump()
+{
+    std::string d = "SVN-fs-dump-format-version: 3\n\nUUID: 4c1ad7a2-0000-0000-0000-000000000000\n\n";
+    d += revision(0, "");
+
+    d += revision(1, "one");
+    d += dir("trunk");
+    d += file("trunk/a.txt", "add", "k-hello", "hello\n");
+    d += dir("trunk/sub");
+    d += file("trunk/sub/b.txt", "add", "k-bee", "bee\n");
+    d += dir("trunk/many");
+    for (int i = 0; i < 100; ++i)
+    {
+        char name[16];
+        std::sprintf(name, "f%03d", 99 - i);
+        d += file(std::string("trunk/many/") + name, "add", "k-empty", "");
+    }
+
+    // "hello\n" -> "hello world\n": copy 5 bytes of the source, then 7 new ones
+    std::string const delta = std::string("SVN\0", 4) + std::string("\x00\x06\x0c\x03\x07", 5)
+        + std::string("\x05\x00\x87", 3) + " world\n";
+    d += revision(2, "two");
+    d += node(
+        "Node-path: trunk/a.txt\nNode-kind: file\nNode-action: change\n"
+        "Text-delta: true\nText-content-md5: k-hello-world\n",
+        std::string(), true, delta);
+    d += node(
+        "Node-path: trunk/sub/b.txt\nNode-kind: file\nNode-action: change\n",
+        props(properties{{"svn:eol-style", "native"}}));
+    d += node("Node-path: trunk/many/f050\nNode-action: delete\n");
+
+    d += revision(3, "three");
+    d += dir("branches");
+    d += dir("branches/b1", "Node-copyfrom-rev: 1\nNode-copyfrom-path: trunk\n");
+    d += file("trunk/sub/b.txt", "change", "k-doomed", "doomed\n");
+    d += node("Node-path: trunk/sub\nNode-action: delete\n");
+    d += dir("trunk/tmp");
+    d += node("Node-path: trunk/tmp\nNode-action: delete\n");
+    d += node(
+        "Node-path: trunk/a.txt\nNode-kind: file\nNode-action: replace\n"
+        "Node-copyfrom-rev: 2\nNode-copyfrom-path: trunk/sub/b.txt\n");
+    d += file("trunk/c.txt", "add", "k-bee", "this text is never read\n");
+    return d;
+}
+
+std::string read_all(svn_dump const& d, long rev, std::string const& path)
+{
+    std::string result;
+    d.file_contents(rev, path, [&](char const* data, std::size_t n) { result.append(data, n); });
+    return result;
+}
+
+void check(std::string const& filename)
+{
+    svn_dump d(filename);
+    assert(d.youngest() == -1);
+
+    assert(d.read_through(0));
+    assert(d.revision_properties(0).at("svn:date") == "2013-07-28T12:00:00.000000Z");
+    assert(d.changes(0).empty());
+    assert(d.check_path(0, "") == svn_dump::dir);
+    assert(d.dir_entries(0, "").empty());
+
+    assert(d.read_through(1));
+    assert(d.revision_properties(1).at("svn:author") == "alice");
+    assert(d.changes(1).size() == 105);
+    assert(d.changes(1)[0].path == "trunk" && d.changes(1)[0].kind == svn_dump::add);
+    assert(d.dir_entries(1, "trunk") == (std::vector<std::string>{"a.txt", "many", "sub"}));
+    auto const trunk = d.list_directory(1, "trunk");
+    assert(trunk.size() == 3 && trunk[0].kind == svn_dump::file && trunk[1].kind == svn_dump::dir);
+    auto const many = d.dir_entries(1, "trunk/many");
+    assert(many.size() == 100 && many.front() == "f000" && many.back() == "f099");
+    assert(std::is_sorted(many.begin(), many.end()));
+    assert(read_all(d, 1, "trunk/a.txt") == "hello\n");
+    assert(d.file_length(1, "/trunk/many/f007") == 0);
+
+    assert(d.read_through(2));
+    auto const c2 = d.changes(2);
+    assert(c2.size() == 3);
+    assert(c2[0].path == "trunk/a.txt" && c2[0].kind == svn_dump::modify && c2[0].text_mod);
+    assert(c2[1].path == "trunk/many/f050" && c2[1].kind == svn_dump::deleted && c2[1].node == svn_dump::file);
+    assert(c2[2].path == "trunk/sub/b.txt" && !c2[2].text_mod && c2[2].prop_mod);
+    assert(read_all(d, 2, "trunk/a.txt") == "hello world\n");
+    assert(d.file_length(2, "trunk/a.txt") == 12);
+    assert(read_all(d, 1, "trunk/a.txt") == "hello\n");
+    assert(d.dir_entries(2, "trunk/many").size() == 99);
+    assert(d.dir_entries(1, "trunk/many").size() == 100);
+    assert(d.check_path(2, "trunk/many/f050") == svn_dump::none);
+
+    assert(d.read_through(3));
+    auto const c3 = d.changes(3);
+    assert(c3.size() == 5);
+    assert(c3[0].path == "branches" && c3[0].kind == svn_dump::add);
+    assert(c3[1].path == "branches/b1" && c3[1].copyfrom_rev == 1 && c3[1].copyfrom_path == "trunk");
+    assert(c3[1].node == svn_dump::dir && !c3[1].text_mod);
+    assert(c3[2].path == "trunk/a.txt" && c3[2].kind == svn_dump::replace);
+    assert(c3[2].copyfrom_path == "trunk/sub/b.txt" && c3[2].node == svn_dump::file);
+    assert(c3[3].path == "trunk/c.txt" && c3[3].kind == svn_dump::add && c3[3].text_mod);
+    assert(c3[4].path == "trunk/sub" && c3[4].kind == svn_dump::deleted && c3[4].node == svn_dump::dir);
+
+    assert(read_all(d, 3, "branches/b1/a.txt") == "hello\n");
+    assert(d.dir_entries(3, "branches/b1/many").size() == 100);
+    auto const b1 = d.list_directory(3, "branches/b1");
+    assert(b1[1].name == "many" && b1[1].id == d.list_directory(1, "trunk")[1].id);
+    assert(b1[1].id != d.list_directory(2, "trunk")[1].id);
+    assert(read_all(d, 3, "trunk/a.txt") == "bee\n");
+    assert(read_all(d, 3, "trunk/c.txt") == "bee\n");
+    assert(d.check_path(3, "trunk/sub") == svn_dump::none);
+    assert(d.check_path(3, "trunk/tmp") == svn_dump::none);
+    assert(d.check_path(2, "trunk/sub") == svn_dump::dir);
+    assert(read_all(d, 2, "trunk/sub/b.txt") == "bee\n");
+
+    bool threw = false;
+    try { d.changes(2); } catch (std::runtime_error const&) { threw = true; }
+    assert(threw);
+
+    assert(!d.read_through(4));
+    assert(d.youngest() == 3);
+}
+
+template <class Compressor>
+void write_compressed(fs::path const& p, std::string const& data, Compressor c)
+{
+    iostreams::filtering_ostream out;
+    out.push(c);
+    out.push(iostreams::file_descriptor_sink(p.string()));
+    out << data;
+}
+
+}
+
+int main()
+{
+    fs::path const dir = fs::temp_directory_path() / fs::unique_path("svn_dump_test-%%%%-%%%%");
+    fs::create_directories(dir);
+    std::string const dump = make_dump();
+
+    {
+        std::ofstream out((dir / "plain").string().c_str(), std::ios::binary);
+        out << dump;
+    }
+    check((dir / "plain").string());
+
+    write_compressed(dir / "gzip", dump, iostreams::gzip_compressor());
+    check((dir / "gzip").string());
+
+    write_compressed(dir / "bzip2", dump, iostreams::bzip2_compressor());
+    check((dir / "bzip2").string());
+
+    fs::remove_all(dir);
+    std::cout << "ok" << std::endl;
+}